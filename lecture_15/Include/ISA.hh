@@ -13,6 +13,7 @@
 
 // 2.1. Load/Store instructions
 #define lbz(RT, RA)		instructions::lbz::execute(RT, RA, __LINE__)
+#define lwz(RT, RA)		instructions::lwz::execute(RT, RA, __LINE__)
 #define stb(RS, RA)		instructions::stb::execute(RS, RA, __LINE__)
 
 // 2.2. Arithmetic instructions
@@ -10,6 +10,26 @@
 #include<iostream>
 #include<iomanip>
 #include<string>
+#include<type_traits>
+#include<functional>
+#include<trace.hh>
+#ifdef PIPELINED_THREADS
+#include<thread>
+#include<mutex>
+#include<condition_variable>
+#include<future>
+#include<deque>
+#include<memory>
+#endif
+
+// All machine state (memory, registers, caches, units, counters) is declared per_machine. In a PIPELINED_THREADS
+// build that is thread-local storage, so each thread simulates its own machine (see class machine below).
+// Otherwise there is a single machine per process and its state is plain global data.
+#ifdef PIPELINED_THREADS
+#define per_machine	thread_local
+#else
+#define per_machine
+#endif
 
 namespace pipelined
 {
@@ -28,14 +48,85 @@ namespace pipelined
 
     extern bool tracing;
 
-    namespace params
+    namespace trace
+    {
+	extern per_machine writer	out;		// the binary trace file of this machine
+	std::string	describe(const operands_t &O);	// text of operands O, with the templates and strings registered so far
+    };
+
+    // Checkpoint file format. A checkpoint is a single file: a header (the 8-byte magic "PLCKPT08", the layout
+    // word, the number of sections), a table of sections (name, offset, size) and the sections themselves, each
+    // starting on a page boundary so that a restore can map the file and copy (or map) each one in place. Section
+    // contents are raw host data, so a checkpoint is only read back by a build with the same layout word.
+    namespace checkpoint
+    {
+	static const char	magic[8] = { 'P', 'L', 'C', 'K', 'P', 'T', '0', '8' };
+	static const u32	page = 4096;		// alignment of the sections in the file
+	static const u32	maxsections = 128;	// entries in the table of sections
+
+	typedef struct
+	{
+	    char	name[48];			// name of the section (NUL terminated)
+	    u64		offset;				// in the file, a multiple of page
+	    u64		size;				// in bytes
+	} section_t;
+
+	typedef struct
+	{
+	    char	magic[8];
+	    u64		layout;				// sizes of the host structures that are saved raw
+	    u64		nsections;			// sections used in the table
+	    u64		reserved;
+	    section_t	table[maxsections];
+	} header_t;
+
+	class writer				// writes the sections of a checkpoint as they are added
+	{
+	    private:
+		FILE*		_file;			// checkpoint file (0 if not open)
+		header_t	_header;		// written last, once all sections are known
+		u64		_end;			// end of the last section
+
+	    public:
+		writer()				{ _file = 0; }
+		~writer()				{ close(); }
+		bool	open(const char *path);				// start a checkpoint file at path
+		bool	close();					// write the table of sections and close the file (false on I/O errors)
+		void	put(const std::string &name, const void *data, u64 size);
+		void	append(const void *data, u64 size);		// more data for the section put last
+		template<typename T> void put(const std::string &name, const std::vector<T> &V)	{ put(name, V.data(), V.size()*sizeof(T)); }
+		template<typename T> void put(const std::string &name, const T &X)		{ static_assert(std::is_trivially_copyable<T>::value, "raw data only"); put(name, &X, sizeof(T)); }
+	};
+
+	class reader				// a checkpoint file, mapped in memory
+	{
+	    private:
+		const u8*	_base;			// the mapped file (0 if not open)
+		u64		_length;		// of the file
+		const header_t*	_header;
+
+	    public:
+		reader()				{ _base = 0; _length = 0; _header = 0; }
+		~reader()				{ close(); }
+		bool		open(const char *path);				// map the checkpoint file at path (false, with a message, if it is not a good one)
+		void		close();
+		const u8*	get(const std::string &name, u64 &size) const;	// the contents of section name (which must be there)
+		template<typename T> void get(const std::string &name, std::vector<T> &V) const	{ u64 size; const u8 *p = get(name, size); assert(size % sizeof(T) == 0); V.resize(size/sizeof(T)); std::copy(p, p + size, (u8*)V.data()); }
+		template<typename T> void get(const std::string &name, T &X) const		{ u64 size; const u8 *p = get(name, size); assert(size == sizeof(T)); std::copy(p, p + size, (u8*)&X); }
+	};
+
+	bool	save(const char *path);		// save the whole state of this machine (false, with a message, if the file cannot be written)
+	bool	restore(const char *path);	// restore a checkpoint into this machine, including its parameters (false, with a message, if it cannot be read)
+    };
+
+    namespace params				// machine parameters: per machine, and configurable at run time (see init() and configure())
     {
 	namespace PRF
 	{
-	    extern const u32	N;
+	    extern per_machine u32	N;
 	};
 
-	namespace GPR
+	namespace GPR				// architected register counts are fixed by the ISA
 	{
 	    extern const u32	N;
 	};
@@ -52,37 +143,75 @@ namespace pipelined
 
 	namespace VRF
 	{
-	    extern const u32 	N;
+	    extern per_machine u32 	N;
+	};
+
+	namespace SB
+	{
+	    extern per_machine u32	N;		// entries of the coalescing store buffer (0: none, stores wait for their line)
+	};
+
+	namespace SQ
+	{
+	    extern per_machine u32	N;		// entries of the store queue (0: none, loads are not ordered against older stores)
+	    extern per_machine u32	forward;	// latency of a load that gets its data from a store in the queue
+	    extern per_machine u32	penalty;	// cycles to replay a load that went ahead of a store it depended on
+	    extern per_machine u32	storesets;	// entries of the store set table (0: no dependence predictor, loads always go ahead)
 	};
 
+	enum replacement_t { LRU, PLRU, SRRIP, BRRIP, RANDOM };	// cache replacement policies
+	enum prefetcher_t { NONE, NEXTLINE, STRIDE, STREAM };		// hardware prefetchers (see caches::prefetcher)
+	enum predictor_t { STATIC, BIMODAL, GSHARE, TAGE };		// branch direction predictors (see branches::predictor); STATIC is "none"
+
 	namespace L1
 	{
-	    extern const u32	nsets;
-	    extern const u32	nways;
-	    extern const u32	linesize;
-	    extern const u32	latency;
+	    extern per_machine u32	nsets;
+	    extern per_machine u32	nways;
+	    extern per_machine u32	linesize;
+	    extern per_machine u32	latency;
+	    extern per_machine replacement_t	replacement;
+	    extern per_machine prefetcher_t	prefetcher;		// of L1D only
+	    extern per_machine u32	prefetchdegree;		// lines a prefetch asks for at a time
+	    extern per_machine u32	prefetchdistance;	// how far ahead of the demand access it asks, in strides (lines for nextline and stream)
+	    extern per_machine u32	mshrs;			// misses L1D can have in flight (0: no limit, and no model of misses in flight)
+	    extern per_machine u32	writeback;		// 1: L1D is write-back (stores write L1D only), 0: write-through
 	};
 
 	namespace L2
 	{
-	    extern const u32	nsets;
-	    extern const u32	nways;
-	    extern const u32	linesize;
-	    extern const u32	latency;
+	    extern per_machine u32	nsets;
+	    extern per_machine u32	nways;
+	    extern per_machine u32	linesize;
+	    extern per_machine u32	latency;
+	    extern per_machine replacement_t	replacement;
+	    extern per_machine prefetcher_t	prefetcher;
+	    extern per_machine u32	prefetchdegree;		// lines a prefetch asks for at a time
+	    extern per_machine u32	prefetchdistance;	// how far ahead of the demand access it asks, in strides (lines for nextline and stream)
+	    extern per_machine u32	mshrs;			// misses L2 can have in flight (0: no limit)
 	};
 
 	namespace L3
 	{
-	    extern const u32	nsets;
-	    extern const u32	nways;
-	    extern const u32	linesize;
-	    extern const u32	latency;
+	    extern per_machine u32	nsets;
+	    extern per_machine u32	nways;
+	    extern per_machine u32	linesize;
+	    extern per_machine u32	latency;
+	    extern per_machine replacement_t	replacement;
+	    extern per_machine u32	mshrs;			// misses L3 can have in flight to memory (0: no limit)
 	};
 
 	namespace MEM
 	{
-	    extern const u32	N;
-	    extern const u32	latency;
+	    extern per_machine u32	latency;
+	};
+
+	namespace BP
+	{
+	    extern per_machine predictor_t	predictor;	// none: fetch goes on past every branch, and a taken one redirects it once it completes
+	    extern per_machine u32	entries;		// 2-bit counters of bimodal and gshare, and of the base table of TAGE (a power of 2)
+	    extern per_machine u32	history;		// bits of global history gshare uses
+	    extern per_machine u32	btb;			// entries of the branch target buffer (0: none, a taken branch waits for decode)
+	    extern per_machine u32	penalty;		// cycles a redirect costs, on top of waiting for the branch to complete
 	};
 
 	namespace Frontend
@@ -94,31 +223,43 @@ namespace pipelined
 
 	    namespace DECODE
 	    {
-		extern const u32	latency;
+		extern per_machine u32	latency;
 	    };
 
 	    namespace DISPATCH
 	    {
-		extern const u32	latency;
+		extern per_machine u32	latency;
 	    };
 	};
 
 	namespace Backend
 	{
-	    extern const u32	maxissue;	// maximum operations that can be issued per cycle
+	    extern per_machine u32	maxissue;	// maximum operations that can be issued per cycle
 	};
 
+	// Parameters are named after their namespaces ("L2.nways", "MEM.latency", "Backend.maxissue", ...).
+	// A config file has one "key = value" per line, and '#' starts a comment. Replacement policies are
+	// lru, plru, srrip, brrip or random; prefetchers are none, nextline, stride or stream; sizes can have a
+	// K or M suffix. Lx.mshrs = 0 (the default) leaves the misses of that level unlimited and untracked.
+	std::vector<std::string>	keys();						// names of all the parameters
+	bool		set(const std::string &key, const std::string &value);		// set parameter key (false, with a message, if key or value is bad)
+	std::string	get(const std::string &key);					// current value of parameter key
+	bool		load(const char *path);						// set the parameters in config file path
+	std::string	check();							// why the parameters are inconsistent ("" if they are not)
+	void		configure();							// size memory, register files and caches from the parameters (all state is reset)
+	void		init(int &argc, char **argv);					// PIPELINED_CONFIG, then "-c file" and "key=value" arguments (removed from argv); exits on error
     };
 
     namespace counters
     {
-	extern u64	instructions;
-	extern u64	operations;
-	extern u64	cycles;
-	extern u64	lastissued;	// cycle the last operation in program order issued
-	extern u64	lastcompleted;	// cycle the last operation in program order completed
-	extern u64	lastfetch;	// cycle the last fetch started
-	extern u64	lastfetched;	// cycle the last fetch completed
+	extern per_machine u64	instructions;
+	extern per_machine u64	operations;
+	extern per_machine u64	cycles;
+	extern per_machine u64	lastissued;	// cycle the last operation in program order issued
+	extern per_machine u64	lastcompleted;	// cycle the last operation in program order completed
+	extern per_machine u64	lastfetch;	// cycle the last fetch started
+	extern per_machine u64	lastfetched;	// cycle the last fetch completed
+	extern per_machine u64	taken;		// taken branches (each one redirects the fetch, unless predicted)
     };
 
     static u64 max(u64 a)			{ return a; }
@@ -215,14 +356,31 @@ namespace pipelined
 	    void used(u64 cycle)	{ _used = max(_used, cycle); }
     };
 
+    template<typename T> class freelist		// free physical registers, ordered by the cycle they were last used
+    {
+	private:
+	    std::vector<u64>			_free;		// bitmap of free registers
+	    std::vector<std::pair<u64,u32> >	_heap;		// min-heap of (used, index), may hold stale entries
+
+	    void push(u64 used, u32 idx);
+
+	public:
+	    void reset(const std::vector<preg<T> > &R);			// rebuild from the busy flags of register file R
+	    void release(std::vector<preg<T> > &R, u32 idx);		// register idx of R is free again
+	    u32  first(const std::vector<preg<T> > &R, u32 next);	// first free register at or after next (R.size() if none)
+	    u32  earliest(std::vector<preg<T> > &R, u32 &next);		// allocate the free register with the earliest used() (R.size() if none)
+	    void take(std::vector<preg<T> > &R, u32 idx);		// allocate register idx of R
+    };
+
     namespace PRF
     {
-	extern std::vector<preg<u64> >	R;	// physical register file (for all scalar registers)
-	extern u32			next;	// next physical register to use				
+	extern per_machine std::vector<preg<u64> >	R;	// physical register file (for all scalar registers)
+	extern per_machine u32			next;	// next physical register to use				
+	extern per_machine freelist<u64>		free;	// free physical registers
+	extern per_machine u64			stalls;	// renames that waited for a free register to be read for the last time
 
-	u32	find_first();
-	u32	find_earliest();
-	u32	find_next();
+	u32	find_next(u64 cycle);		// allocate the free register with the earliest used(), for a rename at cycle
+	void	release(u32 idx);		// physical register idx is no longer mapped
     };
 
     union vector
@@ -239,10 +397,13 @@ namespace pipelined
 
     namespace VRF
     {
-	extern std::vector<preg<vector> >	V;	// physical register file for vectors
-	extern u32				next;	// next physical vector register to use
+	extern per_machine std::vector<preg<vector> >	V;	// physical register file for vectors
+	extern per_machine u32				next;	// next physical vector register to use
+	extern per_machine freelist<vector>			free;	// free physical vector registers
+	extern per_machine u64				stalls;	// renames that waited for a free register to be read for the last time
 
-	u32	find_next();
+	u32	find_next(u64 cycle);			// allocate the free register with the earliest used(), for a rename at cycle
+	void	release(u32 idx);			// physical vector register idx is no longer mapped
     };
 
     template<typename T> class reg	// an architected register
@@ -257,6 +418,7 @@ namespace pipelined
 	    u64& ready()		{ return PRF::R[_idx].ready(); }
 	    const bool& busy() const 	{ return PRF::R[_idx].busy(); }
 	    bool& busy()		{ return PRF::R[_idx].busy(); }
+	    void release()		{ PRF::release(_idx); }
 	    void used(u64 cycle)	{ return PRF::R[_idx].used(cycle); }
 	    const u32& idx() const	{ return _idx; }
 	    u32& idx()			{ return _idx; }
@@ -274,53 +436,295 @@ namespace pipelined
 	    u64& ready()		{ return VRF::V[_idx].ready(); }
 	    const bool& busy() const 	{ return VRF::V[_idx].busy(); }
 	    bool& busy()		{ return VRF::V[_idx].busy(); }
+	    void release()		{ VRF::release(_idx); }
 	    void used(u64 cycle)	{ return VRF::V[_idx].used(cycle); }
 	    const u32& idx() const	{ return _idx; }
 	    u32& idx()			{ return _idx; }
     };
 
-    extern std::vector<u8>		MEM;
-    extern std::vector<reg<u32> >	GPR;
-    extern std::vector<reg<double> >	FPR;
-    extern std::vector<vreg>		VR;
-    extern flags_t			flags;
+    class memory				// the simulated memory: the whole 32-bit address space, reserved up front and backed by host pages on first touch
+    {
+	private:
+	    u8*		_base;			// start of the reservation
+	    std::vector<std::pair<u32,u32> >	_mapped;	// pages mapped from files since the last clear (first, count)
+
+	public:
+	    static const u64	span = (u64)1 << 32;	// bytes of simulated memory
+	    static const u64	page = 4096;		// granularity of pages() (the host's pages are a multiple of it)
+
+	    memory();
+	    ~memory();
+	    memory(const memory&) = delete;
+	    memory& operator=(const memory&) = delete;
+	    u8*		data()				{ return _base; }
+	    const u8*	data() const			{ return _base; }
+	    u64		size() const			{ return span; }
+	    u8&		operator[](u64 addr)		{ return _base[addr]; }
+	    const u8&	operator[](u64 addr) const	{ return _base[addr]; }
+	    void	clear();			// all bytes back to 0, returning the touched pages to the host (the cost is in the touched pages only)
+	    std::vector<u32>	pages() const;		// pages that were touched (backed by the host, in memory or swapped out), in address order (all others are still 0)
+	    bool	map(u64 addr, const char *path, u64 &size);	// map file path at addr (a multiple of the host page size) copy-on-write, so the file is never written; size is the file's
+    };
+
+    extern per_machine memory			MEM;
+
+    // Memory images. A manifest names regions of MEM, one per line:
+    //
+    //	name = address file		input region: the contents of file (relative to the manifest), at address
+    //	name = address size		output region: size bytes at address, left as they are
+    //
+    // Loading an image maps each file straight into MEM when its address is a multiple of the page size (copying
+    // it otherwise), so large inputs are staged once and shared by all the runs that use them.
+    namespace image
+    {
+	typedef struct
+	{
+	    std::string	name;
+	    u32		addr;			// first byte in MEM
+	    u64		size;			// in bytes
+	    std::string	file;			// where an input region comes from ("" for an output region)
+	} region_t;
+
+	extern per_machine std::vector<region_t>	regions;	// regions defined or loaded so far
+
+	void		define(const std::string &name, u32 addr, u64 size);	// a region of MEM, to save() or dump()
+	const region_t*	find(const std::string &name);				// region name (0 if none)
+	bool		load(const char *path);					// load the regions of manifest path into MEM (false, with a message, on errors)
+	bool		save(const char *path);					// write the manifest path, and the contents of each region to path.name
+	bool		dump(const std::string &name, const char *path);	// write the contents of region name to file path
+    };
+    extern per_machine std::vector<reg<u32> >	GPR;
+    extern per_machine std::vector<reg<double> >	FPR;
+    extern per_machine std::vector<vreg>		VR;
+    extern per_machine flags_t			flags;
 
     namespace units
     {
 	class unit
 	{
 	    private:
-		std::set<u64>	_busy;
+		std::vector<u64>	_busy;		// reservation bitmap, one bit per cycle, indexed by cycle modulo the window
+		u64			_base;		// oldest cycle still tracked (older ones have been retired)
+		u64			_window;	// number of cycles tracked, always a power of 2
+
+		void grow(u64 cycle);							// widen the window so that it covers cycle
 
 	    public:
-		unit() 					{ }
-		void clear()				{ _busy.clear(); }
-		const bool busy(u64 cycle) const	{ return _busy.count(cycle); }
-		void claim(u64 cycle) 			{ _busy.insert(cycle); }
+		u64			operations;	// counter of operations issued to this unit
+		u64			claims;		// counter of cycles reserved on this unit
+
+		unit() 					{ _window = 1024; _busy.resize(_window/64); _base = 0; operations = 0; claims = 0; }
+		void clear()				{ std::fill(_busy.begin(), _busy.end(), 0); _base = 0; operations = 0; claims = 0; }
+		const bool busy(u64 cycle) const
+		{
+		    if ((cycle < _base) || (cycle >= _base + _window)) return false;	// outside the window, nothing reserved
+		    u64 slot = cycle & (_window - 1);
+		    return (_busy[slot/64] >> (slot%64)) & 1;
+		}
+		void claim(u64 cycle)
+		{
+		    assert(cycle >= _base);						// cannot reserve a retired cycle
+		    if (cycle >= _base + _window) grow(cycle);
+		    u64 slot = cycle & (_window - 1);
+		    _busy[slot/64] |= (u64)1 << (slot%64);
+		    claims++;
+		}
+		void retire(u64 cycle);							// forget all reservations before cycle
+		void save(checkpoint::writer &W, const std::string &name) const;
+		void restore(const checkpoint::reader &R, const std::string &name);
 	};
 
-	extern unit	LDU;	// load unit
-	extern unit	STU;	// store unit
-	extern unit	FXU;	// fixed-point unit
-	extern unit	FPU;	// floating-point unit
-	extern unit	BRU;	// branch unit
-	extern unit	VU;	// vector unit
+	extern per_machine unit	LDU;	// load unit
+	extern per_machine unit	STU;	// store unit
+	extern per_machine unit	FXU;	// fixed-point unit
+	extern per_machine unit	FPU;	// floating-point unit
+	extern per_machine unit	BRU;	// branch unit
+	extern per_machine unit	VU;	// vector unit
     };
 
     namespace caches
     {
-        class entry                             // cache entry
+	class policy					// replacement policy: picks the way to replace when all ways of a set are valid
+	{
+	    protected:
+		u32		_nsets;
+		u32		_nways;
+		u32		_seed;						// state of the pseudo-random generator
+		u32		random();					// next pseudo-random number (xorshift)
+
+	    public:
+		policy(u32 nsets, u32 nways)				{ _nsets = nsets; _nways = nways; _seed = 1; }
+		virtual ~policy()					{ }
+		virtual void	clear()					{ _seed = 1; }	// back to the initial state
+		virtual void	touch(u32 setix, u32 wayix)		{ }		// line at setix, wayix was hit
+		virtual void	insert(u32 setix, u32 wayix)		{ }		// line at setix, wayix was filled
+		virtual u32	victim(u32 setix) = 0;					// way to replace in set setix
+		virtual void	save(checkpoint::writer &W, const std::string &name) const	{ W.put(name + ".seed", _seed); }
+		virtual void	restore(const checkpoint::reader &R, const std::string &name)	{ R.get(name + ".seed", _seed); }
+
+		static policy*	create(params::replacement_t kind, u32 nsets, u32 nways, const std::vector<u64> &touched, u32 stride);
+	};
+
+	class lru : public policy			// exact LRU, from the last-touched stamps of the lines
+	{
+	    private:
+		const std::vector<u64>	&_touched;				// the stamps, kept by the cache
+		u32			_stride;				// ways per set in the stamp array
+
+	    public:
+		lru(u32 nsets, u32 nways, const std::vector<u64> &touched, u32 stride) : policy(nsets, nways), _touched(touched) { _stride = stride; }
+		u32	victim(u32 setix);
+	};
+
+	class plru : public policy			// tree pseudo-LRU, nways-1 bits per set
+	{
+	    private:
+		std::vector<u64>	_tree;					// node n of the tree of set s is bit n of _tree[s] (root is n = 1)
+
+	    public:
+		plru(u32 nsets, u32 nways);
+		void	clear();
+		void	touch(u32 setix, u32 wayix);
+		void	insert(u32 setix, u32 wayix)	{ touch(setix, wayix); }
+		u32	victim(u32 setix);
+		void	save(checkpoint::writer &W, const std::string &name) const	{ policy::save(W, name); W.put(name + ".tree", _tree); }
+		void	restore(const checkpoint::reader &R, const std::string &name)	{ policy::restore(R, name); R.get(name + ".tree", _tree); }
+	};
+
+	class rrip : public policy			// static (SRRIP) or bimodal (BRRIP) re-reference interval prediction, 2 bits per line
+	{
+	    private:
+		static const u8		distant = 3;				// largest re-reference prediction value
+		bool			_bimodal;				// BRRIP: insert at distant, except 1 in 32 at distant-1
+		std::vector<u8>		_rrpv;					// prediction value of each line
+
+	    public:
+		rrip(u32 nsets, u32 nways, bool bimodal);
+		void	clear();
+		void	touch(u32 setix, u32 wayix)	{ _rrpv[setix*_nways + wayix] = 0; }
+		void	insert(u32 setix, u32 wayix);
+		u32	victim(u32 setix);
+		void	save(checkpoint::writer &W, const std::string &name) const	{ policy::save(W, name); W.put(name + ".rrpv", _rrpv); }
+		void	restore(const checkpoint::reader &R, const std::string &name)	{ policy::restore(R, name); R.get(name + ".rrpv", _rrpv); }
+	};
+
+	class randomized : public policy		// pseudo-random victim
+	{
+	    public:
+		randomized(u32 nsets, u32 nways) : policy(nsets, nways) { }
+		u32	victim(u32 setix)		{ return random() % _nways; }
+	};
+
+	class prefetcher				// hardware prefetcher of a cache: watches its demand accesses and asks for the lines likely to come next
+	{
+	    public:
+		typedef struct
+		{
+		    u32		line;					// line address (address / linesize) to bring in
+		    u64		cycle;					// cycle of the demand access that asked for it
+		} request_t;
+
+	    private:
+		static const u32	nstrides = 64;			// entries of the stride table, indexed by instruction address
+		static const u32	nstreams = 16;			// streams tracked at once
+		static const u32	window = 4;			// misses up to this many lines (plus distance and degree) past a stream continue it
+
+		typedef struct
+		{
+		    u32		pc;					// instruction address
+		    u32		last;					// last address it accessed
+		    i32		stride;					// between its last two accesses
+		    u32		confidence;				// times in a row the stride repeated (saturates at 3)
+		} stride_t;
+
+		typedef struct
+		{
+		    u32		last;					// line of the last miss of the stream
+		    i32		direction;				// +1 (ascending), -1 (descending) or 0 (not known yet)
+		    u32		confidence;				// misses that followed the direction (saturates at 3)
+		    u64		touched;				// for replacing the least recently used stream
+		} stream_t;
+
+		params::prefetcher_t	_kind;
+		u32			_degree;
+		u32			_distance;
+		std::vector<stride_t>	_strides;
+		std::vector<stream_t>	_streams;
+		u64			_clock;				// stream updates so far
+		std::vector<request_t>	_requests;			// asked for, not issued yet
+
+		void	request(u32 line, u32 demand, u64 cycle);	// ask for line (not the demand line, nor twice)
+
+	    public:
+		u64		issued;					// counter of lines brought in by prefetches
+		u64		useful;					// counter of prefetched lines later hit by a demand access
+		u64		late;					// counter of useful prefetches that were not ready when the demand access could issue
+		u64		useless;				// counter of prefetched lines evicted before any demand access hit them
+
+		prefetcher()						{ configure(params::NONE, 1, 1); }
+		void		configure(params::prefetcher_t kind, u32 degree, u32 distance);	// (it is cleared)
+		void		clear();					// forget what was learned, the requests and the statistics
+		params::prefetcher_t	kind() const			{ return _kind; }
+		bool		active() const				{ return _kind != params::NONE; }
+		bool		idle() const				{ return _requests.empty(); }
+		void		train(u32 pc, u32 EA, u32 linesize, bool miss, bool first, u64 cycle);	// a demand access to EA by the instruction at pc (a miss, or the first hit to a prefetched line)
+		std::vector<request_t>&	requests()			{ return _requests; }
+		void		save(checkpoint::writer &W, const std::string &name) const;
+		void		restore(const checkpoint::reader &R, const std::string &name);
+	};
+
+	class mshrs					// miss status holding registers of a cache: the misses it has in flight, at most one per register
+	{
+	    public:
+		typedef struct
+		{
+		    u32		line;					// line address of the miss
+		    u64		ready;					// cycle its data arrive, and the register is free again
+		} miss_t;
+
+	    private:
+		std::vector<miss_t>	_misses;			// one per register (none: the cache does not track its misses)
+
+	    public:
+		u64		allocated;				// counter of primary misses (each one took a register)
+		u64		merged;					// counter of secondary misses (accesses to a line already in flight)
+		u64		stalls;					// counter of primary misses that had to wait for a free register
+		u64		stalled;				// counter of cycles they waited
+
+		mshrs()							{ configure(0); }
+		void		configure(u32 n);				// n registers (it is cleared)
+		void		clear();					// no misses in flight, and no statistics
+		bool		active() const				{ return !_misses.empty(); }
+		u32		size() const				{ return _misses.size(); }
+		u64		free() const;					// first cycle a register is free
+		u64		pending(u32 line) const;			// cycle the data of line arrive, if it missed (0 if it never did)
+		void		allocate(u32 line, u64 ready);			// a primary miss of line, with its data at ready, takes the first free register
+		void		save(checkpoint::writer &W, const std::string &name) const;
+		void		restore(const checkpoint::reader &R, const std::string &name);
+	};
+
+	class cache;
+
+        class entry                             // cache entry: a reference to one line of a cache
         {
+            private:
+		cache*		_cache;		// cache that holds the line (0 for a null entry)
+		u32		_ix;		// index of the line in the cache arrays
+
+		friend class cache;
+
             public:
-                bool            valid;          // is entry valid?
-		bool		modified;	// has entry been modified?
-                uint32_t        addr;           // address of this entry
-                uint64_t        touched;        // last time this entry was used
-		u64             ready;          // cycle data are ready after a miss
-		std::vector<u8>	data;		// data in this entry
-
-		entry(u32 linesize) : data(linesize) { }				// creates a cache entry with linesize bytes of storage
-		entry()	{ }								// default constructor, to be filled later
+		entry()					{ _cache = 0; _ix = 0; }	// a null entry
+		entry(cache *c, u32 ix)			{ _cache = c; _ix = ix; }
+		bool		null() const		{ return _cache == 0; }		// does not refer to any line?
+		bool		valid() const;						// is entry valid?
+		bool		modified() const;					// has entry been modified?
+		u32		addr() const;						// line address of this entry
+		u64		touched() const;					// last time this entry was used
+		u64		ready() const;						// cycle data are ready after a miss
+		bool		prefetched() const;					// was the line brought in by a prefetch, and not hit since?
+		u8*		data() const;						// data in this entry
+		void		invalidate();						// entry is no longer valid
 		void store	(u32 EA, double D);					// stores double-precision value D in address EA
 		void store	(u32 EA, u8	B);					// store byte B in address EA
 		void store	(u32 EA, const vector &V);				// store vector V in address EA
@@ -329,80 +733,390 @@ namespace pipelined
 		void store	(u32 EA, const float (&V)[ 4], const u32 (&M)[4 ]);	// store bytes of vector V in address EA, under control of mask M
         };
 
-        typedef std::vector<entry>      set;
-        typedef std::vector<set>        array;
-
         class cache
         {
             private:
+		static const u32 invalid = 0xffffffff;			// tag of an invalid line (never a line address, since linesize > 1)
+		static const u32 simd = 8;				// ways are padded to a multiple of this, for vector tag compares
+
                 uint32_t        _nsets;
                 uint32_t        _nways;
                 uint32_t        _linesize;
-                array           _sets;
+		u32		_stride;				// ways per set in the arrays (nways rounded up to simd)
+		std::vector<u32>	_tags;				// line address of each line, or invalid
+		std::vector<u8>		_modified;			// has line been modified?
+		std::vector<u64>	_touched;			// last time each line was used
+		std::vector<u64>	_ready;				// cycle data are ready in each line after a miss
+		std::vector<u8>		_prefetched;			// was line brought in by a prefetch, and not hit by a demand access since?
+		std::vector<u8>		_data;				// line data, linesize bytes per line, contiguous
+		params::replacement_t	_replacement;			// kind of replacement policy
+		policy*			_policy;			// replacement policy
+		bool			_writeback;			// modified lines replaced by a fill go to the level below (the source of fills)
+
+		u32		index(u32 setix, u32 wayix) const	{ return setix*_stride + wayix; }
+		u32		match(u32 setix, u32 tag) const;	// way of set setix with this tag (nways() if none)
+		u32		victim(u32 setix);			// way to replace in set setix (an invalid one if any)
+		void		writeback(u32 ix, memory &M);			// copy line ix to memory, if modified
+
+		friend class entry;
 
             public:
 		u64		accesses;					// counter of number of accesses
 		u64		misses;						// counter of number of misses
 		u64		hits;						// counter of number of hits
+		u64		writes;						// counter of writes from above (stores, stores written through, lines written back)
+		prefetcher	prefetch;					// of this cache (none by default)
+		mshrs		mshr;						// of this cache (none by default)
 
-                cache(uint32_t nsets, uint32_t nways, uint32_t linesize);	// construct a cache of size nsets x nways x linesize bytes
+                cache(uint32_t nsets, uint32_t nways, uint32_t linesize, params::replacement_t replacement = params::LRU);	// construct a cache of size nsets x nways x linesize bytes
+		~cache();
+		cache(const cache&) = delete;					// it owns its policy, and the entries and the policy point back into it
+		cache& operator=(const cache&) = delete;
+		void		configure(u32 nsets, u32 nways, u32 linesize);	// change the geometry of the cache (it is cleared)
 
                 uint32_t        nsets() const;       			   	// number of sets
                 uint32_t        nways() const;          			// number of ways
                 uint32_t        linesize() const;    			   	// in bytes
                 uint32_t        capacity() const;     			  	// in bytes
-                array&          sets();                			 	// cache array
+		params::replacement_t	replacement() const;			// current replacement policy
+		void		replacement(params::replacement_t kind);	// change the replacement policy (and reset its state)
+		bool		writeback() const			{ return _writeback; }
+		void		writeback(bool on)			{ _writeback = on; }	// write-back (true) or write-through (false, the default)
+		void		writeback(entry T);				// if the line of T (just moved a level below) is modified here, write it into T
+		entry		line(u32 setix, u32 wayix);			// the entry at set setix, way wayix
 		bool		contains(u32 EA, u32 L);			// tests if cache contains data in address range [EA, EA+L)
 		bool            contains(u32 EA, u32 L, u64 &ready);            // tests if cache contains data in address range [EA, EA+L)
 		bool		contains(u32 WA, u32 L, u32 &set, u32 &way);	// returns the set and way that contain the data (if true)
-		u8*		fill(u32 EA, u32 L, std::vector<u8> &M);	// loads data in address range [EA, EA+L) from memory into this cache, returns a pointer to the data in cache
-		u8*		fill(u32 EA, u32 L, entry &E);			// loads data in address range [EA, EA+L) from another cache's entry into this cache, returns a pointer to the data in cache
+		entry		fill(u32 EA, u32 L, memory &M);			// loads data in address range [EA, EA+L) from memory into this cache, returns the entry that holds it
+		entry		fill(u32 EA, u32 L, entry E);			// loads data in address range [EA, EA+L) from another cache's entry into this cache, returns the entry that holds it
                 void            clear();                			// clear the cache
+		void		invalidate();					// drop all lines, without writing them back (statistics are kept)
+		void		sync(const memory &M);				// reload the data of all valid lines from M, which is up to date (they are no longer modified)
                 void            flush();                			// write back to memory any modified data in cache
 		u32		lineaddr(u32 EA);				// returns the line address for effective address EA;
 		u32		offset(u32 EA);					// returns the offset within a line for effective address EA;
-		entry*		find(u32 EA, u32 L);				// find the cache entry for the effective address range [EA, EA+L)
-		entry*		evict(u32 EA, u32 L, std::vector<u8> &M);	// free up a cache entry to store address range [EA, EA+L) by evicting to memory
-		entry*		evict(u32 EA, u32 L, entry &E);			// free up a cache entry to store address range [EA, EA+L) by evicting to another cache
-		entry*		evict(u32 EA, u32 L);				// evict a cache entry with address range [EA, EA+L) to oblivion (for write-through cache only)
+		entry		find(u32 EA, u32 L);				// find the cache entry for the effective address range [EA, EA+L) (null if not there)
+		entry		evict(u32 EA, u32 L, memory &M);		// free up a cache entry to store address range [EA, EA+L) by evicting to memory
+		entry		evict(u32 EA, u32 L, entry E);			// free up a cache entry to store address range [EA, EA+L) by evicting to another cache
+		entry		evict(u32 EA, u32 L);				// evict a cache entry with address range [EA, EA+L) to oblivion (for write-through cache only)
 		void		access(u32 EA, u32 L);				// count number of accesses
 		void		hit(u32 EA, u32 L);				// count number of hits
+		bool		hitline(u32 setix, u32 wayix);			// count a hit on the line at setix, wayix (already located), true if it was a prefetched one
+		void		prefetched(entry E, u64 ready);			// line E was just brought in by a prefetch, and is ready at cycle ready
+		void		arrives(entry E, u64 ready);			// line E was just filled by a miss in flight, and is ready at cycle ready
 		void		miss(u32 EA, u32 L);				// count number of misses
+		void		save(checkpoint::writer &W, const std::string &name) const;	// lines, replacement state and statistics
+		void		restore(const checkpoint::reader &R, const std::string &name);	// same geometry and policy as when saved
         };
 
-        extern cache L1D;
-        extern cache L1I;
-        extern cache L2;
-        extern cache L3;
+	inline bool	entry::valid() const		{ return _cache->_tags[_ix] != cache::invalid; }
+	inline bool	entry::modified() const		{ return _cache->_modified[_ix]; }
+	inline u32	entry::addr() const		{ return _cache->_tags[_ix]; }
+	inline u64	entry::touched() const		{ return _cache->_touched[_ix]; }
+	inline u64	entry::ready() const		{ return _cache->_ready[_ix]; }
+	inline bool	entry::prefetched() const	{ return _cache->_prefetched[_ix]; }
+	inline u8*	entry::data() const		{ return _cache->_data.data() + (u64)_ix * _cache->_linesize; }
+	inline void	entry::invalidate()
+	{
+	    if (_cache->_prefetched[_ix]) { _cache->prefetch.useless++; _cache->_prefetched[_ix] = false; }	// it leaves the cache unused
+	    _cache->_tags[_ix] = cache::invalid; _cache->_modified[_ix] = false;
+	}
+
+        extern per_machine cache L1D;
+        extern per_machine cache L1I;
+        extern per_machine cache L2;
+        extern per_machine cache L3;
+
+	typedef struct
+	{
+	    u32		level;		// level that held the line when looked up: 1 (L1D), 2 (L2), 3 (L3) or 4 (memory), 0 if not looked up
+	    u32		setix;		// set of the line at that level
+	    u32		wayix;		// way of the line at that level
+	    u64		ready;		// cycle the access can have the line: when it is ready where found, or a miss can go (0 if no wait)
+	    entry	line;		// entry that holds the line at that level (the L1D entry once loaded, null if in memory)
+	    u8*		data;		// data at the effective address, in line
+	} access_t;
+
+	access_t	lookup(u32 EA, u32 L);		// find where address range [EA, EA+L) is in the hierarchy, probing each level at most once
+	u32		latency(const access_t &A);	// load latency for data found at A
+
+	extern per_machine u64	demand;			// cycle the operation being processed could issue, were its data ready
+	void		issue();			// bring in the lines the prefetchers of L1D and L2 asked for
+	void		track(u32 EA, u32 L, const access_t &A);	// the access A, just loaded into L1D, in the MSHRs: merged with a miss in flight, or a new one
+	inline bool	tracking()			{ return L1D.mshr.active() || L2.mshr.active() || L3.mshr.active(); }
+
+	class storebuffer				// coalescing store buffer: stores retire into it, and each entry writes its line once the line is in L1D
+	{
+	    public:
+		typedef struct
+		{
+		    u32		line;					// line address of the stores in the entry
+		    u64		drained;				// cycle the line is written, and the entry is free again
+		} slot_t;
+
+	    private:
+		std::vector<slot_t>	_slots;				// one per entry (none: there is no store buffer)
+
+	    public:
+		u64		stores;					// counter of stores that went into the buffer
+		u64		coalesced;				// counter of stores merged into the entry of an earlier store to the same line
+		u64		drains;					// counter of entries written (one line write each)
+		u64		stalls;					// counter of stores that waited for a free entry
+		u64		stalled;				// counter of cycles they waited
+
+		storebuffer()						{ configure(0); }
+		void		configure(u32 n);				// n entries (it is cleared)
+		void		clear();					// empty, and no statistics
+		bool		active() const				{ return !_slots.empty(); }
+		u32		size() const				{ return _slots.size(); }
+		u64		pending(u32 line, u64 cycle) const;		// cycle the stores to line still in the buffer at cycle are written (0 if none)
+		u64		ready(u32 line, u64 cycle) const;		// first cycle from cycle on a store to line can go in: at once to coalesce, else once an entry is free
+		u64		insert(u32 line, u64 cycle, u64 written);	// a store to line goes in at cycle; returns when its entry drains (written, if it is a new one)
+		void		save(checkpoint::writer &W, const std::string &name) const;
+		void		restore(const checkpoint::reader &R, const std::string &name);
+	};
+
+	extern per_machine storebuffer	SB;		// between the core and L1D (none by default)
+	bool		stored(u32 EA, const access_t &A, u64 &written);	// a store to EA, found at A, was just written to L1D (by cycle written): true if it must be written to L2 too (write-through)
+	inline void	prefetch()			{ if (!L1D.prefetch.idle() || !L2.prefetch.idle()) issue(); }	// before the next lookup
     };
 
-    extern uint32_t     CIA;                    // current instruction address
-    extern uint32_t     NIA;                    // next instruction address
+    extern per_machine uint32_t     CIA;                    // current instruction address
+    extern per_machine uint32_t     NIA;                    // next instruction address
 
     void zeromem();
     void zeroctrs();
 
+    // Golden records of the simulated timing. With PIPELINED_GOLDEN=file, each call to record() appends a CSV line to
+    // file: the test, the test point and the counts of the run just done (instructions, operations, cycles, and the
+    // accesses, hits and misses of each cache level). Tests/golden.csv is such a file, and Tools/golden compares a
+    // new one with it field by field, so that a change to the simulator that changes its timing does not go unnoticed.
+    namespace golden
+    {
+	extern const char	header[];						// the first line of a golden file
+	void	record(const char *test, const std::string &point);			// nothing if PIPELINED_GOLDEN is not set
+    };
+
+    // Statistics registry: named counters, histograms and formulas, grouped by component with dotted names
+    // (caches.L1D.misses, units.FPU.busy_cycles, prf.rename_stalls). A counter refers to a variable the simulator
+    // updates anyway, and reports how much it grew since the last reset(), so that a region of a run (between two
+    // reset() calls, or a reset() and a dump()) can be measured without touching the machine state. zeroctrs()
+    // resets the registry. The built-in statistics are registered on first use; more can be added at any time.
+    // The exports also give the record of each static branch executed in the region, as branches.sites.<address>.*
+    // (executed, taken, mispredicted, btb_misses and accuracy).
+    namespace stats
+    {
+	class histogram				// counts of samples in power-of-2 buckets: 0, 1, 2-3, 4-7, ...
+	{
+	    private:
+		static const u32	nbuckets = 33;	// the last one takes all samples of 2^31 and above
+		u64			_buckets[nbuckets];
+		u64			_samples;
+		u64			_sum;
+
+	    public:
+		histogram()				{ clear(); }
+		void	clear()				{ std::fill(_buckets, _buckets + nbuckets, 0); _samples = 0; _sum = 0; }
+		void	sample(u64 v)			{ _buckets[v ? std::min<u32>(64 - __builtin_clzll(v), nbuckets - 1) : 0]++; _samples++; _sum += v; }
+		u32	size() const			{ return nbuckets; }
+		u64	bucket(u32 i) const		{ return _buckets[i]; }
+		u64	low(u32 i) const		{ return i ? (u64)1 << (i - 1) : 0; }	// smallest sample in bucket i
+		u64	samples() const			{ return _samples; }
+		double	mean() const			{ return _samples ? (double)_sum/_samples : 0.0; }
+	};
+
+	typedef enum { COUNTER, HISTOGRAM, FORMULA } kind_t;
+
+	typedef struct
+	{
+	    std::string			name;		// component.subcomponent.statistic
+	    std::string			description;
+	    kind_t			kind;
+	    const u64*			counter;	// COUNTER: the variable
+	    u64				base;		// COUNTER: its value at the last reset
+	    histogram*			hist;		// HISTOGRAM
+	    std::function<double()>	formula;	// FORMULA: of other statistics, see value()
+	} stat_t;
+
+	extern per_machine histogram	dispatch;	// cycles from dispatch to issue, of each operation
+
+	void		counter(const std::string &name, const u64 &var, const std::string &description);
+	void		distribution(const std::string &name, histogram &H, const std::string &description);
+	void		formula(const std::string &name, std::function<double()> F, const std::string &description);
+	const stat_t*	find(const std::string &name);			// statistic name (0 if none)
+	std::vector<std::string>	names();			// of all statistics, in the order they were registered
+	double		value(const std::string &name);			// of counter (since the last reset) or formula name (which must be there)
+	void		reset();					// start a region: counters count from here, histograms are cleared
+	void		json(std::ostream &out);			// nested objects, one per component (and per static branch, under branches.sites)
+	void		csv(std::ostream &out);				// name,value lines (a histogram gives its samples, mean and buckets)
+	bool		dump(const char *path);				// as JSON if path ends in .json, as CSV otherwise (false, with a message, on errors)
+    };
+
+#ifdef PIPELINED_THREADS
+    class machine				// a simulated machine: a thread of its own, whose per_machine state is the machine state
+    {
+	private:
+	    std::thread				_thread;	// the thread that runs the jobs
+	    std::mutex				_lock;		// guards _jobs and _done
+	    std::condition_variable		_wake;		// signals new jobs, or the end
+	    std::deque<std::function<void()> >	_jobs;		// jobs waiting to run, in order
+	    bool				_done;		// no more jobs will come
+
+	    void loop();						// run jobs until done
+
+	public:
+	    machine();
+	    ~machine();							// finish the pending jobs and stop the thread
+
+	    template<typename F> auto run(F job) -> std::future<decltype(job())>	// run job on this machine, after the jobs already queued
+	    {
+		auto task = std::make_shared<std::packaged_task<decltype(job())()> >(job);
+		auto result = task->get_future();
+		{
+		    std::lock_guard<std::mutex> guard(_lock);
+		    _jobs.push_back([task]() { (*task)(); });
+		}
+		_wake.notify_one();
+		return result;
+	    }
+    };
+#endif
+
+    class pool					// recycled storage for simulator objects, one free list per size class
+    {
+	private:
+	    static const u32	granule = 16;		// sizes are rounded up to a multiple of this
+	    static const u32	nclasses = 16;		// largest object is granule*nclasses bytes
+	    static const u32	chunksize = 64*1024;	// storage is obtained from the host in chunks of this size
+
+	    std::vector<u8*>	_chunks;		// chunks obtained from the host
+	    u32			_chunk;			// number of chunks in use, the last one is being carved
+	    u32			_next;			// offset of the next free byte in that chunk
+	    std::vector<void*>	_free[nclasses];	// released blocks, by size class
+
+	public:
+	    pool()		{ _chunk = 0; _next = chunksize; }
+	    ~pool()		{ for (u32 i=0; i<_chunks.size(); i++) free(_chunks[i]); }
+	    void* allocate(size_t size);		// get a block of at least size bytes
+	    void  release(void *p, size_t size);	// give back a block obtained with allocate(size)
+	    void  reset();				// recycle all storage (no object may be alive)
+    };
+
     namespace operations
     {
-	extern std::multiset<u64>	issued;
+	class slots				// issue slots taken per cycle
+	{
+	    private:
+		std::vector<u8>		_count;		// operations issued, indexed by cycle modulo the window
+		u64			_base;		// oldest cycle still tracked (older ones have been retired)
+		u64			_window;	// number of cycles tracked, always a power of 2
+#ifdef CHECK_ISSUED
+		std::multiset<u64>	_check;		// reference implementation, for regression checking
+#endif
+
+		void grow(u64 cycle);							// widen the window so that it covers cycle
+
+	    public:
+		slots()					{ _window = 1024; _count.resize(_window); _base = 0; }
+		void clear()
+		{
+		    std::fill(_count.begin(), _count.end(), 0); _base = 0;
+#ifdef CHECK_ISSUED
+		    _check.clear();
+#endif
+		}
+		u32 count(u64 cycle) const
+		{
+		    u32 n = 0;
+		    if ((cycle >= _base) && (cycle < _base + _window)) n = _count[cycle & (_window - 1)];
+#ifdef CHECK_ISSUED
+		    assert(n == _check.count(cycle));
+#endif
+		    return n;
+		}
+		void insert(u64 cycle)
+		{
+		    assert(cycle >= _base);						// cannot issue in a retired cycle
+		    if (cycle >= _base + _window) grow(cycle);
+		    assert(_count[cycle & (_window - 1)] < 255);
+		    _count[cycle & (_window - 1)]++;
+#ifdef CHECK_ISSUED
+		    _check.insert(cycle);
+#endif
+		}
+		void retire(u64 cycle);							// forget all issues before cycle
+		void save(checkpoint::writer &W, const std::string &name) const;
+		void restore(const checkpoint::reader &R, const std::string &name);
+	};
+
+	extern per_machine slots	issued;
+
+	class storequeue				// the stores in flight, in program order: forwards their data to younger loads, and predicts which loads depend on them (store sets)
+	{
+	    public:
+		typedef struct
+		{
+		    u32		pc;					// instruction address of the store
+		    u32		EA;					// first byte it writes
+		    u32		L;					// bytes it writes
+		    u64		issued;					// cycle its address and data are known
+		    u64		written;				// cycle its data are in L1D, and the entry is free again
+		} store_t;
+
+	    private:
+		std::vector<store_t>	_stores;			// one per entry, a ring from the oldest (none: there is no store queue)
+		u32			_next;				// entry of the next store (the oldest one)
+		std::vector<u32>	_ssit;				// store set of each load and store, indexed by instruction address (+1, 0: none)
+		std::vector<store_t>	_lfst;				// last store of each store set
+
+		u32	index(u32 pc) const				{ return (pc / 4) % _ssit.size(); }
+		void	train(u32 load, u32 store);			// the load at load went ahead of the store at store it depended on: one store set for both
+
+	    public:
+		u64		stores;					// counter of stores that went into the queue
+		u64		stalls;					// counter of stores that waited for a free entry
+		u64		forwarded;				// counter of loads that got their data from a store in the queue
+		u64		violations;				// counter of loads that went ahead of a store they depended on, and were replayed
+		u64		waits;					// counter of loads the predictor held back until a store of their set issued
+		u64		falsedeps;				// counter of those that did not depend on it (or waited past the store they did depend on)
+
+		storequeue()						{ configure(0, 0); }
+		void		configure(u32 n, u32 storesets);		// n entries, and a store set table of storesets entries (it is cleared)
+		void		clear();					// empty, nothing predicted, and no statistics
+		bool		active() const				{ return !_stores.empty(); }
+		u32		size() const				{ return _stores.size(); }
+		u64		ready(u64 cycle);				// first cycle from cycle on the next store can go in (once the oldest is written)
+		void		insert(u32 pc, u32 EA, u32 L, u64 issued, u64 written);	// a store to [EA, EA+L), issued at issued, written at written
+		u64		load(u32 pc, u32 EA, u32 L, u64 cycle, bool &forward);	// when a load of [EA, EA+L) that could go at cycle can go past the older stores
+		void		save(checkpoint::writer &W, const std::string &name) const;
+		void		restore(const checkpoint::reader &R, const std::string &name);
+	};
+
+	extern per_machine storequeue	SQ;		// of the load and store units (none by default)
+
+	extern per_machine pool	objects;	// storage for operations
 
 	class operation
 	{
 	    private:
-		static bool	first;	// first operation processed
+		static per_machine bool	first;	// first operation processed
 
 		u64	_count;		// opearation #
 		u64	_ready;		// inputs ready
 		u64	_issue;		// issue time
 		u64	_complete;	// completion time (output ready)
 	    public:
+		static void*		operator new(size_t size)		{ return objects.allocate(size); }
+		static void		operator delete(void *p, size_t size)	{ objects.release(p, size); }
+		virtual			~operation()				{ }
 		static	void 		zero() { first = true; }		// starting a new stream
 		virtual units::unit& 	unit() = 0;				// functional unit for this operation
 		virtual u64 		target(u64 cycle) = 0;			// update ready time of output
 		virtual u32  		latency() 	{ return 1; }		// operation latency
 		virtual u32  		throughput() 	{ return 1; }		// operation throughput
 		virtual u64	 	ready() = 0;				// time inputs are ready
-		virtual std::string	dasm()  = 0;				// disassembly of the operation
+		virtual void		operands(trace::operands_t &O) = 0;	// disassembly of the operation, as a template and arguments
+		std::string		dasm()	{ trace::operands_t O; operands(O); return trace::describe(O); }
 		virtual u64             cacheready()    { return 0; }
 		virtual bool		issue(u64 cycle) = 0; 			// issue operation at the cycle
 		void output(std::ostream& out)
@@ -412,6 +1126,13 @@ namespace pipelined
 			first = false;
 		    }
 
+		    if (trace::out.active())
+		    {
+			trace::operands_t O; operands(O);
+			trace::out.operation(_count, O, _ready, _issue, _complete);
+			return;
+		    }
+
 		    std::ios state(nullptr);
 		    state.copyfmt(out);
 		    out << std::setw( 8) << std::setfill('0') << _count     << " , ";
@@ -426,7 +1147,13 @@ namespace pipelined
 		{
 		    _count = counters::operations;
 		    counters::operations++;					// increment operation count
-		    u64 minissue = max(ready(), cacheready());                  // check ready time for register and cache inputs
+		    units::unit &U = unit();
+		    U.operations++;
+		    U.retire(dispatch);						// nothing can issue before dispatch, so older reservations can go
+		    issued.retire(dispatch);
+		    u64 inputs = ready();
+		    caches::demand = max(inputs, dispatch);			// when it could issue, but for the cache
+		    u64 minissue = max(inputs, cacheready());                   // check ready time for register and cache inputs
 		    _ready = minissue;                                          // inputs ready
 		    minissue = max(minissue,dispatch);				// account for operation dispatch 
 		    minissue = target(minissue);				// save results and update ready time for output register
@@ -438,7 +1165,7 @@ namespace pipelined
 			{
 			    for (int i=0; i<throughput(); i++)			// test the next "inverse throughput" cycles
 			    {
-				if (unit().busy(minissue + i)) 			// if any of them busy, cannot issue
+				if (U.busy(minissue + i)) 			// if any of them busy, cannot issue
 				{
 				    issuable = false;
 				    break;
@@ -455,8 +1182,9 @@ namespace pipelined
 		    issued.insert(minissue);					// mark issue on this cycle
 		    for (int i=0; i<throughput(); i++)				// mark the unit busy for the next "inverse throughput" cycles
 		    {
-			unit().claim(minissue + i);
+			U.claim(minissue + i);
 		    }
+		    stats::dispatch.sample(minissue - dispatch);
 		    u64 cycle = counters::cycles;				// current cycle count
 		    counters::cycles = std::max(cycle, minissue + latency()); 	// current cycle could advance to the end of this operation
 		    _complete = minissue + latency();
@@ -481,8 +1209,8 @@ namespace pipelined
 		units::unit& unit() { return units::FXU; }
 		u64 target(u64 cycle) 
 		{ 
-		    GPR[_RT].busy() = false;
-		    _idx = PRF::find_next();
+		    GPR[_RT].release();
+		    _idx = PRF::find_next(cycle);
 		    return max(cycle, PRF::R[_idx].used());
 		}
 		bool issue(u64 cycle)
@@ -495,7 +1223,7 @@ namespace pipelined
 		    return false; 
 		}
 		u64 ready() { return max(GPR[_RA].ready()); }
-		std::string dasm() { std::string str = "addi (p" + std::to_string(_idx) + ", p" + std::to_string(GPR[_RA].idx()) + ", " + std::to_string(_SI) + ")"; return str; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("addi (p%, p%, %)"); O.set(F, _idx, GPR[_RA].idx(), _SI); }
 	};
 
 	class muli : public operation
@@ -510,8 +1238,8 @@ namespace pipelined
 		units::unit& unit() { return units::FXU; }
 		u64 target(u64 cycle) 
 		{ 
-		    GPR[_RT].busy() = false;
-		    _idx = PRF::find_next();
+		    GPR[_RT].release();
+		    _idx = PRF::find_next(cycle);
 		    return max(cycle, PRF::R[_idx].used());
 		}
 		bool issue(u64 cycle)
@@ -524,7 +1252,7 @@ namespace pipelined
 		    return false; 
 		}
 		u64 ready() { return max(GPR[_RA].ready()); }
-		std::string dasm() { std::string str = "muli (p" + std::to_string(_idx) + ", p" + std::to_string(GPR[_RA].idx()) + ", " + std::to_string(_SI) + ")"; return str; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("muli (p%, p%, %)"); O.set(F, _idx, GPR[_RA].idx(), _SI); }
 	};
 
 	class add : public operation
@@ -539,8 +1267,8 @@ namespace pipelined
 		units::unit& unit() { return units::FXU; }
 		u64 target(u64 cycle) 
 		{ 
-		    GPR[_RT].busy() = false;
-		    _idx = PRF::find_next();
+		    GPR[_RT].release();
+		    _idx = PRF::find_next(cycle);
 		    return max(cycle, PRF::R[_idx].used());
 		}
 		bool issue(u64 cycle)
@@ -554,7 +1282,7 @@ namespace pipelined
 		    return false; 
 		}
 		u64 ready() { return max(GPR[_RA].ready(), GPR[_RB].ready()); }
-		std::string dasm() { std::string str = "add (p" + std::to_string(_idx) + ", p" + std::to_string(GPR[_RA].idx()) + ", p" + std::to_string(GPR[_RB].idx()) + ")"; return str; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("add (p%, p%, p%)"); O.set(F, _idx, GPR[_RA].idx(), GPR[_RB].idx()); }
 	};
 
 	class sub : public operation
@@ -569,8 +1297,8 @@ namespace pipelined
 		units::unit& unit() { return units::FXU; }
 		u64 target(u64 cycle) 
 		{ 
-		    GPR[_RT].busy() = false;
-		    _idx = PRF::find_next();
+		    GPR[_RT].release();
+		    _idx = PRF::find_next(cycle);
 		    return max(cycle, PRF::R[_idx].used());
 		}
 		bool issue(u64 cycle)
@@ -584,7 +1312,7 @@ namespace pipelined
 		    return false; 
 		}
 		u64 ready() { return max(GPR[_RA].ready(), GPR[_RB].ready()); }
-		std::string dasm() { std::string str = "sub (p" + std::to_string(_idx) + ", p" + std::to_string(GPR[_RA].idx()) + ", p" + std::to_string(GPR[_RB].idx()) + ")"; return str; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("sub (p%, p%, p%)"); O.set(F, _idx, GPR[_RA].idx(), GPR[_RB].idx()); }
 	};
 
 	class cmpi : public operation
@@ -607,119 +1335,154 @@ namespace pipelined
 		units::unit& unit() { return units::FXU; }
 		u64 target(u64 cycle) { return cycle; }
 		u64 ready() { return max(GPR[_RA].ready()); }
-		std::string dasm() { std::string str = "cmpi (p" + std::to_string(GPR[_RA].idx()) + ", " + std::to_string(_SI) + ")"; return str; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("cmpi (p%, %)"); O.set(F, GPR[_RA].idx(), _SI); }
 	};
 
-	u8*	load( u32 EA, u32 L);
+	u8*	load(u32 EA, u32 L);					// load address range [EA, EA+L) into L1D, return a pointer to its data
+	u8*	load(u32 EA, u32 L, caches::access_t &A);		// same, starting from the result A of a lookup (A.line and A.data are updated)
 
-	class lbz : public operation
+	class memop : public operation					// an operation that accesses memory
+	{
+	    protected:
+		caches::access_t	_access;			// where the data is, looked up once per operation
+		bool			_forward;			// a load whose data come from the store queue
+		caches::access_t&	access(u32 EA, u32 L)		{ if (!_access.level) { caches::prefetch(); _access = caches::lookup(EA, L); } return _access; }
+	    public:
+		memop()							{ _access.level = 0; _forward = false; }
+		u64	loadready(u32 EA, u32 L)			// cacheready() of a load: when its line is there and, with a store queue, the older stores let it go
+		{
+		    caches::access_t &A = access(EA, L);
+		    if (!SQ.active()) return A.ready;
+		    u64 ready = SQ.load(CIA, EA, L, caches::demand, _forward);
+		    return _forward ? ready : max(A.ready, ready);	// forwarded data do not wait for the line
+		}
+		u32	loadlatency(u32 EA, u32 L)			{ return _forward ? params::SQ::forward : caches::latency(access(EA, L)); }
+		u64	storeready(u32 EA, u32 L)			// cacheready() of a store: when it can go into the store buffer, if any, else when its line is there
+		{
+		    caches::access_t &A = access(EA, L);
+		    u64 ready = caches::SB.active() ? caches::SB.ready(EA / caches::L1D.linesize(), caches::demand) : A.ready;
+		    return SQ.active() ? max(ready, SQ.ready(caches::demand)) : ready;
+		}
+		u32	storelatency(u32 EA, u32 L)			{ return caches::SB.active() ? 1 : caches::latency(access(EA, L)); }	// it retires into the store buffer
+		bool	stored(u32 EA, u32 L)				// the store just wrote L1D: true if it must write L2 too
+		{
+		    u64 written;
+		    bool through = caches::stored(EA, _access, written);
+		    if (SQ.active()) SQ.insert(CIA, EA, L, counters::lastissued, written);
+		    return through;
+		}
+	};
+
+	class lbz : public memop
 	{
 	    private:
 		gprnum	_RT;
 		gprnum	_RA;
-		u32	_latency;
 		u32	_idx;
 	    public:
-		lbz(gprnum RT, gprnum RA) { _RT = RT; _RA = RA; _latency = 0; }
-		u32 latency() 
+		lbz(gprnum RT, gprnum RA) { _RT = RT; _RA = RA; }
+		u32 latency() { return loadlatency(GPR[_RA].data(), 1); }
+		units::unit& unit() { return units::LDU; }
+		u64 target(u64 cycle) 
 		{ 
-		    if(_latency) return _latency; 
-		    u32 EA = GPR[_RA].data(); 
-		    if      (caches::L1D.contains(EA,1))	_latency = params:: L1::latency;
-		    else if (caches:: L2.contains(EA,1))	_latency = params:: L2::latency;
-		    else if (caches:: L3.contains(EA,1)) 	_latency = params:: L3::latency;
-		    else  					_latency = params::MEM::latency; 
-		    return _latency; 
+		    GPR[_RT].release();
+		    _idx = PRF::find_next(cycle);
+		    return max(cycle, PRF::R[_idx].used());
+		}
+		bool issue(u64 cycle)
+		{
+		    GPR[_RA].used(cycle);
+		    u32 EA = GPR[_RA].data(); 			// compute effective address of load
+		    u8* data = load(EA, 1, _access);			// fill the cache with the line, if not already there
+		    u32 RES = *((u8*)data);			// get data from the cache
+		    GPR[_RT].idx()   = _idx;
+		    GPR[_RT].data()  = RES;
+		    GPR[_RT].ready() = cycle + latency(); 
+		    return false; 
 		}
+		u64 ready() { return max(GPR[_RA].ready()); }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("lbz (p%, p%)"); O.set(F, _idx, GPR[_RA].idx()); }
+		u64 cacheready() { return loadready(GPR[_RA].data(), 1); }
+	};
+
+	class lwz : public memop
+	{
+	    private:
+		gprnum	_RT;
+		gprnum	_RA;
+		u32	_idx;
+	    public:
+		lwz(gprnum RT, gprnum RA) { _RT = RT; _RA = RA; }
+		u32 latency() { return loadlatency(GPR[_RA].data(), 4); }
 		units::unit& unit() { return units::LDU; }
 		u64 target(u64 cycle) 
 		{ 
-		    GPR[_RT].busy() = false;
-		    _idx = PRF::find_next();
+		    GPR[_RT].release();
+		    _idx = PRF::find_next(cycle);
 		    return max(cycle, PRF::R[_idx].used());
 		}
 		bool issue(u64 cycle)
 		{
 		    GPR[_RA].used(cycle);
 		    u32 EA = GPR[_RA].data(); 			// compute effective address of load
-		    u8* data = load(EA, 1);			// fill the cache with the line, if not already there
-		    u32 RES = *((u8*)data);			// get data from the cache
+		    u8* data = load(EA, 4, _access);			// fill the cache with the line, if not already there
+		    u32 RES = *((u32*)data);			// get data from the cache
 		    GPR[_RT].idx()   = _idx;
 		    GPR[_RT].data()  = RES;
 		    GPR[_RT].ready() = cycle + latency(); 
 		    return false; 
 		}
 		u64 ready() { return max(GPR[_RA].ready()); }
-		std::string dasm() { std::string str = "lbz (p" + std::to_string(_idx) + ", p" + std::to_string(GPR[_RA].idx()) + ")"; return str; }
-		u64 cacheready() { u32 EA = GPR[_RA].data(); u64 ready; return caches::L1D.contains(EA,1, ready) ? ready : 0; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("lwz (p%, p%)"); O.set(F, _idx, GPR[_RA].idx()); }
+		u64 cacheready() { return loadready(GPR[_RA].data(), 4); }
 	};
 
-	class stb : public operation
+	class stb : public memop
 	{
 	    private:
 		gprnum	_RS;
 		gprnum	_RA;
-		u32	_latency;
 	    public:
-		stb(gprnum RS, gprnum RA) { _RS = RS; _RA = RA; _latency = 0; }
+		stb(gprnum RS, gprnum RA) { _RS = RS; _RA = RA; }
 		bool issue(u64 cycle) 
 		{
 		    GPR[_RA].used(cycle);
 		    GPR[_RS].used(cycle);
 		    uint32_t EA = GPR[_RA].data();				// compute effective address of store
-		    u8* data = load(EA, 1);					// fill the cache with the line, if not already there
-		    caches::L1D.find(EA, 1)->store(EA,(u8)GPR[_RS].data()); 	// write data to L1 cache
-		    caches::L2 .find(EA, 1)->store(EA,(u8)GPR[_RS].data());	// write to L2 as well, since L1 is write-through!
+		    u8* data = load(EA, 1, _access);			// fill the cache with the line, if not already there
+		    _access.line.store(EA,(u8)GPR[_RS].data()); 	// write data to L1 cache
+		    if (stored(EA, 1)) caches::L2 .find(EA, 1).store(EA,(u8)GPR[_RS].data());	// write to L2 as well, if L1 is write-through
 		    return false; 
 		}
-		u32 latency() 
-		{ 
-		    if(_latency) return _latency; 
-		    u32 EA = GPR[_RA].data(); 
-		    if      (caches::L1D.contains(EA,1))	_latency = params:: L1::latency;
-		    else if (caches:: L2.contains(EA,1))	_latency = params:: L2::latency;
-		    else if (caches:: L3.contains(EA,1)) 	_latency = params:: L3::latency;
-		    else  					_latency = params::MEM::latency; 
-		    return _latency; 
-		}
+		u32 latency() { return storelatency(GPR[_RA].data(), 1); }
 		units::unit& unit() { return units::STU; }
 		u64 target(u64 cycle) { return cycle; }
 		u64 ready() { return max(GPR[_RA].ready(), GPR[_RS].ready()); }
-		std::string dasm() { std::string str = "stb (p" + std::to_string(GPR[_RS].idx()) + ", p" + std::to_string(GPR[_RA].idx()) + ")"; return str; }
-		u64 cacheready() { u32 EA = GPR[_RA].data(); u64 ready; return caches::L1D.contains(EA,1, ready) ? ready : 0; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("stb (p%, p%)"); O.set(F, GPR[_RS].idx(), GPR[_RA].idx()); }
+		u64 cacheready() { return storeready(GPR[_RA].data(), 1); }
 	};
 
-	class lfd : public operation
+	class lfd : public memop
 	{
 	    private:
 		fprnum	_FT;
 		gprnum	_RA;
-		u32	_latency;
 		u32	_idx;
 	    public:
-		lfd(fprnum FT, gprnum RA) { _FT = FT; _RA = RA; _latency = 0; }
-		u32 latency() 
-		{ 
-		    if(_latency) return _latency; 
-		    u32 EA = GPR[_RA].data(); 
-		    if      (caches::L1D.contains(EA,8))	_latency = params:: L1::latency;
-		    else if (caches:: L2.contains(EA,8))	_latency = params:: L2::latency;
-		    else if (caches:: L3.contains(EA,8)) 	_latency = params:: L3::latency;
-		    else  					_latency = params::MEM::latency; 
-		    return _latency; 
-		}
+		lfd(fprnum FT, gprnum RA) { _FT = FT; _RA = RA; }
+		u32 latency() { return loadlatency(GPR[_RA].data(), 8); }
 		units::unit& unit() { return units::LDU; }
 		u64 target(u64 cycle) 
 		{ 
-		    FPR[_FT].busy() = false;
-		    _idx = PRF::find_next();
+		    FPR[_FT].release();
+		    _idx = PRF::find_next(cycle);
 		    return max(cycle, PRF::R[_idx].used());
 		}
 		bool issue(u64 cycle)
 		{
 		    GPR[_RA].used(cycle);
 		    u32 EA = GPR[_RA].data();			// compute effective address of load
-		    u8* data = load(EA, 8);			// fill the cache with the line, if not already there
+		    u8* data = load(EA, 8, _access);			// fill the cache with the line, if not already there
 		    double RES = *((double*)data);		// get data from the cache
 		    FPR[_FT].idx()   = _idx;
 		    FPR[_FT].data()  = RES;
@@ -727,69 +1490,49 @@ namespace pipelined
 		    return false;
 		}
 		u64 ready() { return max(GPR[_RA].ready()); }
-		std::string dasm() { std::string str = "lfd (p" + std::to_string(_idx) + ", p" + std::to_string(GPR[_RA].idx()) + ")"; return str; }
-		u64 cacheready() { u32 EA = GPR[_RA].data(); u64 ready; return caches::L1D.contains(EA,8, ready) ? ready : 0; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("lfd (p%, p%)"); O.set(F, _idx, GPR[_RA].idx()); }
+		u64 cacheready() { return loadready(GPR[_RA].data(), 8); }
 	};
 
-	class stfd : public operation
+	class stfd : public memop
 	{
 	    private:
 		fprnum _FS;
 		gprnum _RA;
-		u32	_latency;
 	    public:
-		stfd(fprnum FS, gprnum RA) { _FS = FS; _RA = RA; _latency = 0; }
+		stfd(fprnum FS, gprnum RA) { _FS = FS; _RA = RA; }
 		bool issue(u64 cycle)
 		{
 		    GPR[_RA].used(cycle);
 		    u32 EA = GPR[_RA].data();				// compute effective address of store
-		    u8* data = load(EA, 8);				// fill the cache with the line, if not already there
-		    caches::L1D.find(EA, 8)->store(EA,FPR[_FS].data());	// write data to L1 cache
-		    caches::L2 .find(EA, 8)->store(EA,FPR[_FS].data()); // write to L2 as well, since L1 is write-through!
+		    u8* data = load(EA, 8, _access);		// fill the cache with the line, if not already there
+		    _access.line.store(EA,FPR[_FS].data());	// write data to L1 cache
+		    if (stored(EA, 8)) caches::L2 .find(EA, 8).store(EA,FPR[_FS].data()); // write to L2 as well, if L1 is write-through
 		    return false;
 		}
-		u32 latency() 
-		{ 
-		    if(_latency) return _latency; 
-		    u32 EA = GPR[_RA].data(); 
-		    if      (caches::L1D.contains(EA,8))	_latency = params:: L1::latency;
-		    else if (caches:: L2.contains(EA,8))	_latency = params:: L2::latency;
-		    else if (caches:: L3.contains(EA,8)) 	_latency = params:: L3::latency;
-		    else  					_latency = params::MEM::latency; 
-		    return _latency; 
-		}
+		u32 latency() { return storelatency(GPR[_RA].data(), 8); }
 		units::unit& unit() { return units::STU; }
 		u64 target(u64 cycle) { return cycle; }
 		u64 ready() { return max(GPR[_RA].ready(), FPR[_FS].ready()); }
-		std::string dasm() { std::string str = "stfd (p" + std::to_string(FPR[_FS].idx()) + ", p" + std::to_string(GPR[_RA].idx()) + ")"; return str; }
-		u64 cacheready() { u32 EA = GPR[_RA].data(); u64 ready; return caches::L1D.contains(EA,8, ready) ? ready : 0; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("stfd (p%, p%)"); O.set(F, FPR[_FS].idx(), GPR[_RA].idx()); }
+		u64 cacheready() { return storeready(GPR[_RA].data(), 8); }
 	};
 
-	class vlb : public operation
+	class vlb : public memop
 	{
 	    private:
 		vrnum	_VT;
 		gprnum	_RA;
 		vrnum	_VM;
-		u32	_latency;
 		u32	_idx;
 	    public:
-		vlb(vrnum VT, gprnum RA, vrnum VM) { _VT = VT; _RA = RA; _VM = VM; _latency = 0; }
-		u32 latency() 
-		{ 
-		    if(_latency) return _latency; 
-		    u32 EA = GPR[_RA].data(); 
-		    if      (caches::L1D.contains(EA,16))	_latency = params:: L1::latency;
-		    else if (caches:: L2.contains(EA,16))	_latency = params:: L2::latency;
-		    else if (caches:: L3.contains(EA,16)) 	_latency = params:: L3::latency;
-		    else  					_latency = params::MEM::latency; 
-		    return _latency; 
-		}
+		vlb(vrnum VT, gprnum RA, vrnum VM) { _VT = VT; _RA = RA; _VM = VM; }
+		u32 latency() { return loadlatency(GPR[_RA].data(), 16); }
 		units::unit& unit() { return units::LDU; }
 		u64 target(u64 cycle) 
 		{ 
-		    VR[_VT].busy() = false;
-		    _idx = VRF::find_next();
+		    VR[_VT].release();
+		    _idx = VRF::find_next(cycle);
 		    return max(cycle, VRF::V[_idx].used());
 		}
 		bool issue(u64 cycle)
@@ -797,79 +1540,59 @@ namespace pipelined
 		    GPR[_RA].used(cycle);
 		    VR[_VM].used(cycle);
 		    u32 EA = GPR[_RA].data(); 			// compute effective address of load
-		    u8* data = load(EA,16);			// fill the cache with the line, if not already there
+		    u8* data = load(EA,16, _access);			// fill the cache with the line, if not already there
 		    VR[_VT].idx()   = _idx;
 		    for (u32 i=0; i<16; i++) VR[_VT].data().byte[i] = VR[_VM].data().byte[i] ? *((u8*)data + i) : 0;
 		    VR[_VT].ready() = cycle + latency(); 
 		    return false; 
 		}
 		u64 ready() { return max(GPR[_RA].ready(), VR[_VM].ready()); }
-		std::string dasm() { std::string str = "vlb (q" + std::to_string(_idx) + ", p" + std::to_string(GPR[_RA].idx()) + ", q" + std::to_string(VR[_VM].idx()) + ")"; return str; }
-		u64 cacheready() { u32 EA = GPR[_RA].data(); u64 ready; return caches::L1D.contains(EA,16, ready) ? ready : 0; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("vlb (q%, p%, q%)"); O.set(F, _idx, GPR[_RA].idx(), VR[_VM].idx()); }
+		u64 cacheready() { return loadready(GPR[_RA].data(), 16); }
 	};
 
-	class vstb : public operation
+	class vstb : public memop
 	{
 	    private:
 		vrnum	_VS;
 		gprnum	_RA;
 		vrnum	_VM;
-		u32	_latency;
 	    public:
-		vstb(vrnum VS, gprnum RA, vrnum VM) { _VS = VS; _RA = RA; _VM = VM; _latency = 0; }
+		vstb(vrnum VS, gprnum RA, vrnum VM) { _VS = VS; _RA = RA; _VM = VM; }
 		bool issue(u64 cycle) 
 		{
 		    GPR[_RA].used(cycle);
 		    VR[_VM].used(cycle);
 		    VR[_VS].used(cycle);
 		    uint32_t EA = GPR[_RA].data();					// compute effective address of store
-		    u8* data = load(EA,16);						// fill the cache with the line, if not already there
-		    caches::L1D.find(EA,16)->store(EA,VR[_VS].data().byte, VR[_VM].data().byte);	// write data to L1 cache
-		    caches::L2 .find(EA,16)->store(EA,VR[_VS].data().byte, VR[_VM].data().byte);	// write to L2 as well
+		    u8* data = load(EA,16, _access);					// fill the cache with the line, if not already there
+		    _access.line.store(EA,VR[_VS].data().byte, VR[_VM].data().byte);	// write data to L1 cache
+		    if (stored(EA, 16)) caches::L2 .find(EA,16).store(EA,VR[_VS].data().byte, VR[_VM].data().byte);	// write to L2 as well
 		    return false; 
 		}
-		u32 latency() 
-		{ 
-		    if(_latency) return _latency; 
-		    u32 EA = GPR[_RA].data(); 
-		    if      (caches::L1D.contains(EA,16))	_latency = params:: L1::latency;
-		    else if (caches:: L2.contains(EA,16))	_latency = params:: L2::latency;
-		    else if (caches:: L3.contains(EA,16)) 	_latency = params:: L3::latency;
-		    else  					_latency = params::MEM::latency; 
-		    return _latency; 
-		}
+		u32 latency() { return storelatency(GPR[_RA].data(), 16); }
 		units::unit& unit() { return units::STU; }
 		u64 target(u64 cycle) { return cycle; }
 		u64 ready() { return max(GPR[_RA].ready(), VR[_VS].ready(), VR[_VM].ready()); }
-		std::string dasm() { std::string str = "vstb (q" + std::to_string(VR[_VS].idx()) + ", p" + std::to_string(GPR[_RA].idx()) + ", q" + std::to_string(VR[_VM].idx()) + ")"; return str; }
-		u64 cacheready() { u32 EA = GPR[_RA].data(); u64 ready; return caches::L1D.contains(EA,16, ready) ? ready : 0; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("vstb (q%, p%, q%)"); O.set(F, VR[_VS].idx(), GPR[_RA].idx(), VR[_VM].idx()); }
+		u64 cacheready() { return storeready(GPR[_RA].data(), 16); }
 	};
 
-	class vlfs : public operation
+	class vlfs : public memop
 	{
 	    private:
 		vrnum	_VT;
 		gprnum	_RA;
 		vrnum	_VM;
-		u32	_latency;
 		u32	_idx;
 	    public:
-		vlfs(vrnum VT, gprnum RA, vrnum VM) { _VT = VT; _RA = RA; _VM = VM; _latency = 0; }
-		u32 latency() 
-		{ 
-		    if(_latency) return _latency; 
-		    u32 EA = GPR[_RA].data(); 
-		    if      (caches::L1D.contains(EA,16))	_latency = params:: L1::latency;
-		    else if (caches:: L2.contains(EA,16))	_latency = params:: L2::latency;
-		    else if (caches:: L3.contains(EA,16)) 	_latency = params:: L3::latency;
-		    else  					_latency = params::MEM::latency; 
-		    return _latency; 
-		}
+		vlfs(vrnum VT, gprnum RA, vrnum VM) { _VT = VT; _RA = RA; _VM = VM; }
+		u32 latency() { return loadlatency(GPR[_RA].data(), 16); }
 		units::unit& unit() { return units::LDU; }
 		u64 target(u64 cycle) 
 		{ 
-		    VR[_VT].busy() = false;
-		    _idx = VRF::find_next();
+		    VR[_VT].release();
+		    _idx = VRF::find_next(cycle);
 		    return max(cycle, VRF::V[_idx].used());
 		}
 		bool issue(u64 cycle)
@@ -877,42 +1600,32 @@ namespace pipelined
 		    GPR[_RA].used(cycle);
 		    VR[_VM].used(cycle);
 		    u32 EA = GPR[_RA].data(); 			// compute effective address of load
-		    u8* data = load(EA,16);			// fill the cache with the line, if not already there
+		    u8* data = load(EA,16, _access);			// fill the cache with the line, if not already there
 		    VR[_VT].idx()   = _idx;
 		    for (u32 i=0; i<4; i++) VR[_VT].data().sp[i] = VR[_VM].data().word[i] ? *((float*)data + i) : 0;
 		    VR[_VT].ready() = cycle + latency(); 
 		    return false; 
 		}
 		u64 ready() { return max(GPR[_RA].ready(), VR[_VM].ready()); }
-		std::string dasm() { std::string str = "vlfs (q" + std::to_string(_idx) + ", p" + std::to_string(GPR[_RA].idx()) + ", q" + std::to_string(VR[_VM].idx()) + ")"; return str; }
-		u64 cacheready() { u32 EA = GPR[_RA].data(); u64 ready; return caches::L1D.contains(EA,16, ready) ? ready : 0; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("vlfs (q%, p%, q%)"); O.set(F, _idx, GPR[_RA].idx(), VR[_VM].idx()); }
+		u64 cacheready() { return loadready(GPR[_RA].data(), 16); }
 	};
 
-	class vlspltsp : public operation
+	class vlspltsp : public memop
 	{
 	    private:
 		vrnum	_VT;
 		gprnum	_RA;
 		vrnum	_VM;
-		u32	_latency;
 		u32	_idx;
 	    public:
-		vlspltsp(vrnum VT, gprnum RA, vrnum VM) { _VT = VT; _RA = RA; _VM = VM; _latency = 0; }
-		u32 latency() 
-		{ 
-		    if(_latency) return _latency; 
-		    u32 EA = GPR[_RA].data(); 
-		    if      (caches::L1D.contains(EA,4))	_latency = params:: L1::latency;
-		    else if (caches:: L2.contains(EA,4))	_latency = params:: L2::latency;
-		    else if (caches:: L3.contains(EA,4)) 	_latency = params:: L3::latency;
-		    else  					_latency = params::MEM::latency; 
-		    return _latency; 
-		}
+		vlspltsp(vrnum VT, gprnum RA, vrnum VM) { _VT = VT; _RA = RA; _VM = VM; }
+		u32 latency() { return loadlatency(GPR[_RA].data(), 4); }
 		units::unit& unit() { return units::LDU; }
 		u64 target(u64 cycle) 
 		{ 
-		    VR[_VT].busy() = false;
-		    _idx = VRF::find_next();
+		    VR[_VT].release();
+		    _idx = VRF::find_next(cycle);
 		    return max(cycle, VRF::V[_idx].used());
 		}
 		bool issue(u64 cycle)
@@ -920,52 +1633,42 @@ namespace pipelined
 		    GPR[_RA].used(cycle);
 		    VR[_VM].used(cycle);
 		    u32 EA = GPR[_RA].data(); 			// compute effective address of load
-		    u8* data = load(EA,4);			// fill the cache with the line, if not already there
+		    u8* data = load(EA,4, _access);			// fill the cache with the line, if not already there
 		    VR[_VT].idx()   = _idx;
 		    for (u32 i=0; i<4; i++) VR[_VT].data().sp[i] = VR[_VM].data().word[i] ? *((float*)data) : 0;
 		    VR[_VT].ready() = cycle + latency(); 
 		    return false; 
 		}
 		u64 ready() { return max(GPR[_RA].ready(), VR[_VM].ready()); }
-		std::string dasm() { std::string str = "vlspltsp (q" + std::to_string(_idx) + ", p" + std::to_string(GPR[_RA].idx()) + ", q" + std::to_string(VR[_VM].idx()) + ")"; return str; }
-		u64 cacheready() { u32 EA = GPR[_RA].data(); u64 ready; return caches::L1D.contains(EA,4, ready) ? ready : 0; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("vlspltsp (q%, p%, q%)"); O.set(F, _idx, GPR[_RA].idx(), VR[_VM].idx()); }
+		u64 cacheready() { return loadready(GPR[_RA].data(), 4); }
 	};
 
-	class vstfs : public operation
+	class vstfs : public memop
 	{
 	    private:
 		vrnum	_VS;
 		gprnum	_RA;
 		vrnum	_VM;
-		u32	_latency;
 	    public:
-		vstfs(vrnum VS, gprnum RA, vrnum VM) { _VS = VS; _RA = RA; _VM = VM; _latency = 0; }
+		vstfs(vrnum VS, gprnum RA, vrnum VM) { _VS = VS; _RA = RA; _VM = VM; }
 		bool issue(u64 cycle) 
 		{
 		    GPR[_RA].used(cycle);
 		    VR[_VM].used(cycle);
 		    VR[_VS].used(cycle);
 		    uint32_t EA = GPR[_RA].data();					// compute effective address of store
-		    u8* data = load(EA,16);						// fill the cache with the line, if not already there
-		    caches::L1D.find(EA,16)->store(EA,VR[_VS].data().sp, VR[_VM].data().word);	// write data to L1 cache
-		    caches::L2 .find(EA,16)->store(EA,VR[_VS].data().sp, VR[_VM].data().word);	// write to L2 as well
+		    u8* data = load(EA,16, _access);					// fill the cache with the line, if not already there
+		    _access.line.store(EA,VR[_VS].data().sp, VR[_VM].data().word);	// write data to L1 cache
+		    if (stored(EA, 16)) caches::L2 .find(EA,16).store(EA,VR[_VS].data().sp, VR[_VM].data().word);	// write to L2 as well
 		    return false; 
 		}
-		u32 latency() 
-		{ 
-		    if(_latency) return _latency; 
-		    u32 EA = GPR[_RA].data(); 
-		    if      (caches::L1D.contains(EA,16))	_latency = params:: L1::latency;
-		    else if (caches:: L2.contains(EA,16))	_latency = params:: L2::latency;
-		    else if (caches:: L3.contains(EA,16)) 	_latency = params:: L3::latency;
-		    else  					_latency = params::MEM::latency; 
-		    return _latency; 
-		}
+		u32 latency() { return storelatency(GPR[_RA].data(), 16); }
 		units::unit& unit() { return units::STU; }
 		u64 target(u64 cycle) { return cycle; }
 		u64 ready() { return max(GPR[_RA].ready(), VR[_VS].ready(), VR[_VM].ready()); }
-		std::string dasm() { std::string str = "vstfs (q" + std::to_string(VR[_VS].idx()) + ", p" + std::to_string(GPR[_RA].idx()) + ", q" + std::to_string(VR[_VM].idx()) + ")"; return str; }
-		u64 cacheready() { u32 EA = GPR[_RA].data(); u64 ready; return caches::L1D.contains(EA,16, ready) ? ready : 0; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("vstfs (q%, p%, q%)"); O.set(F, VR[_VS].idx(), GPR[_RA].idx(), VR[_VM].idx()); }
+		u64 cacheready() { return storeready(GPR[_RA].data(), 16); }
 	};
 
 	class vmaskb : public operation
@@ -988,12 +1691,12 @@ namespace pipelined
 		units::unit& unit() { return units::VU; }
 		u64 target(u64 cycle)
 		{
-		    VR[_VT].busy() = false;
-		    _idx = VRF::find_next();
+		    VR[_VT].release();
+		    _idx = VRF::find_next(cycle);
 		    return max(cycle, VRF::V[_idx].used());
 		}
 		u64 ready() { return max(GPR[_RA].ready()); }
-		std::string dasm() { std::string str = "vmaskb (q" + std::to_string(_idx) + ", p" + std::to_string(GPR[_RA].idx()) + ")"; return str; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("vmaskb (q%, p%)"); O.set(F, _idx, GPR[_RA].idx()); }
 	};
 
 	class vmaskw : public operation
@@ -1016,12 +1719,12 @@ namespace pipelined
 		units::unit& unit() { return units::VU; }
 		u64 target(u64 cycle)
 		{
-		    VR[_VT].busy() = false;
-		    _idx = VRF::find_next();
+		    VR[_VT].release();
+		    _idx = VRF::find_next(cycle);
 		    return max(cycle, VRF::V[_idx].used());
 		}
 		u64 ready() { return max(GPR[_RA].ready()); }
-		std::string dasm() { std::string str = "vmaskw (q" + std::to_string(_idx) + ", p" + std::to_string(GPR[_RA].idx()) + ")"; return str; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("vmaskw (q%, p%)"); O.set(F, _idx, GPR[_RA].idx()); }
 	};
 
 	class vpopcnt : public operation
@@ -1044,12 +1747,12 @@ namespace pipelined
 		units::unit& unit() { return units::VU; }
 		u64 target(u64 cycle)
 		{
-		    GPR[_RT].busy() = false;
-		    _idx = PRF::find_next();
+		    GPR[_RT].release();
+		    _idx = PRF::find_next(cycle);
 		    return max(cycle, PRF::R[_idx].used());
 		}
 		u64 ready() { return max(VR[_VA].ready()); }
-		std::string dasm() { std::string str = "vpopcnt (r" + std::to_string(_idx) + ", q" + std::to_string(VR[_VA].idx()) + ")"; return str; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("vpopcnt (r%, q%)"); O.set(F, _idx, VR[_VA].idx()); }
 	};
 
 	class b : public operation
@@ -1062,7 +1765,7 @@ namespace pipelined
 		units::unit& unit() { return units::BRU; }
 		u64 target(u64 cycle) { return cycle; }
 		u64 ready() { return 0; }
-		std::string dasm() { std::string str = "b (" + std::to_string(_BD) + ")"; return str; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("b (%)"); O.set(F, _BD); }
 	};
 
 	class beq : public operation
@@ -1075,7 +1778,7 @@ namespace pipelined
 		units::unit& unit() { return units::BRU; }
 		u64 target(u64 cycle) { return cycle; }
 		u64 ready() { return max(flags.ready); }
-		std::string dasm() { std::string str = "beq (" + std::to_string(_BD) + ")"; return str; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("beq (%)"); O.set(F, _BD); }
 	};
 
 	class bne : public operation
@@ -1088,7 +1791,7 @@ namespace pipelined
 		units::unit& unit() { return units::BRU; }
 		u64 target(u64 cycle) { return cycle; }
 		u64 ready() { return max(flags.ready); }
-		std::string dasm() { std::string str = "bne (" + std::to_string(_BD) + ")"; return str; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("bne (%)"); O.set(F, _BD); }
 	};
 
 	class blt : public operation
@@ -1101,7 +1804,7 @@ namespace pipelined
 		units::unit& unit() { return units::BRU; }
 		u64 target(u64 cycle) { return cycle; }
 		u64 ready() { return max(flags.ready); }
-		std::string dasm() { std::string str = "blt (" + std::to_string(_BD) + ")"; return str; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("blt (%)"); O.set(F, _BD); }
 	};
 
 	class zd : public operation
@@ -1114,8 +1817,8 @@ namespace pipelined
 		units::unit& unit() { return units::FPU; }
 		u64 target(u64 cycle) 
 		{ 
-		    FPR[_FT].busy() = false;
-		    _idx = PRF::find_next();
+		    FPR[_FT].release();
+		    _idx = PRF::find_next(cycle);
 		    return max(cycle, PRF::R[_idx].used());
 		}
 		bool issue(u64 cycle)
@@ -1126,7 +1829,7 @@ namespace pipelined
 		    return false;
 		}
 		u64 ready() { return 0; }
-		std::string dasm() { std::string str = "zd (p" + std::to_string(_idx) + ")"; return str; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("zd (p%)"); O.set(F, _idx); }
 	};
 
 	class fmul : public operation
@@ -1141,8 +1844,8 @@ namespace pipelined
 		units::unit& unit() { return units::FPU; }
 		u64 target(u64 cycle) 
 		{ 
-		    FPR[_FT].busy() = false;
-		    _idx = PRF::find_next();
+		    FPR[_FT].release();
+		    _idx = PRF::find_next(cycle);
 		    return max(cycle, PRF::R[_idx].used());
 		}
 		bool issue(u64 cycle)
@@ -1156,7 +1859,7 @@ namespace pipelined
 		    return false; 
 		}
 		u64 ready() { return max(FPR[_FA].ready(), FPR[_FB].ready()); }
-		std::string dasm() { std::string str = "fmul (p" + std::to_string(_idx) + ", p" + std::to_string(FPR[_FA].idx()) + ", p" + std::to_string(FPR[_FB].idx()) + ")"; return str; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("fmul (p%, p%, p%)"); O.set(F, _idx, FPR[_FA].idx(), FPR[_FB].idx()); }
 	};
 
 	class vfmulsp : public operation
@@ -1172,8 +1875,8 @@ namespace pipelined
 		units::unit& unit() { return units::VU; }
 		u64 target(u64 cycle) 
 		{ 
-		    VR[_VT].busy() = false;
-		    _idx = VRF::find_next();
+		    VR[_VT].release();
+		    _idx = VRF::find_next(cycle);
 		    return max(cycle, VRF::V[_idx].used());
 		}
 		bool issue(u64 cycle)
@@ -1188,7 +1891,7 @@ namespace pipelined
 		    return false; 
 		}
 		u64 ready() { return max( VR[_VA].ready(), VR[_VM].ready(), VR[_VB].ready() ); }
-		std::string dasm() { std::string str = "vfmulsp (q" + std::to_string(_idx) + ", q" + std::to_string(VR[_VA].idx()) + ", q" + std::to_string(VR[_VB].idx()) + ", q" + std::to_string(VR[_VM].idx()) + ")"; return str; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("vfmulsp (q%, q%, q%, q%)"); O.set(F, _idx, VR[_VA].idx(), VR[_VB].idx(), VR[_VM].idx()); }
 	};
 
 	class fadd : public operation
@@ -1203,8 +1906,8 @@ namespace pipelined
 		units::unit& unit() { return units::FPU; }
 		u64 target(u64 cycle) 
 		{ 
-		    FPR[_FT].busy() = false;
-		    _idx = PRF::find_next();
+		    FPR[_FT].release();
+		    _idx = PRF::find_next(cycle);
 		    return max(cycle, PRF::R[_idx].used());
 		}
 		bool issue(u64 cycle)
@@ -1218,7 +1921,7 @@ namespace pipelined
 		    return false; 
 		}
 		u64 ready() { return max(FPR[_FA].ready(), FPR[_FB].ready()); }
-		std::string dasm() { std::string str = "fadd (p" + std::to_string(_idx) + ", p" + std::to_string(FPR[_FA].idx()) + ", p" + std::to_string(FPR[_FB].idx()) + ")"; return str; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("fadd (p%, p%, p%)"); O.set(F, _idx, FPR[_FA].idx(), FPR[_FB].idx()); }
 	};
 
 	class vfaddsp : public operation
@@ -1234,8 +1937,8 @@ namespace pipelined
 		units::unit& unit() { return units::VU; }
 		u64 target(u64 cycle) 
 		{ 
-		    VR[_VT].busy() = false;
-		    _idx = VRF::find_next();
+		    VR[_VT].release();
+		    _idx = VRF::find_next(cycle);
 		    return max(cycle, VRF::V[_idx].used());
 		}
 		bool issue(u64 cycle)
@@ -1250,16 +1953,137 @@ namespace pipelined
 		    return false; 
 		}
 		u64 ready() { return max(VR[_VA].ready(), VR[_VB].ready(), VR[_VM].ready()); }
-		std::string dasm() { std::string str = "vfaddsp (q" + std::to_string(_idx) + ", q" + std::to_string(VR[_VA].idx()) + ", q" + std::to_string(VR[_VB].idx()) + ", q" + std::to_string(VR[_VM].idx()) + ")"; return str; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("vfaddsp (q%, q%, q%, q%)"); O.set(F, _idx, VR[_VA].idx(), VR[_VB].idx(), VR[_VM].idx()); }
 	};
     };
 
+    namespace sampling				// sampled simulation (SMARTS): functional warming, with short detailed windows at a fixed period
+    {
+	extern per_machine u64	countdown;	// instructions left in the current phase (never reaches 0 when not sampling)
+
+	typedef struct
+	{
+	    u64		instructions;		// instructions executed, in all modes
+	    u64		samples;		// measured windows
+	    double	cpi;			// mean cycles per instruction of the windows
+	    double	stddev;			// standard deviation of the CPI of the windows
+	    double	cycles;			// estimated cycles of the whole run (cpi * instructions)
+	    double	error;			// half-width of the confidence interval of cycles
+	} estimate_t;
+
+	void		start(u64 period, u64 window, u64 warmup, u64 warming = ~(u64)0);	// every period instructions: fast-forward, functional warming for the last warming
+											// of them, then warmup and window instructions in detail (measuring the window)
+	void		next();						// end of the current phase (countdown reached 0)
+	void		stop();						// back to full timing simulation
+	estimate_t	estimate(double z = 1.96);			// extrapolate the cycles of the run so far (z = 1.96 for a 95% confidence interval)
+    };
+
+    namespace functional			// functional mode: instructions only update architected state (registers, flags, NIA, MEM), with no timing
+    {
+	extern per_machine bool	active;		// executing functionally?
+	extern per_machine bool	warming;	// keep the cache tags warm while executing functionally?
+	extern per_machine bool	counting;	// count the instructions executed functionally?
+	extern per_machine u64	instructions;	// instructions executed functionally (if counting)
+
+	inline void	step()				// account for one instruction executed functionally
+	{
+	    if (counting) instructions++;
+	    if (warming) counters::cycles++;		// a nominal CPI of 1, so that the replacement policies see the order of the accesses
+	}
+	inline bool	next()				// start of an instruction (where sampling may switch modes): execute it functionally?
+	{
+	    if (!--sampling::countdown) sampling::next();
+	    return active;
+	}
+	inline void	touch(u32 EA, u32 L)		{ if (warming) operations::load(EA, L); }	// access to [EA, EA+L): updates the cache tags, when warming
+	void		enter(bool count = true, bool warm = false);	// switch to functional mode (modified data in the caches goes back to MEM; unless warm, the data caches are emptied)
+	void		leave();					// back to timing mode (the data caches start cold, or as warmed)
+
+	class region				// functional mode for the lifetime of a region object
+	{
+	    private:
+		bool	_active;			// mode in force before the region
+		bool	_warming;
+		bool	_counting;
+	    public:
+		region(bool count = true, bool warm = false)	{ _active = active; _warming = warming; _counting = counting; enter(count, warm); }
+		~region()					{ if (_active) enter(_counting, _warming); else leave(); }
+	};
+    };
+
+    namespace branches
+    {
+	class predictor				// branch prediction unit: a BTB for the targets of taken branches, and a direction predictor for the conditional ones
+	{
+	    public:
+		typedef struct
+		{
+		    u32		pc;					// address of the branch (invalid: an empty entry)
+		    u32		target;					// where it went, the last time it was taken
+		} btb_t;
+
+		typedef struct
+		{
+		    u16		tag;					// of the branch and history that allocated the entry
+		    u8		ctr;					// 3-bit counter: taken from 4 on
+		    u8		u;					// 2-bit useful counter: 0 means the entry can be replaced
+		} tagged_t;
+
+		typedef struct
+		{
+		    u64		executed;
+		    u64		taken;
+		    u64		mispredicted;				// direction predicted wrong
+		    u64		btbmisses;				// taken, with no target in the BTB
+		} site_t;						// the record of a static branch
+
+	    private:
+		static const u32	invalid = 0xffffffff;		// pc of an empty BTB entry (never a branch address)
+		static const u32	ntagged = 4;			// tagged tables of TAGE
+		static const u32	lengths[ntagged];		// global history bits each one uses (a geometric series)
+		static const u32	aging = 1 << 18;		// TAGE updates between two halvings of the useful counters
+
+		params::predictor_t	_kind;
+		u32			_history;			// bits of global history of gshare
+		u64			_ghr;				// global history: outcomes of the last conditional branches, the newest in bit 0
+		u64			_clock;				// TAGE updates so far
+		std::vector<u8>		_counters;			// 2-bit counters: taken from 2 on
+		std::vector<tagged_t>	_tagged;			// the tagged tables of TAGE, one after the other
+		std::vector<btb_t>	_btb;				// direct-mapped (none: no BTB)
+		std::vector<site_t>	_sites;				// indexed by instruction address / 4
+
+		bool	bimodal(u32 ix, bool taken);			// prediction of counter ix, which then learns the outcome
+		bool	tage(u32 pc, bool taken);			// prediction of TAGE for the branch at pc, which then learns the outcome
+		bool	direction(u32 pc, bool taken);			// predicted direction of the conditional branch at pc, before it learns the outcome
+
+	    public:
+		u64		predicted;				// counter of conditional branches predicted
+		u64		mispredicted;				// counter of those whose direction was predicted wrong
+		u64		btbmisses;				// counter of taken branches the BTB had no target for (fetch waits for decode)
+		u64		redirects;				// counter of fetches down the wrong path (fetch waits for the branch to complete)
+
+		predictor()						{ configure(params::STATIC, 16, 0, 0); }
+		void		configure(params::predictor_t kind, u32 entries, u32 history, u32 btb);	// (it is cleared)
+		void		clear();					// forget what was learned, and the statistics
+		params::predictor_t	kind() const			{ return _kind; }
+		bool		active() const				{ return _kind != params::STATIC; }
+		void		resolve(u32 pc, bool conditional, bool taken, u32 target, u64 decoded);	// the branch at pc (decoded at decoded) went to target if taken: fetch goes on, or waits
+		const std::vector<site_t>&	sites() const		{ return _sites; }
+		void		save(checkpoint::writer &W, const std::string &name) const;
+		void		restore(const checkpoint::reader &R, const std::string &name);
+	};
+
+	extern per_machine predictor	BP;		// of the frontend (none by default)
+    };
+
     namespace instructions
     {
+	extern per_machine pool	objects;		// storage for instructions
+
 	class instruction
 	{
 	    private:
-		static bool	first;		// first instruction processed
+		static per_machine bool	first;	// first instruction processed
 
 		u64		_count;		// instruction #
 		u32		_addr;		// instruction address
@@ -1269,21 +2093,38 @@ namespace pipelined
 		bool		_hit;		// L1I cache hit
 
 	    public:
+		typedef enum { NOBRANCH, CONDITIONAL, UNCONDITIONAL } branch_t;
+
 		instruction(u32 addr) { _addr = addr; }
+		static void*		operator new(size_t size)		{ return objects.allocate(size); }
+		static void		operator delete(void *p, size_t size)	{ objects.release(p, size); }
+		virtual			~instruction()				{ }
 		static void		zero() { first = true; }
 		virtual bool 		process() = 0;
-		virtual std::string	dasm() = 0;
+		virtual branch_t	branch() const	{ return NOBRANCH; }	// kind of branch, for the branch predictor
+		virtual void		operands(trace::operands_t &O) = 0;	// disassembly of the instruction, as a template and arguments
+		std::string		dasm()	{ trace::operands_t O; operands(O); return trace::describe(O); }
 		u64&	count()		{ return _count; }
 		const u64& count() const{ return _count; }
+		u32	addr() const	{ return _addr; }
+		u64 decoded() const	{ return _decoded; }
 		u64 dispatched() const	{ return _dispatched; }
 		void output(std::ostream& out)
 		{
 		    if (first)
 		    {
-			out << "instr # ,address ,          instruction ,   fetch ,  decode ,dispatch ,      op # ,            operation ,     ready ,    issued ,  complete" << std::endl;
+			if (trace::out.active()) trace::out.header();
+			else out << trace::header << std::endl;
 			first = false;
 		    }
 
+		    if (trace::out.active())
+		    {
+			trace::operands_t O; operands(O);
+			trace::out.instruction(_count, _addr, _hit, O, _fetched, _decoded, _dispatched);
+			return;
+		    }
+
 		    std::ios state(nullptr);
 		    state.copyfmt(out);
 		    out << std::setw( 7) << std::setfill('0') << _count     	<< " , ";
@@ -1296,8 +2137,8 @@ namespace pipelined
 		}
 		void	fetch()
 		{ 
-		    u32 latency = caches::L1I.contains(_addr, 4) ? params::L1::latency : params::MEM::latency;
 		    _hit = caches::L1I.contains(_addr, 4);
+		    u32 latency = _hit ? params::L1::latency : params::MEM::latency;
 		    _fetched = max(counters::lastfetch + latency, counters::lastfetched+1);
 		    counters::lastfetched = _fetched;
 		    counters::lastfetch++;
@@ -1315,6 +2156,35 @@ namespace pipelined
 
 	bool process(instruction* instr);
 
+	template<typename T> struct kind { static const char id; };	// one distinct address per instruction class
+	template<typename T> const char kind<T>::id = 0;
+
+	struct decoded					// an entry of the decoded-instruction cache
+	{
+	    instruction*	inst;			// the decoded instruction (0 if none)
+	    const void*		kind;			// class of the decoded instruction
+	    u64			ops[4];			// operands it was decoded with
+	};
+
+	extern per_machine std::vector<decoded>	dcache;		// decoded-instruction cache, indexed by instruction address / 4
+
+	void flush();					// discard all decoded instructions
+
+	template<typename T, typename... A> T* cached(u32 addr, A... args)	// return the decoded instruction at addr, building it if needed
+	{
+	    static_assert(sizeof...(A) <= 4, "too many operands");
+	    u64 ops[4] = { (u64)(args)... };
+	    u32 ix = addr / 4;
+	    if (ix >= dcache.size()) dcache.resize(ix + 1);
+	    decoded &d = dcache[ix];
+	    if (d.inst && (d.kind == &kind<T>::id) && std::equal(ops, ops + 4, d.ops)) return (T*)d.inst;
+	    delete d.inst;				// a different instruction lives at this address (e.g., another kernel)
+	    d.inst = new T(args..., addr);
+	    d.kind = &kind<T>::id;
+	    std::copy(ops, ops + 4, d.ops);
+	    return (T*)d.inst;
+	}
+
 	class addi : public instruction
 	{
 	    private:
@@ -1324,8 +2194,9 @@ namespace pipelined
 	    public:
 		addi(gprnum RT, gprnum RA, i16 SI, u32 addr) : instruction(addr) { _RT = RT; _RA = RA; _SI = SI; }
 		bool process() { return operations::process(new operations::addi(_RT, _RA, _SI), dispatched()); }
-		static bool execute(gprnum RT, gprnum RA, i16 SI, u32 line) { return instructions::process(new addi(RT, RA, SI, 4*line)); }
-		std::string dasm() { std::string str = "addi (r" + std::to_string(_RT) + ", r" + std::to_string(_RA) + ", " + std::to_string(_SI) + ")"; return str; }
+		static bool execute(gprnum RT, gprnum RA, i16 SI, u32 line) { if (functional::next()) return perform(RT, RA, SI); return instructions::process(cached<addi>(4*line, RT, RA, SI)); }
+		static bool perform(gprnum RT, gprnum RA, i16 SI) { functional::step(); GPR[RT].data() = GPR[RA].data() + SI; return false; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("addi (r%, r%, %)"); O.set(F, _RT, _RA, _SI); }
 	};
 
 	class muli : public instruction
@@ -1337,8 +2208,9 @@ namespace pipelined
 	    public:
 		muli(gprnum RT, gprnum RA, i16 SI, u32 addr) : instruction(addr) { _RT = RT; _RA = RA; _SI = SI; }
 		bool process() { return operations::process(new operations::muli(_RT, _RA, _SI), dispatched()); }
-		static bool execute(gprnum RT, gprnum RA, i16 SI, u32 line) { return instructions::process(new muli(RT, RA, SI, 4*line)); }
-		std::string dasm() { std::string str = "muli (r" + std::to_string(_RT) + ", r" + std::to_string(_RA) + ", " + std::to_string(_SI) + ")"; return str; }
+		static bool execute(gprnum RT, gprnum RA, i16 SI, u32 line) { if (functional::next()) return perform(RT, RA, SI); return instructions::process(cached<muli>(4*line, RT, RA, SI)); }
+		static bool perform(gprnum RT, gprnum RA, i16 SI) { functional::step(); GPR[RT].data() = GPR[RA].data() * SI; return false; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("muli (r%, r%, %)"); O.set(F, _RT, _RA, _SI); }
 	};
 
 	class add : public instruction
@@ -1350,8 +2222,9 @@ namespace pipelined
 	    public:
 		add(gprnum RT, gprnum RA, gprnum RB, u32 addr) : instruction(addr) { _RT = RT; _RA = RA; _RB = RB; }
 		bool process() { return operations::process(new operations::add(_RT, _RA, _RB), dispatched()); }
-		static bool execute(gprnum RT, gprnum RA, gprnum RB, u32 line) { return instructions::process(new add(RT, RA, RB, 4*line)); }
-		std::string dasm() { std::string str = "add (r" + std::to_string(_RT) + ", r" + std::to_string(_RA) + ", r" + std::to_string(_RB) + ")"; return str; }
+		static bool execute(gprnum RT, gprnum RA, gprnum RB, u32 line) { if (functional::next()) return perform(RT, RA, RB); return instructions::process(cached<add>(4*line, RT, RA, RB)); }
+		static bool perform(gprnum RT, gprnum RA, gprnum RB) { functional::step(); GPR[RT].data() = GPR[RA].data() + GPR[RB].data(); return false; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("add (r%, r%, r%)"); O.set(F, _RT, _RA, _RB); }
 	};
 
 	class sub : public instruction
@@ -1363,8 +2236,9 @@ namespace pipelined
 	    public:
 		sub(gprnum RT, gprnum RA, gprnum RB, u32 addr) : instruction(addr) { _RT = RT; _RA = RA; _RB = RB; }
 		bool process() { return operations::process(new operations::sub(_RT, _RA, _RB), dispatched()); }
-		static bool execute(gprnum RT, gprnum RA, gprnum RB, u32 line) { return instructions::process(new sub(RT, RA, RB, 4*line)); }
-		std::string dasm() { std::string str = "sub (r" + std::to_string(_RT) + ", r" + std::to_string(_RA) + ", r" + std::to_string(_RB) + ")"; return str; }
+		static bool execute(gprnum RT, gprnum RA, gprnum RB, u32 line) { if (functional::next()) return perform(RT, RA, RB); return instructions::process(cached<sub>(4*line, RT, RA, RB)); }
+		static bool perform(gprnum RT, gprnum RA, gprnum RB) { functional::step(); GPR[RT].data() = GPR[RA].data() - GPR[RB].data(); return false; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("sub (r%, r%, r%)"); O.set(F, _RT, _RA, _RB); }
 	};
 
 	class cmpi : public instruction
@@ -1375,8 +2249,9 @@ namespace pipelined
 	    public:
 		cmpi(gprnum RA, i16 SI, u32 addr) : instruction(addr) { _RA = RA; _SI = SI; }
 		bool process() { return operations::process(new operations::cmpi(_RA, _SI), dispatched()); }
-		static bool execute(gprnum RA, i16 SI, u32 line) { return instructions::process(new cmpi(RA, SI, 4*line)); }
-		std::string dasm() { std::string str = "cmpi (r" + std::to_string(_RA) + ", " + std::to_string(_SI) + ")"; return str; }
+		static bool execute(gprnum RA, i16 SI, u32 line) { if (functional::next()) return perform(RA, SI); return instructions::process(cached<cmpi>(4*line, RA, SI)); }
+		static bool perform(gprnum RA, i16 SI) { functional::step(); flags.LT = false; flags.GT = false; flags.EQ = false; if (GPR[RA].data() < SI) flags.LT = true; else if (GPR[RA].data() > SI) flags.GT = true; else flags.EQ = true; return false; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("cmpi (r%, %)"); O.set(F, _RA, _SI); }
 	};
 
 	class lbz : public instruction
@@ -1387,8 +2262,22 @@ namespace pipelined
 	    public:
 		lbz(gprnum RT, gprnum RA, u32 addr) : instruction(addr) { _RT = RT; _RA = RA; }
 		bool process() { return operations::process(new operations::lbz(_RT, _RA), dispatched()); }
-		static bool execute(gprnum RT, gprnum RA, u32 line) { return instructions::process(new lbz(RT, RA, 4*line)); }
-		std::string dasm() { std::string str = "lbz (r" + std::to_string(_RT) + ", r" + std::to_string(_RA) + ")"; return str; }
+		static bool execute(gprnum RT, gprnum RA, u32 line) { if (functional::next()) return perform(RT, RA); return instructions::process(cached<lbz>(4*line, RT, RA)); }
+		static bool perform(gprnum RT, gprnum RA) { functional::step(); functional::touch(GPR[RA].data(), 1); GPR[RT].data() = MEM[GPR[RA].data()]; return false; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("lbz (r%, r%)"); O.set(F, _RT, _RA); }
+	};
+
+	class lwz : public instruction
+	{
+	    private:
+		gprnum 	_RT;
+		gprnum	_RA;
+	    public:
+		lwz(gprnum RT, gprnum RA, u32 addr) : instruction(addr) { _RT = RT; _RA = RA; }
+		bool process() { return operations::process(new operations::lwz(_RT, _RA), dispatched()); }
+		static bool execute(gprnum RT, gprnum RA, u32 line) { if (functional::next()) return perform(RT, RA); return instructions::process(cached<lwz>(4*line, RT, RA)); }
+		static bool perform(gprnum RT, gprnum RA) { functional::step(); functional::touch(GPR[RA].data(), 4); GPR[RT].data() = *(const u32*)&MEM[GPR[RA].data()]; return false; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("lwz (r%, r%)"); O.set(F, _RT, _RA); }
 	};
 
 	class stb : public instruction
@@ -1399,8 +2288,9 @@ namespace pipelined
 	    public:
 		stb(gprnum RS, gprnum RA, u32 addr) : instruction(addr) { _RS = RS, _RA = RA; }
 		bool process() { return operations::process(new operations::stb(_RS, _RA), dispatched()); }
-		static bool execute(gprnum RS, gprnum RA, u32 line) { return instructions::process(new stb(RS, RA, 4*line)); }
-		std::string dasm() { std::string str = "stb (r" + std::to_string(_RS) + ", r" + std::to_string(_RA) + ")"; return str; }
+		static bool execute(gprnum RS, gprnum RA, u32 line) { if (functional::next()) return perform(RS, RA); return instructions::process(cached<stb>(4*line, RS, RA)); }
+		static bool perform(gprnum RS, gprnum RA) { functional::step(); functional::touch(GPR[RA].data(), 1); MEM[GPR[RA].data()] = GPR[RS].data(); return false; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("stb (r%, r%)"); O.set(F, _RS, _RA); }
 	};
 
 	class vlb : public instruction
@@ -1412,8 +2302,9 @@ namespace pipelined
 	    public:
 		vlb(vrnum VT, gprnum RA, vrnum VM, u32 addr) : instruction(addr) { _VT = VT; _RA = RA; _VM = VM; }
 		bool process() { return operations::process(new operations::vlb(_VT, _RA, _VM), dispatched()); }
-		static bool execute(vrnum VT, gprnum RA, vrnum VM, u32 line) { return instructions::process(new vlb(VT, RA, VM, 4*line)); }
-		std::string dasm() { std::string str = "vlb (v" + std::to_string(_VT) + ", r" + std::to_string(_RA) + ", v" + std::to_string(_VM) + ")"; return str; }
+		static bool execute(vrnum VT, gprnum RA, vrnum VM, u32 line) { if (functional::next()) return perform(VT, RA, VM); return instructions::process(cached<vlb>(4*line, VT, RA, VM)); }
+		static bool perform(vrnum VT, gprnum RA, vrnum VM) { functional::step(); functional::touch(GPR[RA].data(), 16); const u8 *data = &MEM[GPR[RA].data()]; for (u32 i=0; i<16; i++) VR[VT].data().byte[i] = VR[VM].data().byte[i] ? data[i] : 0; return false; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("vlb (v%, r%, v%)"); O.set(F, _VT, _RA, _VM); }
 	};
 
 	class vstb : public instruction
@@ -1425,8 +2316,9 @@ namespace pipelined
 	    public:
 		vstb(vrnum VS, gprnum RA, vrnum VM, u32 addr) : instruction(addr) { _VS = VS, _RA = RA; _VM = VM; }
 		bool process() { return operations::process(new operations::vstb(_VS, _RA, _VM), dispatched()); }
-		static bool execute(vrnum VS, gprnum RA, vrnum VM, u32 line) { return instructions::process(new vstb(VS, RA, VM, 4*line)); }
-		std::string dasm() { std::string str = "vstb (v" + std::to_string(_VS) + ", r" + std::to_string(_RA) + ", v" + std::to_string(_VM) + ")"; return str; }
+		static bool execute(vrnum VS, gprnum RA, vrnum VM, u32 line) { if (functional::next()) return perform(VS, RA, VM); return instructions::process(cached<vstb>(4*line, VS, RA, VM)); }
+		static bool perform(vrnum VS, gprnum RA, vrnum VM) { functional::step(); functional::touch(GPR[RA].data(), 16); u8 *data = &MEM[GPR[RA].data()]; for (u32 i=0; i<16; i++) if (VR[VM].data().byte[i]) data[i] = VR[VS].data().byte[i]; return false; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("vstb (v%, r%, v%)"); O.set(F, _VS, _RA, _VM); }
 	};
 
 	class vlfs : public instruction
@@ -1438,8 +2330,9 @@ namespace pipelined
 	    public:
 		vlfs(vrnum VT, gprnum RA, vrnum VM, u32 addr) : instruction(addr) { _VT = VT; _RA = RA; _VM = VM; }
 		bool process() { return operations::process(new operations::vlfs(_VT, _RA, _VM), dispatched()); }
-		static bool execute(vrnum VT, gprnum RA, vrnum VM, u32 line) { return instructions::process(new vlfs(VT, RA, VM, 4*line)); }
-		std::string dasm() { std::string str = "vlfs (v" + std::to_string(_VT) + ", r" + std::to_string(_RA) + ", v" + std::to_string(_VM) + ")"; return str; }
+		static bool execute(vrnum VT, gprnum RA, vrnum VM, u32 line) { if (functional::next()) return perform(VT, RA, VM); return instructions::process(cached<vlfs>(4*line, VT, RA, VM)); }
+		static bool perform(vrnum VT, gprnum RA, vrnum VM) { functional::step(); functional::touch(GPR[RA].data(), 16); const float *data = (const float*)&MEM[GPR[RA].data()]; for (u32 i=0; i<4; i++) VR[VT].data().sp[i] = VR[VM].data().word[i] ? data[i] : 0; return false; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("vlfs (v%, r%, v%)"); O.set(F, _VT, _RA, _VM); }
 	};
 
 	class vlspltsp : public instruction
@@ -1451,8 +2344,9 @@ namespace pipelined
 	    public:
 		vlspltsp(vrnum VT, gprnum RA, vrnum VM, u32 addr) : instruction(addr) { _VT = VT; _RA = RA; _VM = VM; }
 		bool process() { return operations::process(new operations::vlspltsp(_VT, _RA, _VM), dispatched()); }
-		static bool execute(vrnum VT, gprnum RA, vrnum VM, u32 line) { return instructions::process(new vlspltsp(VT, RA, VM, 4*line)); }
-		std::string dasm() { std::string str = "vlspltsp (v" + std::to_string(_VT) + ", r" + std::to_string(_RA) + ", v" + std::to_string(_VM) + ")"; return str; }
+		static bool execute(vrnum VT, gprnum RA, vrnum VM, u32 line) { if (functional::next()) return perform(VT, RA, VM); return instructions::process(cached<vlspltsp>(4*line, VT, RA, VM)); }
+		static bool perform(vrnum VT, gprnum RA, vrnum VM) { functional::step(); functional::touch(GPR[RA].data(), 4); float data = *(const float*)&MEM[GPR[RA].data()]; for (u32 i=0; i<4; i++) VR[VT].data().sp[i] = VR[VM].data().word[i] ? data : 0; return false; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("vlspltsp (v%, r%, v%)"); O.set(F, _VT, _RA, _VM); }
 	};
 
 	class vstfs : public instruction
@@ -1464,8 +2358,9 @@ namespace pipelined
 	    public:
 		vstfs(vrnum VS, gprnum RA, vrnum VM, u32 addr) : instruction(addr) { _VS = VS, _RA = RA; _VM = VM; }
 		bool process() { return operations::process(new operations::vstfs(_VS, _RA, _VM), dispatched()); }
-		static bool execute(vrnum VS, gprnum RA, vrnum VM, u32 line) { return instructions::process(new vstfs(VS, RA, VM, 4*line)); }
-		std::string dasm() { std::string str = "vstfs (v" + std::to_string(_VS) + ", r" + std::to_string(_RA) + ", v" + std::to_string(_VM) + ")"; return str; }
+		static bool execute(vrnum VS, gprnum RA, vrnum VM, u32 line) { if (functional::next()) return perform(VS, RA, VM); return instructions::process(cached<vstfs>(4*line, VS, RA, VM)); }
+		static bool perform(vrnum VS, gprnum RA, vrnum VM) { functional::step(); functional::touch(GPR[RA].data(), 16); float *data = (float*)&MEM[GPR[RA].data()]; for (u32 i=0; i<4; i++) if (VR[VM].data().word[i]) data[i] = VR[VS].data().sp[i]; return false; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("vstfs (v%, r%, v%)"); O.set(F, _VS, _RA, _VM); }
 	};
 
 	class beq : public instruction
@@ -1476,8 +2371,10 @@ namespace pipelined
 	    public:
 		beq(i16 BD, const char *label, u32 addr) : instruction(addr) { _BD = BD; _label = label; }
 		bool process() { return operations::process(new operations::beq(_BD), dispatched()); }
-		static bool execute(i16 BD, const char *label, u32 line) { return instructions::process(new beq(BD, label, 4*line)); }
-		std::string dasm() { std::string str = "beq (" + std::string(_label) + ")"; return str; }
+		branch_t branch() const { return CONDITIONAL; }
+		static bool execute(i16 BD, const char *label, u32 line) { if (functional::next()) return perform(BD); return instructions::process(cached<beq>(4*line, BD, label)); }
+		static bool perform(i16 BD) { functional::step(); if (flags.EQ) { NIA = CIA + BD; return true; } return false; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("beq ($)"); O.set(F, trace::string(_label)); }
 	};
 
 	class bne : public instruction
@@ -1488,8 +2385,10 @@ namespace pipelined
 	    public:
 		bne(i16 BD, const char *label, u32 addr) : instruction(addr) { _BD = BD; _label = label; }
 		bool process() { return operations::process(new operations::bne(_BD), dispatched()); }
-		static bool execute(i16 BD, const char *label, u32 line) { return instructions::process(new bne(BD, label, 4*line)); }
-		std::string dasm() { std::string str = "bne (" + std::string(_label) + ")"; return str; }
+		branch_t branch() const { return CONDITIONAL; }
+		static bool execute(i16 BD, const char *label, u32 line) { if (functional::next()) return perform(BD); return instructions::process(cached<bne>(4*line, BD, label)); }
+		static bool perform(i16 BD) { functional::step(); if (!flags.EQ) { NIA = CIA + BD; return true; } return false; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("bne ($)"); O.set(F, trace::string(_label)); }
 	};
 
 	class blt : public instruction
@@ -1500,8 +2399,10 @@ namespace pipelined
 	    public:
 		blt(i16 BD, const char *label, u32 addr) : instruction(addr) { _BD = BD; _label = label; }
 		bool process() { return operations::process(new operations::blt(_BD), dispatched()); }
-		static bool execute(i16 BD, const char *label, u32 line) { return instructions::process(new blt(BD, label, 4*line)); }
-		std::string dasm() { std::string str = "blt (" + std::string(_label) + ")"; return str; }
+		branch_t branch() const { return CONDITIONAL; }
+		static bool execute(i16 BD, const char *label, u32 line) { if (functional::next()) return perform(BD); return instructions::process(cached<blt>(4*line, BD, label)); }
+		static bool perform(i16 BD) { functional::step(); if (flags.LT) { NIA = CIA + BD; return true; } return false; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("blt ($)"); O.set(F, trace::string(_label)); }
 	};
 
 	class b : public instruction
@@ -1512,8 +2413,10 @@ namespace pipelined
 	    public:
 		b(i16 BD, const char *label, u32 addr) : instruction(addr) { _BD = BD; _label = label; }
 		bool process() { return operations::process(new operations::b(_BD), dispatched()); }
-		static bool execute(i16 BD, const char *label, u32 line) { return instructions::process(new b(BD, label, 4*line)); }
-		std::string dasm() { std::string str = "b (" + std::string(_label) + ")"; return str; }
+		branch_t branch() const { return UNCONDITIONAL; }
+		static bool execute(i16 BD, const char *label, u32 line) { if (functional::next()) return perform(BD); return instructions::process(cached<b>(4*line, BD, label)); }
+		static bool perform(i16 BD) { functional::step(); NIA = CIA + BD; return true; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("b ($)"); O.set(F, trace::string(_label)); }
 	};
 
 	class zd : public instruction
@@ -1523,8 +2426,9 @@ namespace pipelined
 	    public:
 		zd(fprnum FT, u32 addr) : instruction(addr) { _FT = FT; }
 		bool process() { return operations::process(new operations::zd(_FT), dispatched()); }
-		static bool execute(fprnum FT, u32 line) { return instructions::process(new zd(FT, 4*line)); }
-		std::string dasm() { std::string str = "zd (f" + std::to_string(_FT) + ")"; return str; }
+		static bool execute(fprnum FT, u32 line) { if (functional::next()) return perform(FT); return instructions::process(cached<zd>(4*line, FT)); }
+		static bool perform(fprnum FT) { functional::step(); FPR[FT].data() = 0.0; return false; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("zd (f%)"); O.set(F, _FT); }
 	};
 
 	class fmul : public instruction
@@ -1536,8 +2440,9 @@ namespace pipelined
 	    public:
 		fmul(fprnum FT, fprnum FA, fprnum FB, u32 addr) : instruction(addr) { _FT = FT; _FA = FA; _FB = FB; }
 		bool process() { return operations::process(new operations::fmul(_FT, _FA, _FB), dispatched()); }
-		static bool execute(fprnum FT, fprnum FA, fprnum FB, u32 line) { return instructions::process(new fmul(FT, FA, FB, 4*line)); }
-		std::string dasm() { std::string str = "fmul (f" + std::to_string(_FT) + ", f" + std::to_string(_FA) + ", f" + std::to_string(_FB) + ")"; return str; }
+		static bool execute(fprnum FT, fprnum FA, fprnum FB, u32 line) { if (functional::next()) return perform(FT, FA, FB); return instructions::process(cached<fmul>(4*line, FT, FA, FB)); }
+		static bool perform(fprnum FT, fprnum FA, fprnum FB) { functional::step(); FPR[FT].data() = FPR[FA].data() * FPR[FB].data(); return false; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("fmul (f%, f%, f%)"); O.set(F, _FT, _FA, _FB); }
 	};
 
 	class fadd : public instruction
@@ -1549,8 +2454,9 @@ namespace pipelined
 	    public:
 		fadd(fprnum FT, fprnum FA, fprnum FB, u32 addr) : instruction(addr) { _FT = FT; _FA = FA; _FB = FB; }
 		bool process() { return operations::process(new operations::fadd(_FT, _FA, _FB), dispatched()); }
-		static bool execute(fprnum FT, fprnum FA, fprnum FB, u32 line) { return instructions::process(new fadd(FT, FA, FB, 4*line)); }
-		std::string dasm() { std::string str = "fadd (f" + std::to_string(_FT) + ", f" + std::to_string(_FA) + ", f" + std::to_string(_FB) + ")"; return str; }
+		static bool execute(fprnum FT, fprnum FA, fprnum FB, u32 line) { if (functional::next()) return perform(FT, FA, FB); return instructions::process(cached<fadd>(4*line, FT, FA, FB)); }
+		static bool perform(fprnum FT, fprnum FA, fprnum FB) { functional::step(); FPR[FT].data() = FPR[FA].data() + FPR[FB].data(); return false; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("fadd (f%, f%, f%)"); O.set(F, _FT, _FA, _FB); }
 	};
 
 	class vfmulsp : public instruction
@@ -1563,8 +2469,9 @@ namespace pipelined
 	    public:
 		vfmulsp(vrnum VT, vrnum VA, vrnum VB, vrnum VM, u32 addr) : instruction(addr) { _VT = VT; _VA = VA; _VB = VB; _VM = VM; }
 		bool process() { return operations::process(new operations::vfmulsp(_VT, _VA, _VB, _VM), dispatched()); }
-		static bool execute(vrnum VT, vrnum VA, vrnum VB, vrnum VM, u32 line) { return instructions::process(new vfmulsp(VT, VA, VB, VM, 4*line)); }
-		std::string dasm() { std::string str = "vfmulsp (v" + std::to_string(_VT) + ", v" + std::to_string(_VA) + ", v" + std::to_string(_VB) + ", v" + std::to_string(_VT) + ")"; return str; }
+		static bool execute(vrnum VT, vrnum VA, vrnum VB, vrnum VM, u32 line) { if (functional::next()) return perform(VT, VA, VB, VM); return instructions::process(cached<vfmulsp>(4*line, VT, VA, VB, VM)); }
+		static bool perform(vrnum VT, vrnum VA, vrnum VB, vrnum VM) { functional::step(); vector RES = {0}; for (u32 i=0; i<4; i++) RES.sp[i] = VR[VM].data().word[i] ? VR[VA].data().sp[i] * VR[VB].data().sp[i] : 0.0; VR[VT].data() = RES; return false; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("vfmulsp (v%, v%, v%, v%)"); O.set(F, _VT, _VA, _VB, _VT); }
 	};
 
 	class vfaddsp : public instruction
@@ -1577,8 +2484,9 @@ namespace pipelined
 	    public:
 		vfaddsp(vrnum VT, vrnum VA, vrnum VB, vrnum VM, u32 addr) : instruction(addr) { _VT = VT; _VA = VA; _VB = VB; _VM = VM; }
 		bool process() { return operations::process(new operations::vfaddsp(_VT, _VA, _VB, _VM), dispatched()); }
-		static bool execute(vrnum VT, vrnum VA, vrnum VB, vrnum VM, u32 line) { return instructions::process(new vfaddsp(VT, VA, VB, VM, 4*line)); }
-		std::string dasm() { std::string str = "vfaddsp (v" + std::to_string(_VT) + ", v" + std::to_string(_VA) + ", v" + std::to_string(_VB) + ", v" + std::to_string(_VT) + ")"; return str; }
+		static bool execute(vrnum VT, vrnum VA, vrnum VB, vrnum VM, u32 line) { if (functional::next()) return perform(VT, VA, VB, VM); return instructions::process(cached<vfaddsp>(4*line, VT, VA, VB, VM)); }
+		static bool perform(vrnum VT, vrnum VA, vrnum VB, vrnum VM) { functional::step(); vector RES = {0}; for (u32 i=0; i<4; i++) RES.sp[i] = VR[VM].data().word[i] ? VR[VA].data().sp[i] + VR[VB].data().sp[i] : 0.0; VR[VT].data() = RES; return false; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("vfaddsp (v%, v%, v%, v%)"); O.set(F, _VT, _VA, _VB, _VT); }
 	};
 
 	class lfd : public instruction
@@ -1589,8 +2497,9 @@ namespace pipelined
 	    public:
 		lfd(fprnum FT, gprnum RA, u32 addr) : instruction(addr) { _FT = FT; _RA = RA; }
 		bool process() { return operations::process(new operations::lfd(_FT, _RA), dispatched()); }
-		static bool execute(fprnum FT, gprnum RA, u32 line) { return instructions::process(new lfd(FT, RA, 4*line)); }
-		std::string dasm() { std::string str = "lfd (f" + std::to_string(_FT) + ", r" + std::to_string(_RA) + ")"; return str; }
+		static bool execute(fprnum FT, gprnum RA, u32 line) { if (functional::next()) return perform(FT, RA); return instructions::process(cached<lfd>(4*line, FT, RA)); }
+		static bool perform(fprnum FT, gprnum RA) { functional::step(); functional::touch(GPR[RA].data(), 8); FPR[FT].data() = *(const double*)&MEM[GPR[RA].data()]; return false; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("lfd (f%, r%)"); O.set(F, _FT, _RA); }
 	};
 
 	class stfd : public instruction
@@ -1601,8 +2510,9 @@ namespace pipelined
 	    public:
 		stfd(fprnum FS, gprnum RA, u32 addr) : instruction(addr) { _FS = FS; _RA = RA; }
 		bool process() { return operations::process(new operations::stfd(_FS, _RA), dispatched()); }
-		static bool execute(fprnum FS, gprnum RA, u32 line) { return instructions::process(new stfd(FS, RA, 4*line)); }
-		std::string dasm() { std::string str = "stfd (f" + std::to_string(_FS) + ", r" + std::to_string(_RA) + ")"; return str; }
+		static bool execute(fprnum FS, gprnum RA, u32 line) { if (functional::next()) return perform(FS, RA); return instructions::process(cached<stfd>(4*line, FS, RA)); }
+		static bool perform(fprnum FS, gprnum RA) { functional::step(); functional::touch(GPR[RA].data(), 8); *(double*)&MEM[GPR[RA].data()] = FPR[FS].data(); return false; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("stfd (f%, r%)"); O.set(F, _FS, _RA); }
 	};
 
 	class vmaskb : public instruction
@@ -1613,8 +2523,9 @@ namespace pipelined
 	    public:
 		vmaskb(vrnum VT, gprnum RA, u32 addr) : instruction(addr) { _VT = VT; _RA = RA; }
 		bool process() { return operations::process(new operations::vmaskb(_VT, _RA), dispatched()); }
-		static bool execute(vrnum VT, gprnum RA, u32 line) { return instructions::process(new vmaskb(VT, RA, 4*line)); }
-		std::string dasm() { std::string str = "vmaskb (v" + std::to_string(_VT) + ", r" + std::to_string(_RA) + ")"; return str; }
+		static bool execute(vrnum VT, gprnum RA, u32 line) { if (functional::next()) return perform(VT, RA); return instructions::process(cached<vmaskb>(4*line, VT, RA)); }
+		static bool perform(vrnum VT, gprnum RA) { functional::step(); vector RES = {0}; for (u32 i=0; i<min(16U, GPR[RA].data()); i++) RES.byte[i] = 1; VR[VT].data() = RES; return false; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("vmaskb (v%, r%)"); O.set(F, _VT, _RA); }
 	};
 
 	class vmaskw : public instruction
@@ -1625,8 +2536,9 @@ namespace pipelined
 	    public:
 		vmaskw(vrnum VT, gprnum RA, u32 addr) : instruction(addr) { _VT = VT; _RA = RA; }
 		bool process() { return operations::process(new operations::vmaskw(_VT, _RA), dispatched()); }
-		static bool execute(vrnum VT, gprnum RA, u32 line) { return instructions::process(new vmaskw(VT, RA, 4*line)); }
-		std::string dasm() { std::string str = "vmaskw (v" + std::to_string(_VT) + ", r" + std::to_string(_RA) + ")"; return str; }
+		static bool execute(vrnum VT, gprnum RA, u32 line) { if (functional::next()) return perform(VT, RA); return instructions::process(cached<vmaskw>(4*line, VT, RA)); }
+		static bool perform(vrnum VT, gprnum RA) { functional::step(); vector RES = {0}; for (u32 i=0; i<min(4U, GPR[RA].data()); i++) RES.word[i] = 1; VR[VT].data() = RES; return false; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("vmaskw (v%, r%)"); O.set(F, _VT, _RA); }
 	};
 
 	class vpopcnt : public instruction
@@ -1637,8 +2549,9 @@ namespace pipelined
 	    public:
 		vpopcnt(gprnum RT, vrnum VA, u32 addr) : instruction(addr) { _RT = RT; _VA = VA; }
 		bool process() { return operations::process(new operations::vpopcnt(_RT, _VA), dispatched()); }
-		static bool execute(gprnum RT, vrnum VA, u32 line) { return instructions::process(new vpopcnt(RT, VA, 4*line)); }
-		std::string dasm() { std::string str = "vpopcnt (r" + std::to_string(_RT) + ", v" + std::to_string(_VA) + ")"; return str; }
+		static bool execute(gprnum RT, vrnum VA, u32 line) { if (functional::next()) return perform(RT, VA); return instructions::process(cached<vpopcnt>(4*line, RT, VA)); }
+		static bool perform(gprnum RT, vrnum VA) { functional::step(); u32 RES = 0; for (u32 i=0; i<16; i++) RES += __builtin_popcount(VR[VA].data().byte[i]); GPR[RT].data() = RES; return false; }
+		void operands(trace::operands_t &O) { static const u16 F = trace::format("vpopcnt (r%, v%)"); O.set(F, _RT, _VA); }
 	};
     };
 };
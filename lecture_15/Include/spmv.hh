@@ -0,0 +1,9 @@
+#ifndef _SPMV_HH_
+#define _SPMV_HH_
+
+namespace pipelined
+{
+    void spmv(double *y, double *val, uint32_t *col, uint32_t *rowptr, double *x, uint32_t m);
+};
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef _TRACE_HH_
+#define _TRACE_HH_
+
+#include<stdio.h>
+#include<stdint.h>
+#include<assert.h>
+#include<vector>
+#include<string>
+
+// Binary trace format, shared by the simulator (writer) and Tools/tracedump (reader).
+//
+// A trace file starts with the 8-byte magic "PLTRACE1", followed by records. Each record is a kind byte
+// and a sequence of LEB128 varints (signed values are zigzag encoded):
+//
+//   'F' format      : id, length, bytes		disassembly template; '%' is a number, '$' a string operand
+//   'S' string      : id, length, bytes		string operand (branch labels)
+//   'H' header      :					start of a new stream (CSV header line)
+//   'I' instruction : count delta, addr, hit, operands, fetched delta, decoded - fetched, dispatched - decoded
+//   'O' operation   : count delta, operands, ready - dispatched, issue - ready, complete - issue
+//
+// Operands are the format id, the number of arguments and the (zigzag) arguments. Count deltas are relative
+// to the previous record of the same kind, fetched to the previous instruction, and ready to the dispatch
+// cycle of the previous instruction. Formats and strings are defined in the file before their first use.
+
+namespace pipelined
+{
+    namespace trace
+    {
+	enum kind_t { FORMAT = 'F', STRING = 'S', HEADER = 'H', INSTRUCTION = 'I', OPERATION = 'O' };
+
+	static const char	magic[8] = { 'P', 'L', 'T', 'R', 'A', 'C', 'E', '1' };
+	static const char	header[] = "instr # ,address ,          instruction ,   fetch ,  decode ,dispatch ,      op # ,            operation ,     ready ,    issued ,  complete";
+
+	struct operands_t				// disassembly of an instruction or operation, as a template and its arguments
+	{
+	    uint16_t	format;				// index of the template
+	    uint8_t	nargs;				// number of arguments
+	    int64_t	args[4];			// the arguments
+
+	    template<typename... A> void set(uint16_t F, A... a)
+	    {
+		static_assert(sizeof...(A) <= 4, "too many operands");
+		int64_t v[] = { 0, (int64_t)(a)... };
+		format = F; nargs = sizeof...(A);
+		for (uint32_t i=0; i<nargs; i++) args[i] = v[i+1];
+	    }
+	};
+
+	inline std::string	text					// expand operands O with the given templates and strings
+	(
+	    const operands_t			&O,
+	    const std::vector<std::string>	&formats,
+	    const std::vector<std::string>	&strings
+	)
+	{
+	    assert(O.format < formats.size());
+	    const std::string &F = formats[O.format];
+	    std::string str; uint32_t n = 0;
+	    for (uint32_t i=0; i<F.size(); i++)
+	    {
+		if      (F[i] == '%') { assert(n < O.nargs); str += std::to_string(O.args[n++]); }
+		else if (F[i] == '$') { assert(n < O.nargs); assert((uint64_t)O.args[n] < strings.size()); str += strings[O.args[n++]]; }
+		else                  str += F[i];
+	    }
+	    return str;
+	}
+
+	inline uint64_t	zigzag(int64_t v)	{ return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63); }
+	inline int64_t	unzigzag(uint64_t v)	{ return (int64_t)(v >> 1) ^ -(int64_t)(v & 1); }
+
+	class writer					// buffered writer of trace records
+	{
+	    private:
+		FILE*			_file;		// trace file (0 if not open)
+		std::vector<uint8_t>	_buffer;	// pending bytes
+		uint32_t		_length;	// bytes used in _buffer
+		std::vector<bool>	_formats;	// formats already defined in the file
+		std::vector<uint8_t>	_smask;		// which arguments of each defined format are strings
+		std::vector<bool>	_strings;	// strings already defined in the file
+		uint64_t		_icount;	// last instruction count
+		uint64_t		_ocount;	// last operation count
+		uint64_t		_fetched;	// last fetch cycle
+		uint64_t		_dispatched;	// last dispatch cycle
+
+		void	put(uint64_t v)		{ if (_length + 10 > _buffer.size()) flush(); do { uint8_t b = v & 0x7f; v >>= 7; _buffer[_length++] = b | (v ? 0x80 : 0); } while (v); }
+		void	put(int64_t v)		{ put(zigzag(v)); }
+		void	bytes(const std::string &s);
+		void	operands(const operands_t &O);
+
+	    public:
+		writer() : _buffer(1 << 20)	{ _file = 0; _length = 0; }
+		~writer()			{ close(); }
+		bool	open(const char *path);					// start a trace file at path
+		void	close();						// flush and close the trace file
+		void	flush();						// write pending records to the file
+		bool	active() const		{ return _file != 0; }		// is a trace file open?
+		void	header();						// start of a new stream
+		void	instruction(uint64_t count, uint32_t addr, bool hit, const operands_t &O, uint64_t fetched, uint64_t decoded, uint64_t dispatched);
+		void	operation(uint64_t count, const operands_t &O, uint64_t ready, uint64_t issue, uint64_t complete);
+	};
+
+	extern std::vector<std::string>		formats;	// disassembly templates, by id
+	extern std::vector<std::string>		strings;	// string operands, by id
+
+	uint16_t	format(const char *F);				// id of template F (registered on first use)
+	uint32_t	string(const char *S);				// id of string S (registered on first use)
+	bool		open(const char *path);				// send the trace to a binary file at path instead of std::cout
+	void		close();					// finish the binary trace
+    };
+};
+
+#endif
@@ -1,582 +1,2319 @@
 #include<pipelined.hh>
+#include<cmath>
+#include<string.h>
+#include<unordered_map>
+#include<sstream>
+#include<fstream>
+#include<mutex>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<fcntl.h>
+#include<unistd.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include<immintrin.h>
+#endif
 
 namespace pipelined
 {
-    bool	tracing = false;
-    bool	operations::operation::first = true;
-    bool	instructions::instruction::first = true;
-
-    const u32	params::MEM::N = 1024*1024;			// 1 MiB of main memory
-    const u32 	params::MEM::latency = 300;
+    namespace trace
+    {
+	per_machine writer		out;
+	std::vector<std::string>	formats;
+	std::vector<std::string>	strings;
+	static std::mutex		registry;				// guards formats and strings, which all machines share
 
-    const u32 	params::L1::latency = 2;
-    const u32	params::L1::nsets = 16;
-    const u32 	params::L1::nways = 4;
-    const u32	params::L1::linesize = 16;
+	uint16_t	format(const char *F)
+	{
+	    std::lock_guard<std::mutex> guard(registry);
+	    for (u32 i=0; i<formats.size(); i++) if (formats[i] == F) return i;
+	    formats.push_back(F);
+	    assert(formats.size() <= 0x10000);
+	    return formats.size() - 1;
+	}
 
-    const u32 	params::L2::latency = 4;
-    const u32	params::L2::nsets = 64;
-    const u32 	params::L2::nways = 4;
-    const u32	params::L2::linesize = 16;
+	uint32_t	string(const char *S)
+	{
+	    std::lock_guard<std::mutex> guard(registry);
+	    static std::unordered_map<std::string, u32> ids;
+	    auto it = ids.find(S);
+	    if (it != ids.end()) return it->second;
+	    strings.push_back(S);
+	    return ids[S] = strings.size() - 1;
+	}
 
-    const u32 	params::L3::latency = 8;
-    const u32	params::L3::nsets = 64;				// Must be same nsets of L2!
-    const u32 	params::L3::nways = 16;				// nways can be larger
-    const u32	params::L3::linesize = 16;
+	std::string	describe(const operands_t &O)
+	{
+	    std::lock_guard<std::mutex> guard(registry);
+	    return text(O, formats, strings);
+	}
 
-    const u32	params::GPR::N = 16;
-    const u32 	params::FPR::N = 8;
-    const u32	params::PRF::N = 64;
-    const u32	params::VRF::N = 128;
-    const u32	params::VR::N = 32;
+	bool	open(const char *path)
+	{
+	    return out.open(path);
+	}
 
-    const u32	params::Backend::maxissue = 1;
-    const u32	params::Frontend::DECODE::latency = 1;
-    const u32	params::Frontend::DISPATCH::latency = 1;
+	void	close()
+	{
+	    out.close();
+	}
 
-    std::vector<u8>		MEM(params::MEM::N);
-    std::vector<reg<u32> >	GPR(params::GPR::N);
-    std::vector<reg<double> >	FPR(params::FPR::N);
-    std::vector<preg<u64> >	PRF::R(params::PRF::N);
-    u32 			PRF::next = 0;
-    std::vector<vreg>		VR(params::VR::N);
-    std::vector<preg<vector> > 	VRF::V(params::VRF::N);
-    u32				VRF::next = 0;
+	bool	writer::open(const char *path)
+	{
+	    close();
+	    _file = fopen(path, "wb");
+	    if (!_file) return false;
+	    _length = 0;
+	    _formats.clear(); _smask.clear(); _strings.clear();
+	    _icount = 0; _ocount = 0; _fetched = 0; _dispatched = 0;
+	    fwrite(magic, 1, sizeof(magic), _file);
+	    return true;
+	}
 
-    units::unit			units::LDU;
-    units::unit			units::STU;
-    units::unit			units::FXU;
-    units::unit			units::FPU;
-    units::unit			units::BRU;
-    units::unit			units::VU;
+	void	writer::flush()
+	{
+	    if (_file && _length) fwrite(_buffer.data(), 1, _length, _file);
+	    _length = 0;
+	}
 
-    std::multiset<u64>		operations::issued;
+	void	writer::close()
+	{
+	    if (!_file) return;
+	    flush();
+	    fclose(_file);
+	    _file = 0;
+	}
 
-    namespace PRF
-    {
-	u32	find_next()
+	void	writer::bytes(const std::string &s)
 	{
-	    return find_earliest();
+	    put((uint64_t)s.size());
+	    for (u32 i=0; i<s.size(); i++) { if (_length + 1 > _buffer.size()) flush(); _buffer[_length++] = s[i]; }
 	}
 
-	u32	find_earliest()
+	void	writer::operands(const operands_t &O)
 	{
-	    u32 idx;
-	    do						// find a first candidate
+	    if (O.format >= _formats.size()) { _formats.resize(O.format + 1, false); _smask.resize(O.format + 1, 0); }
+	    if (!_formats[O.format])						// first use of this template: define it
 	    {
-		PRF::next %= params::PRF::N;
-		idx = PRF::next++;
-	    } while (PRF::R[idx].busy());
-	    for (u32 i=0; i<params::PRF::N; i++)	// look for a possibly better candidate
-		if ((!(PRF::R[i].busy())) && (PRF::R[i].used() < PRF::R[idx].used())) idx = i;
-	    PRF::R[idx].busy() = true;
-	    return idx;
+		std::string F; { std::lock_guard<std::mutex> guard(registry); F = formats[O.format]; }
+		u8 mask = 0; u32 n = 0;
+		for (u32 i=0; i<F.size(); i++)
+		{
+		    if (F[i] == '$') mask |= 1 << n;
+		    if ((F[i] == '$') || (F[i] == '%')) n++;
+		}
+		put((uint64_t)FORMAT); put((uint64_t)O.format); bytes(F);
+		_formats[O.format] = true; _smask[O.format] = mask;
+	    }
+	    for (u32 i=0; i<O.nargs; i++)						// first use of a string operand: define it
+	    {
+		if (!((_smask[O.format] >> i) & 1)) continue;
+		u32 id = O.args[i];
+		if (id >= _strings.size()) _strings.resize(id + 1, false);
+		if (_strings[id]) continue;
+		std::string S; { std::lock_guard<std::mutex> guard(registry); S = strings[id]; }
+		put((uint64_t)STRING); put((uint64_t)id); bytes(S);
+		_strings[id] = true;
+	    }
 	}
 
-	u32	find_first()
+	void	writer::header()
 	{
-	    u32 idx;
-	    do
-	    {
-		PRF::next %= params::PRF::N;
-		idx = PRF::next++;
-	    } while (PRF::R[idx].busy());
-	    PRF::R[idx].busy() = true;
-	    return idx;
+	    put((uint64_t)HEADER);
 	}
-    };
 
-    namespace VRF
-    {
-	u32	find_next()
+	void	writer::instruction(uint64_t count, uint32_t addr, bool hit, const operands_t &O, uint64_t fetched, uint64_t decoded, uint64_t dispatched)
 	{
-	    u32 idx;
-	    do						// find a first candidate
-	    {
-		VRF::next %= params::VRF::N;
-		idx = VRF::next++;
-	    } while (VRF::V[idx].busy());
-	    for (u32 i=0; i<params::VRF::N; i++)	// look for a possibly better candidate
-		if ((!(VRF::V[i].busy())) && (VRF::V[i].used() < VRF::V[idx].used())) idx = i;
-	    VRF::V[idx].busy() = true;
-	    return idx;
+	    operands(O);
+	    put((uint64_t)INSTRUCTION);
+	    put((int64_t)(count - _icount)); _icount = count;
+	    put((uint64_t)addr);
+	    put((uint64_t)hit);
+	    put((uint64_t)O.format); put((uint64_t)O.nargs); for (u32 i=0; i<O.nargs; i++) put(O.args[i]);
+	    put((int64_t)(fetched - _fetched)); _fetched = fetched;
+	    put((int64_t)(decoded - fetched));
+	    put((int64_t)(dispatched - decoded)); _dispatched = dispatched;
 	}
-    };
 
-    namespace caches
-    {
-        cache   L1D(params::L1::nsets, params::L1::nways, params::L1::linesize);
-	cache	L1I(params::L1::nsets, params::L1::nways, params::L1::linesize);
-	cache	L2 (params::L2::nsets, params::L2::nways, params::L2::linesize);
-	cache	L3 (params::L3::nsets, params::L3::nways, params::L3::linesize);
+	void	writer::operation(uint64_t count, const operands_t &O, uint64_t ready, uint64_t issue, uint64_t complete)
+	{
+	    operands(O);
+	    put((uint64_t)OPERATION);
+	    put((int64_t)(count - _ocount)); _ocount = count;
+	    put((uint64_t)O.format); put((uint64_t)O.nargs); for (u32 i=0; i<O.nargs; i++) put(O.args[i]);
+	    put((int64_t)(ready - _dispatched));
+	    put((int64_t)(issue - ready));
+	    put((int64_t)(complete - issue));
+	}
 
-        cache::cache(uint32_t nsets, uint32_t nways, uint32_t linesize) : _sets(nsets)
-        {
-            _nsets = nsets;
-            _nways = nways;
-            _linesize = linesize;
+	static bool	fromenv()							// PIPELINED_TRACE=- traces as text to std::cout, PIPELINED_TRACE=file to a binary file
+	{
+	    const char *path = getenv("PIPELINED_TRACE");
+	    if (!path) return false;
+	    if (std::string(path) != "-") { bool ok = open(path); assert(ok); }
+	    return true;
+	}
+    };
 
-	    accesses = 0;
-	    hits = 0;
-	    misses = 0;
+    bool	tracing = trace::fromenv();
+    per_machine bool	operations::operation::first = true;
+    per_machine bool	instructions::instruction::first = true;
 
-            entry empty(linesize); empty.valid = false; empty.touched = 0; empty.modified = false;
-            set   init(nways); for (uint32_t i=0; i<nways; i++) init[i] = empty;
-            for (uint32_t i=0; i<nsets; i++) _sets[i] = init;
-        }
+    per_machine u32 	params::MEM::latency = 300;
 
-        void cache::clear()
-        {
-	    accesses = 0;
-	    hits = 0;
-	    misses = 0;
+    per_machine u32 	params::L1::latency = 2;
+    per_machine u32	params::L1::nsets = 16;
+    per_machine u32 	params::L1::nways = 4;
+    per_machine u32	params::L1::linesize = 16;
+    per_machine params::replacement_t	params::L1::replacement = params::LRU;
+    per_machine params::prefetcher_t	params::L1::prefetcher = params::NONE;
+    per_machine u32	params::L1::prefetchdegree = 1;
+    per_machine u32	params::L1::prefetchdistance = 1;
+    per_machine u32	params::L1::mshrs = 0;
+    per_machine u32	params::L1::writeback = 0;
 
-            for (uint32_t setix=0; setix<nsets(); setix++)
-                for (uint32_t wayix=0; wayix<nways(); wayix++)
-                {
-                    sets()[setix][wayix].valid = false;
-		    sets()[setix][wayix].modified = false;
-                    sets()[setix][wayix].touched = 0;
-                    sets()[setix][wayix].addr = 0;
-		    sets()[setix][wayix].ready = 0;
-                }
-        }
+    per_machine u32 	params::L2::latency = 4;
+    per_machine u32	params::L2::nsets = 64;
+    per_machine u32 	params::L2::nways = 4;
+    per_machine u32	params::L2::linesize = 16;
+    per_machine params::replacement_t	params::L2::replacement = params::LRU;
+    per_machine params::prefetcher_t	params::L2::prefetcher = params::NONE;
+    per_machine u32	params::L2::prefetchdegree = 1;
+    per_machine u32	params::L2::prefetchdistance = 1;
+    per_machine u32	params::L2::mshrs = 0;
 
-	void cache::flush()
-	{
-            for (uint32_t setix=0; setix<nsets(); setix++)
-	    {
-                for (uint32_t wayix=0; wayix<nways(); wayix++)
-                {
-		    if (sets()[setix][wayix].valid && sets()[setix][wayix].modified)
-		    {
-			u32 addr = sets()[setix][wayix].addr * linesize();
-			for (u32 i=0; i<linesize(); i++) 
-			{
-			    MEM[addr + i] = sets()[setix][wayix].data[i];	// fill the memory starting at addrress EA with the entry
-			}
-		    }
-		}
-	    }
-	}
+    per_machine u32 	params::L3::latency = 8;
+    per_machine u32	params::L3::nsets = 64;				// Must be same nsets of L2!
+    per_machine u32 	params::L3::nways = 16;				// nways can be larger
+    per_machine u32	params::L3::linesize = 16;
+    per_machine params::replacement_t	params::L3::replacement = params::LRU;
+    per_machine u32	params::L3::mshrs = 0;
 
-        uint32_t cache::linesize() const
-        {
-            return _linesize;
-        }
+    const u32	params::GPR::N = 16;
+    const u32 	params::FPR::N = 8;
+    per_machine u32	params::PRF::N = 64;
+    per_machine u32	params::VRF::N = 128;
+    per_machine u32	params::SB::N = 0;
+    per_machine u32	params::SQ::N = 0;
+    per_machine u32	params::SQ::forward = 1;
+    per_machine u32	params::SQ::penalty = 10;
+    per_machine u32	params::SQ::storesets = 64;
+    per_machine params::predictor_t	params::BP::predictor = params::STATIC;
+    per_machine u32	params::BP::entries = 4096;
+    per_machine u32	params::BP::history = 12;
+    per_machine u32	params::BP::btb = 512;
+    per_machine u32	params::BP::penalty = 0;
+    const u32	params::VR::N = 32;
 
-        uint32_t cache::nsets() const
-        {
-            return _nsets;
-        }
+    per_machine u32	params::Backend::maxissue = 1;
+    per_machine u32	params::Frontend::DECODE::latency = 1;
+    per_machine u32	params::Frontend::DISPATCH::latency = 1;
 
-        uint32_t cache::nways() const
-        {
-            return _nways;
-        }
+    per_machine memory			MEM;
+    per_machine std::vector<reg<u32> >	GPR(params::GPR::N);
+    per_machine std::vector<reg<double> >	FPR(params::FPR::N);
+    per_machine std::vector<preg<u64> >	PRF::R(params::PRF::N);
+    per_machine u32 			PRF::next = 0;
+    per_machine std::vector<vreg>		VR(params::VR::N);
+    per_machine std::vector<preg<vector> > 	VRF::V(params::VRF::N);
+    per_machine u32				VRF::next = 0;
 
-        uint32_t cache::capacity() const
-        {
-            return _nsets * _nways * _linesize;
-        }
+    per_machine units::unit			units::LDU;
+    per_machine units::unit			units::STU;
+    per_machine units::unit			units::FXU;
+    per_machine units::unit			units::FPU;
+    per_machine units::unit			units::BRU;
+    per_machine units::unit			units::VU;
 
-        array &cache::sets()
-        {
-            return _sets;
-        }
+    per_machine operations::slots		operations::issued;
+    per_machine operations::storequeue	operations::SQ;
+    per_machine branches::predictor	branches::BP;
 
-	bool 	cache::contains(u32 EA, u32 L, u32 &setix, u32 &wayix)
+    per_machine pool			operations::objects;
+    per_machine pool			instructions::objects;
+    per_machine std::vector<instructions::decoded>	instructions::dcache;
+
+    void* pool::allocate(size_t size)
+    {
+	u32 c = (size + granule - 1) / granule - 1;			// size class of this request
+	assert(c < nclasses);
+	if (!_free[c].empty())						// reuse a released block, if we have one
 	{
-	    u32	lineaddr = EA / linesize();			// compute line address of first byte
-	    assert(lineaddr == ((EA+L-1) / linesize())); 	// assert that last byte is in the same line
-            setix = lineaddr % nsets();				// compute set index from line address
-            for (wayix = 0; wayix < nways(); wayix++)		// look for address in one of the ways of the set
-            {
-                if (sets()[setix][wayix].valid && (sets()[setix][wayix].addr == lineaddr)) break;
-            }
-            return (wayix < nways());
+	    void *p = _free[c].back();
+	    _free[c].pop_back();
+	    return p;
 	}
-
-	bool 	cache::contains(u32 EA, u32 L)
+	u32 bytes = (c + 1) * granule;
+	if (_next + bytes > chunksize)					// current chunk exhausted, move to the next one
 	{
-	    u32 setix; u32 wayix;
-	    return contains(EA, L, setix, wayix);
+	    if (_chunk == _chunks.size()) _chunks.push_back((u8*)malloc(chunksize));
+	    _chunk++;
+	    _next = 0;
 	}
+	void *p = _chunks[_chunk-1] + _next;
+	_next += bytes;
+	return p;
+    }
 
-	bool    cache::contains(u32 EA, u32 L, u64 &ready)
+    void pool::release(void *p, size_t size)
+    {
+	u32 c = (size + granule - 1) / granule - 1;
+	_free[c].push_back(p);
+    }
+
+    void pool::reset()
+    {
+	for (u32 c=0; c<nclasses; c++) _free[c].clear();
+	_chunk = 0;
+	_next = chunksize;
+    }
+
+    namespace units
+    {
+	void unit::retire(u64 cycle)
 	{
-            u32 setix; u32 wayix;
-	    if (contains(EA, L, setix, wayix))
+	    if (cycle <= _base) return;					// already retired
+	    if (cycle - _base >= _window)				// whole window is in the past
 	    {
-	        ready = sets()[setix][wayix].ready;
-	        return true;
+		std::fill(_busy.begin(), _busy.end(), 0);
 	    }
-	    else
+	    else for (u64 c = _base; c < cycle; c++)			// clear the slots of the retired cycles
 	    {
-	        ready = 0;
-	        return false;
+		u64 slot = c & (_window - 1);
+		_busy[slot/64] &= ~((u64)1 << (slot%64));
 	    }
+	    _base = cycle;
 	}
 
-	u32	cache::lineaddr(u32 EA)
+	void unit::grow(u64 cycle)
 	{
-	    return EA - offset(EA);
+	    u64 window = _window;
+	    while (cycle >= _base + window) window *= 2;		// new window must reach cycle
+	    std::vector<u64> busy(window/64, 0);
+	    for (u64 c = _base; c < _base + _window; c++)		// rehash the live reservations
+	    {
+		if (!this->busy(c)) continue;
+		u64 slot = c & (window - 1);
+		busy[slot/64] |= (u64)1 << (slot%64);
+	    }
+	    _busy.swap(busy);
+	    _window = window;
 	}
 
-	u32	cache::offset(u32 EA)
+	void unit::save(checkpoint::writer &W, const std::string &name) const
 	{
-	    return EA % linesize();
+	    u64 window[2] = { _base, _window };
+	    u64 counts[2] = { operations, claims };
+	    W.put(name + ".window", window);
+	    W.put(name + ".counts", counts);
+	    W.put(name + ".busy", _busy);
 	}
 
-	entry*	cache::find(u32 EA, u32 L)
+	void unit::restore(const checkpoint::reader &R, const std::string &name)
 	{
-	    u32 setix; u32 wayix; 
-	    if (contains(EA, L, setix, wayix)) 	return &(sets()[setix][wayix]);
-	    else 				return 0;
+	    u64 window[2], counts[2];
+	    R.get(name + ".window", window);
+	    R.get(name + ".counts", counts);
+	    _base = window[0]; _window = window[1];
+	    operations = counts[0]; claims = counts[1];
+	    R.get(name + ".busy", _busy);
+	    assert(_busy.size() == _window/64);
 	}
+    };
 
-	entry*	cache::evict(u32 EA, u32 L)
+    namespace operations
+    {
+	void slots::retire(u64 cycle)
 	{
-	    u32 offset = EA % linesize(); 				// offset within a line
-	    u32 lineaddr = EA / linesize();				// line address
-            u32 setix = lineaddr % nsets();				// compute set index from line address
-
-	    // We need to find the matching entry
-	    u32 wayix;
-	    for (wayix = 0; wayix < nways(); wayix++)
-		if (sets()[setix][wayix].valid && sets()[setix][wayix].addr == lineaddr) break;
-
-	    // invalidate the entry, if found
-	    if (wayix < nways())
-	    {
-		sets()[setix][wayix].valid = false;			// entry is now invalid
-		sets()[setix][wayix].modified = false;			// fresh entry
-		return &(sets()[setix][wayix]);				// return the cache entry
-	    }
-	    else return 0;
+	    if (cycle <= _base) return;					// already retired
+	    if (cycle - _base >= _window) std::fill(_count.begin(), _count.end(), 0);
+	    else for (u64 c = _base; c < cycle; c++) _count[c & (_window - 1)] = 0;
+	    _base = cycle;
 	}
 
-	entry*	cache::evict(u32 EA, u32 L, std::vector<u8> &M)
+	void slots::grow(u64 cycle)
 	{
-	    u32 offset = EA % linesize(); 				// offset within a line
-	    u32 lineaddr = EA / linesize();				// line address
-            u32 setix = lineaddr % nsets();				// compute set index from line address
-
-	    // We need to find the LRU entry
-	    u64 lasttouch = counters::cycles;
-	    u32 lru = nways();
-	    for (u32 wayix = 0; wayix < nways(); wayix++)
-	    {
-		if (!sets()[setix][wayix].valid)
-		{
-		    // invalid entry, can use this one as the lru
-		    lru = wayix;
-		    break;
-		}
-		if (sets()[setix][wayix].touched <= lasttouch)
-		{
-		    // older than current candidate - update
-		    lru = wayix;
-		    lasttouch = sets()[setix][wayix].touched;
-		}
-	    }
-	    assert(lru < nways());
-	    if (sets()[setix][lru].valid && sets()[setix][lru].modified)
-	    {
-		u32 addr = sets()[setix][lru].addr * linesize();
-		for (u32 i=0; i<linesize(); i++) 
-		    M[addr + i] = sets()[setix][lru].data[i];			// fill memory from the cache entry
-	    }
-	    sets()[setix][lru].valid = false;					// entry is now invalid
-	    sets()[setix][lru].modified = false;				// fresh entry
-	    return &(sets()[setix][lru]);					// return the cache entry
+	    u64 window = _window;
+	    while (cycle >= _base + window) window *= 2;		// new window must reach cycle
+	    std::vector<u8> count(window, 0);
+	    for (u64 c = _base; c < _base + _window; c++) count[c & (window - 1)] = _count[c & (_window - 1)];
+	    _count.swap(count);
+	    _window = window;
 	}
 
-	entry*	cache::evict(u32 EA, u32 L, caches::entry &E)
+	void slots::save(checkpoint::writer &W, const std::string &name) const
 	{
-	    assert(!E.valid);						// target cache entry should be invalid
-	    u32 offset = EA % linesize(); 				// offset within a line
-	    u32 lineaddr = EA / linesize();				// line address
-            u32 setix = lineaddr % nsets();				// compute set index from line address
-
-	    // We need to find the LRU entry
-	    u64 lasttouch = counters::cycles;
-	    u32 lru = nways();
-	    for (u32 wayix = 0; wayix < nways(); wayix++)
-	    {
-		if (!sets()[setix][wayix].valid)
-		{
-		    // invalid entry, can use this one as the lru
-		    lru = wayix;
-		    break;
-		}
-		if (sets()[setix][wayix].touched <= lasttouch)
-		{
-		    // older than current candidate - update
-		    lru = wayix;
-		    lasttouch = sets()[setix][wayix].touched;
-		}
-	    }
-	    assert(lru < nways());
-	    if (sets()[setix][lru].valid)
-	    {
-		u32 addr = sets()[setix][lru].addr * linesize();
-		for (u32 i=0; i<linesize(); i++) 
-		    E.data[i] = sets()[setix][lru].data[i];		// fill the target cache entry from this entry
-		E.valid = sets()[setix][lru].valid;
-		E.modified = sets()[setix][lru].modified;
-		E.addr = sets()[setix][lru].addr;
-		E.touched = sets()[setix][lru].touched;
-	    }
-	    sets()[setix][lru].valid = false;				// entry is now invalid
-	    sets()[setix][lru].modified = false;			// fresh entry
-	    return &(sets()[setix][lru]);				// return the cache entry
+	    u64 window[2] = { _base, _window };
+	    W.put(name + ".window", window);
+	    W.put(name + ".count", _count);
 	}
 
-	u8*	cache::fill(u32 EA, u32 L, std::vector<u8> &M)
+	void slots::restore(const checkpoint::reader &R, const std::string &name)
 	{
-	    u32 setix; u32 wayix; u32 offset = EA % linesize(); u32 lineaddr = EA / linesize();
-	    if (contains(EA, L, setix, wayix))
-	    {
-		// This is a hit! just return the contents at the offset
-		return sets()[setix][wayix].data.data() + offset;
-	    }
-	    else
-	    {
-	    	// This is a miss! We need to allocate an entry and bring data from memory
-                // find the LRU entry
-                u64 lasttouch = counters::cycles;
-                u32 lru = nways();
-                for (wayix = 0; wayix < nways(); wayix++)
-                {
-                    if (!sets()[setix][wayix].valid)
-                    {
-                        // invalid entry, can use this one as the lru
-                        lru = wayix;
-                        break;
-                    }
-                    if (sets()[setix][wayix].touched <= lasttouch)
-                    {
-                        // older than current candidate - update
-                        lru = wayix;
-                        lasttouch = sets()[setix][wayix].touched;
-                    }
-                }
-                assert(lru < nways());
-                sets()[setix][lru].valid = true;					// entry is now valid
-                sets()[setix][lru].modified = false;					// fresh entry
-                sets()[setix][lru].addr = lineaddr;					// it has this line address
-                sets()[setix][lru].touched = counters::cycles;				// it was just touched
-		for (u32 i=0; i<linesize(); i++) 
-		    sets()[setix][lru].data[i] = M[lineaddr * linesize() + i];		// fill the entry with L bytes from memory, starting at addrress EA
-		sets()[setix][lru].ready = counters::cycles;                            // cycle when data will be ready in cache entry
-		return sets()[setix][lru].data.data() + offset;				// return the contents
-	    }
-	}
-
-	u8*	cache::fill(u32 EA, u32 L, caches::entry &E)
-	{
-	    u32 setix; u32 wayix; u32 offset = EA % linesize(); u32 lineaddr = EA / linesize();
-	    if (contains(EA, L, setix, wayix))
-	    {
-		// This is a hit! just return the contents at the offset
-		return sets()[setix][wayix].data.data() + offset;
-	    }
-	    else
-	    {
-	    	// This is a miss! We need to allocate an entry and bring data from memory
-                // find the LRU entry
-                u64 lasttouch = counters::cycles;
-                u32 lru = nways();
-                for (wayix = 0; wayix < nways(); wayix++)
-                {
-                    if (!sets()[setix][wayix].valid)
-                    {
-                        // invalid entry, can use this one as the lru
-                        lru = wayix;
-                        break;
-                    }
-                    if (sets()[setix][wayix].touched <= lasttouch)
-                    {
-                        // older than current candidate - update
-                        lru = wayix;
-                        lasttouch = sets()[setix][wayix].touched;
-                    }
-                }
-                assert(lru < nways());
-                sets()[setix][lru].valid = true;					// entry is now valid
-                sets()[setix][lru].modified = E.modified;				// entry has the modified status of the source cache entry
-                sets()[setix][lru].addr = lineaddr;					// it has this line address
-                sets()[setix][lru].touched = counters::cycles;				// it was just touched
-		assert(linesize() == E.data.size());					// check that linesizes are the same
-		for (u32 i=0; i<linesize(); i++) 
-		    sets()[setix][lru].data[i] = E.data[i];				// fill this entry with L bytes from the source cache entry
-		sets()[setix][lru].ready = counters::cycles;                            // cycle when data will be ready in cache entry
-		return sets()[setix][lru].data.data() + offset;				// return the contents
-	    }
+	    u64 window[2];
+	    R.get(name + ".window", window);
+	    _base = window[0]; _window = window[1];
+	    R.get(name + ".count", _count);
+	    assert(_count.size() == _window);
+#ifdef CHECK_ISSUED
+	    _check.clear();
+	    for (u64 c = _base; c < _base + _window; c++) for (u32 n=0; n<_count[c & (_window - 1)]; n++) _check.insert(c);
+#endif
 	}
 
-	void 	cache::hit(u32 EA, u32 L)
+	void	storequeue::configure(u32 n, u32 storesets)
 	{
-	    hits++;
-	    u32 setix; u32 wayix;
-	    if (contains(EA, L, setix, wayix))
-	    {
-		sets()[setix][wayix].touched = counters::cycles;
-	    }
+	    _stores.resize(n);
+	    _ssit.resize(storesets);
+	    _lfst.resize(storesets);
+	    clear();
 	}
 
-	void	cache::miss(u32 EA, u32 L)
+	void	storequeue::clear()
 	{
-	    misses++;
+	    store_t S = { 0, 0, 0, 0, 0 };
+	    std::fill(_stores.begin(), _stores.end(), S);
+	    std::fill(_lfst.begin(), _lfst.end(), S);
+	    std::fill(_ssit.begin(), _ssit.end(), 0);
+	    _next = 0;
+	    stores = 0;
+	    stalls = 0;
+	    forwarded = 0;
+	    violations = 0;
+	    waits = 0;
+	    falsedeps = 0;
 	}
 
-	void 	cache::access(u32 EA, u32 L)
+	u64	storequeue::ready(u64 cycle)
 	{
-	    accesses++;
+	    u64 free = _stores[_next].written;
+	    if (free <= cycle) return cycle;
+	    stalls++;
+	    return free;
 	}
-    };
 
-    u8*	pipelined::operations::load
-    (
-	u32	EA,
-	u32 	L
-    )
-    {
-	caches::L1D.access(EA, L);
-	if (caches::L1D.contains(EA, L))
+	void	storequeue::insert(u32 pc, u32 EA, u32 L, u64 issued, u64 written)
 	{
-	    // this is an L1 hit
-	    caches::L1D.hit(EA, L);
-	    assert(caches::L2.contains(EA, L));
+	    assert(active());
+	    stores++;
+	    store_t S = { pc, EA, L, issued, written };
+	    _stores[_next] = S;
+	    _next = (_next + 1) % _stores.size();
+	    u32 set = _ssit.empty() ? 0 : _ssit[index(pc)];
+	    if (set) _lfst[set-1] = S;
 	}
-	else
+
+	void	storequeue::train(u32 load, u32 store)
 	{
-	    // this is an L1 miss
-	    caches::L1D.miss(EA, L);
+	    if (_ssit.empty()) return;
+	    u32 &l = _ssit[index(load)], &s = _ssit[index(store)];
+	    if (!l && !s) l = s = index(load) + 1;				// a new set
+	    else if (!l) l = s;
+	    else if (!s) s = l;
+	    else l = s = std::min(l, s);					// the two sets become one
+	}
 
-	    // Let us try the L2
-	    caches::L2.access(EA, L);
-	    if (caches::L2.contains(EA, L))
+	u64	storequeue::load(u32 pc, u32 EA, u32 L, u64 cycle, bool &forward)
+	{
+	    forward = false;
+	    u64 ready = 0;
+	    u32 set = _ssit.empty() ? 0 : _ssit[index(pc)];
+	    if (set && (_lfst[set-1].issued > cycle)) { ready = _lfst[set-1].issued; waits++; }	// predicted to depend on the last store of its set
+	    const store_t *S = 0;
+	    for (u32 n=1; (n<=_stores.size()) && !S; n++)			// the youngest store that writes any of its bytes
 	    {
-		// this is an L2 hit
-		caches::L2.hit(EA, L);
+		const store_t &T = _stores[(_next + _stores.size() - n) % _stores.size()];
+		if ((T.EA < EA + L) && (EA < T.EA + T.L)) S = &T;
 	    }
-	    else
+	    if (!S || (S->written <= cycle))					// its data are in L1D
 	    {
-		// this is an L2 miss
-		caches::L2.miss(EA, L);
+		if (ready) falsedeps++;
+		return ready;
+	    }
+	    if (ready > S->issued) falsedeps++;					// held back longer than the store it depends on
+	    if (S->issued > max(cycle, ready))					// it went ahead of the store, and is replayed once the store issues
+	    {
+		violations++;
+		train(pc, S->pc);
+		ready = S->issued + params::SQ::penalty;
+	    }
+	    ready = max(ready, S->issued);
+	    if ((S->EA <= EA) && (EA + L <= S->EA + S->L)) { forward = true; forwarded++; }
+	    else ready = max(ready, S->written);				// the store has only some of the bytes: read L1D once it has them
+	    return ready;
+	}
 
-		// let us free up space in L3 before we evict L2
-		caches::entry *empty = caches::L3.evict(EA, L, MEM);					// evict a line from L3 to memory
-		caches::L2.evict(EA, L, *empty);							// evict a line from L2 to L3 (nsets must be the same!)
-		if (empty->valid) caches::L1D.evict((empty->addr) * (caches::L3.linesize()), L);	// if a valid entry was evicted from L2, must be evicted from L1
+	void	storequeue::save(checkpoint::writer &W, const std::string &name) const
+	{
+	    u64 stats[6] = { stores, stalls, forwarded, violations, waits, falsedeps };
+	    W.put(name + ".stats", stats);
+	    W.put(name + ".next", _next);
+	    W.put(name + ".stores", _stores);
+	    W.put(name + ".ssit", _ssit);
+	    W.put(name + ".lfst", _lfst);
+	}
 
-		// Now, let us see if we find the data in L3
-		caches::L3.access(EA, L);
-		if (caches::L3.contains(EA, L))
-		{
-		    // This is an L3 hit
-		    caches::L3.hit(EA, L);
-		    caches::L2.fill(EA, L, *(caches::L3.find(EA, L)));
-		    caches::L3.find(EA, L)->valid = false;
-		}
-		else
-		{
-		    // This is an L3 miss
-		    caches::L3.miss(EA, L);
-		    caches::L2.fill(EA, L, MEM);
-		}
-	    }
-	    caches::L1D.fill(EA, L, *(caches::L2.find(EA, L)));
-	    assert(caches::L2.contains(EA, L));
+	void	storequeue::restore(const checkpoint::reader &R, const std::string &name)
+	{
+	    u64 size[2] = { _stores.size(), _ssit.size() };
+	    u64 stats[6];
+	    R.get(name + ".stats", stats);
+	    stores = stats[0]; stalls = stats[1]; forwarded = stats[2]; violations = stats[3]; waits = stats[4]; falsedeps = stats[5];
+	    R.get(name + ".next", _next);
+	    R.get(name + ".stores", _stores);
+	    R.get(name + ".ssit", _ssit);
+	    R.get(name + ".lfst", _lfst);
+	    assert((_stores.size() == size[0]) && (_ssit.size() == size[1]) && (_lfst.size() == size[1]));	// restored with the parameters
 	}
-	assert(caches::L1D.contains(EA, L));
-	assert(caches:: L2.contains(EA, L));
-	return caches::L1D.find(EA, L)->data.data() + caches::L1D.offset(EA);
-    }
+    };
 
-    void pipelined::caches::entry::store(u32 EA, double D)
+    template<typename T> void freelist<T>::push(u64 used, u32 idx)
     {
-	u32 offset = EA % data.size();
-	*((double*)(data.data() + offset)) = D;
-	modified = true;
+	_heap.push_back(std::make_pair(used, idx));
+	std::push_heap(_heap.begin(), _heap.end(), std::greater<std::pair<u64,u32> >());
     }
 
-    void pipelined::caches::entry::store(u32 EA, u8 B)
+    template<typename T> void freelist<T>::reset(const std::vector<preg<T> > &R)
     {
-	u32 offset = EA % data.size();
-	*((u8*)(data.data() + offset)) = B;
-	modified = true;
+	_free.assign((R.size() + 63)/64, 0);
+	_heap.clear();
+	for (u32 i=0; i<R.size(); i++)
+	{
+	    if (R[i].busy()) continue;
+	    _free[i/64] |= (u64)1 << (i%64);
+	    _heap.push_back(std::make_pair(R[i].used(), i));
+	}
+	std::make_heap(_heap.begin(), _heap.end(), std::greater<std::pair<u64,u32> >());
     }
 
-    void pipelined::caches::entry::store(u32 EA, const pipelined::vector &V)
+    template<typename T> void freelist<T>::release(std::vector<preg<T> > &R, u32 idx)
     {
-	u32 offset = EA % data.size();
-	assert(offset == 0);
-	assert(sizeof(V) == data.size());
-	*((vector*)(data.data() + offset)) = V;
-	modified = true;
+	R[idx].busy() = false;
+	if (_free.size()*64 < R.size()) { reset(R); return; }		// first use, before any zeroctrs()
+	_free[idx/64] |= (u64)1 << (idx%64);
+	push(R[idx].used(), idx);
+	if (_heap.size() > 4*R.size()) reset(R);			// too many stale entries, rebuild
     }
 
-    void pipelined::caches::entry::store(u32 EA, const u8 (&V)[16])
+    template<typename T> void freelist<T>::take(std::vector<preg<T> > &R, u32 idx)
     {
-	u32 offset = EA % data.size();
-	assert(offset == 0);
-	assert(sizeof(V) == data.size());
-	u8 *buff = (u8*)(data.data() + offset);
-	for (u32 i=0; i<16; i++) *((u8*)buff + i) = V[i];
-	modified = true;
+	R[idx].busy() = true;
+	_free[idx/64] &= ~((u64)1 << (idx%64));				// its heap entries are now stale
     }
 
-    void pipelined::caches::entry::store(u32 EA, const u8 (&V)[16], const u8 (&M)[16])
+    template<typename T> u32 freelist<T>::first(const std::vector<preg<T> > &R, u32 next)
     {
-	u32 offset = EA % data.size();
-	assert(offset == 0);
-	assert(sizeof(V) == data.size());
-	u8 *buff = (u8*)(data.data() + offset);
-	for (u32 i=0; i<16; i++) if (M[i]) *((u8*)buff + i) = V[i];
-	modified = true;
+	u32 N = R.size();
+	for (u32 n=0; n<2; n++)						// [next, N) then [0, next)
+	{
+	    u32 lo = n ? 0 : next;
+	    u32 hi = n ? next : N;
+	    for (u32 w = lo/64; w*64 < hi; w++)
+	    {
+		u64 bits = _free[w];
+		if (w == lo/64) bits &= ~(u64)0 << (lo%64);		// ignore registers before lo
+		if (bits == 0) continue;
+		u32 idx = w*64 + __builtin_ctzll(bits);
+		if (idx < hi) return idx;
+		break;
+	    }
+	}
+	return N;
     }
 
-    void pipelined::caches::entry::store(u32 EA, const float (&V)[4], const u32 (&M)[4])
+    template<typename T> u32 freelist<T>::earliest(std::vector<preg<T> > &R, u32 &next)
     {
-	u32 offset = EA % data.size();
-	assert(offset == 0);
-	assert(sizeof(V) == data.size());
-	float *buff = (float*)(data.data() + offset);
-	for (u32 i=0; i<4; i++) if (M[i]) *((float*)buff + i) = V[i];
-	modified = true;
+	u32 N = R.size();
+	if (_free.size()*64 < N) reset(R);				// first use, before any zeroctrs()
+	u32 idx = first(R, next % N);					// the round-robin candidate
+	if (idx == N) return N;						// nothing free
+	next = idx + 1;
+	while (true)							// find the free register with the earliest used()
+	{
+	    u64 used = _heap.front().first;
+	    u32 top  = _heap.front().second;
+	    bool free = (_free[top/64] >> (top%64)) & 1;
+	    if (free && (used == R[top].used())) break;			// a valid entry
+	    std::pop_heap(_heap.begin(), _heap.end(), std::greater<std::pair<u64,u32> >());
+	    _heap.pop_back();
+	    if (free) push(R[top].used(), top);				// used() moved on since it was freed
+	}
+	if (R[idx].used() > _heap.front().first) idx = _heap.front().second;	// candidate is not the earliest
+	take(R, idx);
+	return idx;
     }
 
-    flags_t     flags;                          // flags
-
-    uint32_t    CIA;                            // current instruction address
-    uint32_t    NIA;                            // next instruction address
+    template class freelist<u64>;
+    template class freelist<vector>;
 
-    uint64_t    counters::instructions = 0;     // instruction counter
-    uint64_t    counters::operations = 0;       // operation counter
-    uint64_t    counters::cycles = 0;           // cycle counter
-    uint64_t    counters::lastissued = 0;       // last issue cycle
-    uint64_t    counters::lastcompleted = 0;    // last complete cycle
-    uint64_t    counters::lastfetched = 0;      // last fetch complete cycle
-    uint64_t    counters::lastfetch = 0;        // last fetch start cycle
+    per_machine freelist<u64>	PRF::free;
+    per_machine u64			PRF::stalls = 0;
+    per_machine freelist<vector>	VRF::free;
+    per_machine u64			VRF::stalls = 0;
 
-    void zeromem()
+    namespace PRF
     {
-        for (uint32_t i=0; i<params::MEM::N; i++) MEM[i] = 0;
-    }
+	u32	find_next(u64 cycle)
+	{
+	    u32 idx = PRF::free.earliest(PRF::R, PRF::next);
+	    assert(idx < params::PRF::N);				// the target was released just before, so there is always one
+	    if (PRF::R[idx].used() > cycle) PRF::stalls++;		// the rename waits for it
+	    return idx;
+	}
 
-    void zeroctrs()
-    {
-    	operations::operation::zero();;
-    	instructions::instruction::zero();
+	void	release(u32 idx)
+	{
+	    PRF::free.release(PRF::R, idx);
+	}
+    };
+
+    namespace VRF
+    {
+	u32	find_next(u64 cycle)
+	{
+	    u32 idx = VRF::free.earliest(VRF::V, VRF::next);
+	    assert(idx < params::VRF::N);
+	    if (VRF::V[idx].used() > cycle) VRF::stalls++;
+	    return idx;
+	}
+
+	void	release(u32 idx)
+	{
+	    VRF::free.release(VRF::V, idx);
+	}
+    };
+
+    namespace caches
+    {
+        per_machine cache   L1D(params::L1::nsets, params::L1::nways, params::L1::linesize, params::L1::replacement);
+	per_machine cache	L1I(params::L1::nsets, params::L1::nways, params::L1::linesize, params::L1::replacement);
+	per_machine cache	L2 (params::L2::nsets, params::L2::nways, params::L2::linesize, params::L2::replacement);
+	per_machine cache	L3 (params::L3::nsets, params::L3::nways, params::L3::linesize, params::L3::replacement);
+	per_machine storebuffer	SB;
+
+	const u32 cache::invalid;
+	const u32 cache::simd;
+	const u8  rrip::distant;
+
+	u32	policy::random()
+	{
+	    _seed ^= _seed << 13; _seed ^= _seed >> 17; _seed ^= _seed << 5;
+	    return _seed;
+	}
+
+	policy*	policy::create(params::replacement_t kind, u32 nsets, u32 nways, const std::vector<u64> &touched, u32 stride)
+	{
+	    switch (kind)
+	    {
+		case params::LRU:	return new lru(nsets, nways, touched, stride);
+		case params::PLRU:	return new plru(nsets, nways);
+		case params::SRRIP:	return new rrip(nsets, nways, false);
+		case params::BRRIP:	return new rrip(nsets, nways, true);
+		case params::RANDOM:	return new randomized(nsets, nways);
+		default:		assert(false); return 0;
+	    }
+	}
+
+	u32	lru::victim(u32 setix)
+	{
+	    u64 lasttouch = counters::cycles;
+	    u32 lru = _nways;
+	    for (u32 wayix = 0; wayix < _nways; wayix++)
+	    {
+		if (_touched[setix*_stride + wayix] <= lasttouch)
+		{
+		    // older than current candidate - update
+		    lru = wayix;
+		    lasttouch = _touched[setix*_stride + wayix];
+		}
+	    }
+	    assert(lru < _nways);
+	    return lru;
+	}
+
+	plru::plru(u32 nsets, u32 nways) : policy(nsets, nways), _tree(nsets)
+	{
+	    assert(nways <= 64);					// nways-1 nodes must fit in bits 1..63
+	    assert((nways & (nways - 1)) == 0);				// the tree needs a power of two ways
+	}
+
+	void	plru::clear()
+	{
+	    policy::clear();
+	    std::fill(_tree.begin(), _tree.end(), 0);
+	}
+
+	void	plru::touch(u32 setix, u32 wayix)
+	{
+	    // point every node on the path to wayix away from it
+	    u32 node = 1; u32 lo = 0;
+	    for (u32 size = _nways/2; size > 0; size /= 2)
+	    {
+		if (wayix < lo + size)	{ _tree[setix] |=  ((u64)1 << node); node = 2*node; }		// went left, victim is to the right
+		else			{ _tree[setix] &= ~((u64)1 << node); node = 2*node + 1; lo += size; }	// went right, victim is to the left
+	    }
+	}
+
+	u32	plru::victim(u32 setix)
+	{
+	    // follow the nodes to the pseudo least-recently used way
+	    u32 node = 1; u32 lo = 0;
+	    for (u32 size = _nways/2; size > 0; size /= 2)
+	    {
+		if ((_tree[setix] >> node) & 1)	{ node = 2*node + 1; lo += size; }
+		else				{ node = 2*node; }
+	    }
+	    return lo;
+	}
+
+	rrip::rrip(u32 nsets, u32 nways, bool bimodal) : policy(nsets, nways), _rrpv(nsets*nways)
+	{
+	    _bimodal = bimodal;
+	    clear();
+	}
+
+	void	rrip::clear()
+	{
+	    policy::clear();
+	    std::fill(_rrpv.begin(), _rrpv.end(), distant);
+	}
+
+	void	rrip::insert(u32 setix, u32 wayix)
+	{
+	    if (_bimodal && (random() % 32)) _rrpv[setix*_nways + wayix] = distant;	// most lines are predicted not to be reused
+	    else			     _rrpv[setix*_nways + wayix] = distant - 1;	// a long re-reference interval
+	}
+
+	u32	rrip::victim(u32 setix)
+	{
+	    u8 *rrpv = &_rrpv[setix*_nways];
+	    while (true)
+	    {
+		for (u32 wayix = 0; wayix < _nways; wayix++)
+		    if (rrpv[wayix] == distant) return wayix;		// first line predicted to be re-referenced last
+		for (u32 wayix = 0; wayix < _nways; wayix++) rrpv[wayix]++;	// age the whole set and try again
+	    }
+	}
+
+	void	prefetcher::configure(params::prefetcher_t kind, u32 degree, u32 distance)
+	{
+	    _kind = kind;
+	    _degree = degree;
+	    _distance = distance;
+	    clear();
+	}
+
+	void	prefetcher::clear()
+	{
+	    stride_t S = { 0, 0, 0, 0 };
+	    stream_t T = { 0, 0, 0, 0 };
+	    _strides.assign(nstrides, S);
+	    _streams.assign(nstreams, T);
+	    _clock = 0;
+	    _requests.clear();
+	    issued = 0;
+	    useful = 0;
+	    late = 0;
+	    useless = 0;
+	}
+
+	void	prefetcher::request(u32 line, u32 demand, u64 cycle)
+	{
+	    if (line == demand) return;
+	    for (u32 i=0; i<_requests.size(); i++) if (_requests[i].line == line) return;
+	    request_t R = { line, cycle };
+	    _requests.push_back(R);
+	}
+
+	void	prefetcher::train(u32 pc, u32 EA, u32 linesize, bool miss, bool first, u64 cycle)
+	{
+	    u32 line = EA / linesize;
+	    switch (_kind)
+	    {
+		case params::NEXTLINE:					// the lines after a miss (or after a prefetched line, once used)
+		{
+		    if (!miss && !first) return;
+		    for (u32 k=0; k<_degree; k++) request(line + _distance + k, line, cycle);
+		    return;
+		}
+		case params::STRIDE:					// each instruction repeats its stride: ask for the addresses it will access next
+		{
+		    stride_t &S = _strides[(pc / 4) % nstrides];
+		    if (S.pc != pc) { S.pc = pc; S.last = EA; S.stride = 0; S.confidence = 0; return; }
+		    i32 stride = (i32)(EA - S.last);
+		    S.last = EA;
+		    if ((stride == S.stride) && stride) { if (S.confidence < 3) S.confidence++; }
+		    else if (S.confidence) S.confidence--;
+		    else S.stride = stride;
+		    if (S.confidence < 2) return;
+		    i64 step = ((u32)abs(S.stride) < linesize) ? (S.stride > 0 ? linesize : -(i64)linesize) : S.stride;	// at least a line at a time
+		    for (u32 k=0; k<_degree; k++) request((u32)(EA + step * (_distance + k)) / linesize, line, cycle);
+		    return;
+		}
+		case params::STREAM:					// misses to consecutive lines: run ahead of the stream
+		{
+		    if (!miss && !first) return;
+		    _clock++;
+		    u32 s = nstreams;
+		    for (u32 i=0; i<nstreams; i++)
+		    {
+			stream_t &T = _streams[i];
+			if (!T.touched) continue;
+			i32 delta = (i32)(line - T.last);
+			bool ahead = T.direction ? (delta * T.direction > 0) : (delta != 0);	// in its direction, once known
+			if (ahead && ((u32)abs(delta) <= window + _distance + _degree)) { s = i; break; }
+		    }
+		    if (s == nstreams)					// a new stream, in place of the least recently used one
+		    {
+			s = 0;
+			for (u32 i=1; i<nstreams; i++) if (_streams[i].touched < _streams[s].touched) s = i;
+			stream_t T = { line, 0, 0, _clock };
+			_streams[s] = T;
+			return;
+		    }
+		    stream_t &T = _streams[s];
+		    if (!T.direction) T.direction = (line > T.last) ? 1 : -1;
+		    if (T.confidence < 3) T.confidence++;
+		    T.last = line;
+		    T.touched = _clock;
+		    if (T.confidence < 2) return;
+		    for (u32 k=0; k<_degree; k++) request(line + T.direction * (i32)(_distance + k), line, cycle);
+		    return;
+		}
+		default:
+		    return;
+	    }
+	}
+
+	void	prefetcher::save(checkpoint::writer &W, const std::string &name) const
+	{
+	    u64 stats[5] = { issued, useful, late, useless, _clock };
+	    W.put(name + ".stats", stats);
+	    W.put(name + ".strides", _strides);
+	    W.put(name + ".streams", _streams);
+	    W.put(name + ".requests", _requests);
+	}
+
+	void	prefetcher::restore(const checkpoint::reader &R, const std::string &name)
+	{
+	    u64 stats[5];
+	    R.get(name + ".stats", stats);
+	    issued = stats[0]; useful = stats[1]; late = stats[2]; useless = stats[3]; _clock = stats[4];
+	    R.get(name + ".strides", _strides);
+	    R.get(name + ".streams", _streams);
+	    R.get(name + ".requests", _requests);
+	    assert((_strides.size() == nstrides) && (_streams.size() == nstreams));
+	}
+
+	void	mshrs::configure(u32 n)
+	{
+	    _misses.resize(n);
+	    clear();
+	}
+
+	void	mshrs::clear()
+	{
+	    miss_t M = { 0, 0 };
+	    std::fill(_misses.begin(), _misses.end(), M);
+	    allocated = 0;
+	    merged = 0;
+	    stalls = 0;
+	    stalled = 0;
+	}
+
+	u64	mshrs::free() const
+	{
+	    u64 cycle = ~(u64)0;
+	    for (u32 i=0; i<_misses.size(); i++) cycle = std::min(cycle, _misses[i].ready);
+	    return _misses.empty() ? 0 : cycle;
+	}
+
+	u64	mshrs::pending(u32 line) const
+	{
+	    u64 cycle = 0;
+	    for (u32 i=0; i<_misses.size(); i++) if (_misses[i].ready && (_misses[i].line == line)) cycle = std::max(cycle, _misses[i].ready);
+	    return cycle;
+	}
+
+	void	mshrs::allocate(u32 line, u64 ready)
+	{
+	    assert(active());
+	    u32 r = 0;
+	    for (u32 i=1; i<_misses.size(); i++) if (_misses[i].ready < _misses[r].ready) r = i;
+	    _misses[r].line = line;
+	    _misses[r].ready = ready;
+	    allocated++;
+	}
+
+	void	mshrs::save(checkpoint::writer &W, const std::string &name) const
+	{
+	    u64 stats[4] = { allocated, merged, stalls, stalled };
+	    W.put(name + ".stats", stats);
+	    W.put(name + ".misses", _misses);
+	}
+
+	void	mshrs::restore(const checkpoint::reader &R, const std::string &name)
+	{
+	    u64 size = _misses.size();
+	    u64 stats[4];
+	    R.get(name + ".stats", stats);
+	    allocated = stats[0]; merged = stats[1]; stalls = stats[2]; stalled = stats[3];
+	    R.get(name + ".misses", _misses);
+	    assert(_misses.size() == size);						// restored with the parameters
+	}
+
+	void	storebuffer::configure(u32 n)
+	{
+	    _slots.resize(n);
+	    clear();
+	}
+
+	void	storebuffer::clear()
+	{
+	    slot_t S = { 0, 0 };
+	    std::fill(_slots.begin(), _slots.end(), S);
+	    stores = 0;
+	    coalesced = 0;
+	    drains = 0;
+	    stalls = 0;
+	    stalled = 0;
+	}
+
+	u64	storebuffer::pending(u32 line, u64 cycle) const
+	{
+	    u64 drained = 0;
+	    for (u32 i=0; i<_slots.size(); i++) if ((_slots[i].drained > cycle) && (_slots[i].line == line)) drained = std::max(drained, _slots[i].drained);
+	    return drained;
+	}
+
+	u64	storebuffer::ready(u32 line, u64 cycle) const
+	{
+	    if (pending(line, cycle)) return cycle;
+	    u64 free = ~(u64)0;
+	    for (u32 i=0; i<_slots.size(); i++) free = std::min(free, _slots[i].drained);
+	    return std::max(cycle, free);
+	}
+
+	u64	storebuffer::insert(u32 line, u64 cycle, u64 written)
+	{
+	    assert(active());
+	    stores++;
+	    u64 drained = pending(line, cycle);
+	    if (drained) { coalesced++; return drained; }			// written with the stores already there
+	    u32 e = 0;
+	    for (u32 i=1; i<_slots.size(); i++) if (_slots[i].drained < _slots[e].drained) e = i;
+	    _slots[e].line = line;
+	    _slots[e].drained = written;
+	    drains++;
+	    return written;
+	}
+
+	void	storebuffer::save(checkpoint::writer &W, const std::string &name) const
+	{
+	    u64 stats[5] = { stores, coalesced, drains, stalls, stalled };
+	    W.put(name + ".stats", stats);
+	    W.put(name + ".slots", _slots);
+	}
+
+	void	storebuffer::restore(const checkpoint::reader &R, const std::string &name)
+	{
+	    u64 size = _slots.size();
+	    u64 stats[5];
+	    R.get(name + ".stats", stats);
+	    stores = stats[0]; coalesced = stats[1]; drains = stats[2]; stalls = stats[3]; stalled = stats[4];
+	    R.get(name + ".slots", _slots);
+	    assert(_slots.size() == size);						// restored with the parameters
+	}
+
+        cache::cache(uint32_t nsets, uint32_t nways, uint32_t linesize, params::replacement_t replacement)
+        {
+	    _policy = 0;
+	    _replacement = replacement;
+	    _writeback = false;
+	    configure(nsets, nways, linesize);
+        }
+
+	void	cache::configure(u32 nsets, u32 nways, u32 linesize)
+	{
+            _nsets = nsets;
+            _nways = nways;
+            _linesize = linesize;
+	    _stride = ((nways + simd - 1) / simd) * simd;
+	    assert(nsets > 0); assert(nways > 0);
+	    assert(linesize > 1);					// so that no line address can be the invalid tag
+
+	    _tags.resize(nsets * _stride);
+	    _modified.resize(nsets * _stride);
+	    _touched.resize(nsets * _stride);
+	    _ready.resize(nsets * _stride);
+	    _prefetched.resize(nsets * _stride);
+	    _data.resize((u64)nsets * _stride * linesize);
+	    replacement(_replacement);					// the policy state depends on the geometry
+
+	    clear();
+	}
+
+	cache::~cache()
+	{
+	    delete _policy;
+	}
+
+	params::replacement_t	cache::replacement() const
+	{
+	    return _replacement;
+	}
+
+	void	cache::replacement(params::replacement_t kind)
+	{
+	    delete _policy;							// (0 when called from the constructor)
+	    _replacement = kind;
+	    _policy = policy::create(kind, nsets(), nways(), _touched, _stride);
+	    _policy->clear();
+	}
+
+        void cache::clear()
+        {
+	    accesses = 0;
+	    hits = 0;
+	    misses = 0;
+	    writes = 0;
+
+	    invalidate();
+	    prefetch.clear();
+	    mshr.clear();
+        }
+
+	void cache::invalidate()
+	{
+	    std::fill(_tags.begin(), _tags.end(), invalid);
+	    std::fill(_modified.begin(), _modified.end(), 0);
+	    std::fill(_touched.begin(), _touched.end(), 0);
+	    std::fill(_ready.begin(), _ready.end(), 0);
+	    std::fill(_prefetched.begin(), _prefetched.end(), 0);
+	    _policy->clear();
+	}
+
+	void cache::sync(const memory &M)
+	{
+	    for (u32 ix=0; ix<_tags.size(); ix++)
+	    {
+		if (_tags[ix] == invalid) continue;
+		u64 addr = (u64)_tags[ix] * linesize();
+		std::copy(&M[addr], &M[addr] + linesize(), &_data[(u64)ix * linesize()]);
+		_modified[ix] = false;
+	    }
+	}
+
+	void cache::save(checkpoint::writer &W, const std::string &name) const
+	{
+	    u64 stats[4] = { accesses, hits, misses, writes };
+	    W.put(name + ".stats", stats);
+	    W.put(name + ".tags", _tags);
+	    W.put(name + ".modified", _modified);
+	    W.put(name + ".touched", _touched);
+	    W.put(name + ".ready", _ready);
+	    W.put(name + ".prefetched", _prefetched);
+	    W.put(name + ".data", _data);
+	    _policy->save(W, name + ".policy");
+	    prefetch.save(W, name + ".prefetcher");
+	    mshr.save(W, name + ".mshrs");
+	}
+
+	void cache::restore(const checkpoint::reader &R, const std::string &name)
+	{
+	    u64 size = _tags.size();
+	    u64 stats[4];
+	    R.get(name + ".stats", stats);
+	    accesses = stats[0]; hits = stats[1]; misses = stats[2]; writes = stats[3];
+	    R.get(name + ".tags", _tags);
+	    R.get(name + ".modified", _modified);
+	    R.get(name + ".touched", _touched);
+	    R.get(name + ".ready", _ready);
+	    R.get(name + ".prefetched", _prefetched);
+	    R.get(name + ".data", _data);
+	    assert(_tags.size() == size); assert(_data.size() == size * linesize());	// the geometry was restored with the parameters
+	    _policy->restore(R, name + ".policy");
+	    prefetch.restore(R, name + ".prefetcher");
+	    mshr.restore(R, name + ".mshrs");
+	}
+
+	void cache::writeback(u32 ix, memory &M)
+	{
+	    if ((_tags[ix] != invalid) && _modified[ix])
+	    {
+		u64 addr = (u64)_tags[ix] * linesize();
+		std::copy(&_data[(u64)ix * linesize()], &_data[(u64)ix * linesize()] + linesize(), &M[addr]);	// fill memory from the cache entry
+	    }
+	}
+
+	void cache::flush()
+	{
+            for (uint32_t setix=0; setix<nsets(); setix++)
+                for (uint32_t wayix=0; wayix<nways(); wayix++)
+		    writeback(index(setix, wayix), MEM);
+	}
+
+        uint32_t cache::linesize() const
+        {
+            return _linesize;
+        }
+
+        uint32_t cache::nsets() const
+        {
+            return _nsets;
+        }
+
+        uint32_t cache::nways() const
+        {
+            return _nways;
+        }
+
+        uint32_t cache::capacity() const
+        {
+            return _nsets * _nways * _linesize;
+        }
+
+	entry	cache::line(u32 setix, u32 wayix)
+	{
+	    assert(setix < nsets()); assert(wayix < nways());
+	    return entry(this, index(setix, wayix));
+	}
+
+	u32	cache::match(u32 setix, u32 tag) const
+	{
+	    // compare the tag against all ways of the set at once; padding ways hold the invalid tag and never match
+	    const u32 *tags = &_tags[index(setix, 0)];
+	    for (u32 wayix = 0; wayix < _stride; wayix += simd)
+	    {
+#if defined(__AVX2__)
+		__m256i T = _mm256_set1_epi32(tag);
+		u32 mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(tags + wayix)), T)));
+#elif defined(__SSE2__)
+		__m128i T = _mm_set1_epi32(tag);
+		u32 mask =  _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(tags + wayix + 0)), T)))
+		         | (_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(tags + wayix + 4)), T))) << 4);
+#else
+		u32 mask = 0;
+		for (u32 i = 0; i < simd; i++) if (tags[wayix + i] == tag) mask |= (1 << i);
+#endif
+		if (mask) return wayix + __builtin_ctz(mask);
+	    }
+	    return nways();
+	}
+
+	u32	cache::victim(u32 setix)
+	{
+	    u32 wayix = match(setix, invalid);				// an invalid entry, if any, is used first
+	    if (wayix < nways()) return wayix;
+	    wayix = _policy->victim(setix);				// otherwise, ask the replacement policy
+	    assert(wayix < nways());
+	    return wayix;
+	}
+
+	bool 	cache::contains(u32 EA, u32 L, u32 &setix, u32 &wayix)
+	{
+	    u32	lineaddr = EA / linesize();			// compute line address of first byte
+	    assert(lineaddr == ((EA+L-1) / linesize())); 	// assert that last byte is in the same line
+            setix = lineaddr % nsets();				// compute set index from line address
+	    wayix = match(setix, lineaddr);			// look for address in one of the ways of the set
+            return (wayix < nways());
+	}
+
+	bool 	cache::contains(u32 EA, u32 L)
+	{
+	    u32 setix; u32 wayix;
+	    return contains(EA, L, setix, wayix);
+	}
+
+	bool    cache::contains(u32 EA, u32 L, u64 &ready)
+	{
+            u32 setix; u32 wayix;
+	    if (contains(EA, L, setix, wayix))
+	    {
+	        ready = _ready[index(setix, wayix)];
+	        return true;
+	    }
+	    else
+	    {
+	        ready = 0;
+	        return false;
+	    }
+	}
+
+	u32	cache::lineaddr(u32 EA)
+	{
+	    return EA - offset(EA);
+	}
+
+	u32	cache::offset(u32 EA)
+	{
+	    return EA % linesize();
+	}
+
+	entry	cache::find(u32 EA, u32 L)
+	{
+	    u32 setix; u32 wayix; 
+	    if (contains(EA, L, setix, wayix)) 	return line(setix, wayix);
+	    else 				return entry();
+	}
+
+	entry	cache::evict(u32 EA, u32 L)
+	{
+	    u32 setix; u32 wayix;
+	    if (contains(EA, L, setix, wayix))				// we need to find the matching entry
+	    {
+		entry E = line(setix, wayix);
+		E.invalidate();						// entry is now invalid
+		return E;						// return the cache entry
+	    }
+	    else return entry();
+	}
+
+	entry	cache::evict(u32 EA, u32 L, memory &M)
+	{
+            u32 setix = (EA / linesize()) % nsets();			// compute set index from line address
+	    entry E = line(setix, victim(setix));				// we need to find the entry to replace
+	    writeback(E._ix, M);					// fill memory from the cache entry
+	    E.invalidate();						// entry is now invalid
+	    return E;							// return the cache entry
+	}
+
+	entry	cache::evict(u32 EA, u32 L, entry T)
+	{
+	    assert(!T.valid());						// target cache entry should be invalid
+	    assert(linesize() == T._cache->linesize());			// check that linesizes are the same
+            u32 setix = (EA / linesize()) % nsets();			// compute set index from line address
+	    entry E = line(setix, victim(setix));				// we need to find the entry to replace
+	    if (E.valid())
+	    {
+		std::copy(E.data(), E.data() + linesize(), T.data());	// fill the target cache entry from this entry
+		T._cache->_tags[T._ix] = E.addr();
+		T._cache->_modified[T._ix] = E.modified();
+		T._cache->_touched[T._ix] = E.touched();
+		T._cache->_policy->insert(T._ix / T._cache->_stride, T._ix % T._cache->_stride);
+	    }
+	    E.invalidate();						// entry is now invalid
+	    return E;							// return the cache entry
+	}
+
+	entry	cache::fill(u32 EA, u32 L, memory &M)
+	{
+	    u32 setix; u32 wayix; u32 lineaddr = EA / linesize();
+	    if (contains(EA, L, setix, wayix))
+	    {
+		// This is a hit! just return the entry
+		return line(setix, wayix);
+	    }
+	    else
+	    {
+	    	// This is a miss! We need to allocate an entry and bring data from memory
+		u32 ix = index(setix, victim(setix));
+		if ((_tags[ix] != invalid) && _prefetched[ix]) prefetch.useless++;	// replaced unused
+		_prefetched[ix] = false;
+		_tags[ix] = lineaddr;							// entry is now valid, with this line address
+		_modified[ix] = false;							// fresh entry
+		_touched[ix] = counters::cycles;					// it was just touched
+		std::copy(&M[(u64)lineaddr * linesize()], &M[(u64)lineaddr * linesize()] + linesize(), &_data[(u64)ix * linesize()]);	// fill the entry from memory
+		_ready[ix] = counters::cycles;						// cycle when data will be ready in cache entry
+		_policy->insert(setix, ix - index(setix, 0));
+		return entry(this, ix);							// return the entry
+	    }
+	}
+
+	entry	cache::fill(u32 EA, u32 L, entry S)
+	{
+	    u32 setix; u32 wayix; u32 lineaddr = EA / linesize();
+	    if (contains(EA, L, setix, wayix))
+	    {
+		// This is a hit! just return the entry
+		return line(setix, wayix);
+	    }
+	    else
+	    {
+	    	// This is a miss! We need to allocate an entry and bring data from the source entry
+		assert(linesize() == S._cache->linesize());				// check that linesizes are the same
+		u32 ix = index(setix, victim(setix));
+		if (_writeback && (_tags[ix] != invalid) && _modified[ix])		// write the victim back to the level below (which holds all our lines)
+		{
+		    entry T = S._cache->find(_tags[ix] * linesize(), 1);
+		    assert(!T.null());
+		    std::copy(&_data[(u64)ix * linesize()], &_data[(u64)ix * linesize()] + linesize(), T.data());
+		    T._cache->_modified[T._ix] = true;
+		    T._cache->writes++;
+		}
+		if ((_tags[ix] != invalid) && _prefetched[ix]) prefetch.useless++;	// replaced unused
+		_prefetched[ix] = false;
+		_tags[ix] = lineaddr;							// entry is now valid, with this line address
+		_modified[ix] = S.modified();						// entry has the modified status of the source cache entry
+		_touched[ix] = counters::cycles;					// it was just touched
+		std::copy(S.data(), S.data() + linesize(), &_data[(u64)ix * linesize()]);	// fill this entry from the source cache entry
+		_ready[ix] = counters::cycles;						// cycle when data will be ready in cache entry
+		_policy->insert(setix, ix - index(setix, 0));
+		return entry(this, ix);							// return the entry
+	    }
+	}
+
+	void 	cache::hit(u32 EA, u32 L)
+	{
+	    hits++;
+	    u32 setix; u32 wayix;
+	    if (contains(EA, L, setix, wayix))
+	    {
+		_touched[index(setix, wayix)] = counters::cycles;
+		_policy->touch(setix, wayix);
+	    }
+	}
+
+	bool 	cache::hitline(u32 setix, u32 wayix)
+	{
+	    hits++;
+	    u32 ix = index(setix, wayix);
+	    _touched[ix] = counters::cycles;
+	    _policy->touch(setix, wayix);
+	    if (!_prefetched[ix]) return false;
+	    prefetch.useful++;							// the first demand hit to a prefetched line
+	    if (_ready[ix] > demand) prefetch.late++;				// it had to wait for the line
+	    _prefetched[ix] = false;
+	    return true;
+	}
+
+	void	cache::prefetched(entry E, u64 ready)
+	{
+	    assert(E._cache == this);
+	    _ready[E._ix] = ready;
+	    _prefetched[E._ix] = true;
+	    prefetch.issued++;
+	}
+
+	void	cache::writeback(entry T)
+	{
+	    u32 setix; u32 wayix;
+	    if (!_writeback || !contains(T.addr() * linesize(), 1, setix, wayix)) return;
+	    u32 ix = index(setix, wayix);
+	    if (!_modified[ix]) return;
+	    std::copy(&_data[(u64)ix * linesize()], &_data[(u64)ix * linesize()] + linesize(), T.data());
+	    T._cache->_modified[T._ix] = true;
+	    T._cache->writes++;
+	}
+
+	void	cache::arrives(entry E, u64 ready)
+	{
+	    assert(E._cache == this);
+	    _ready[E._ix] = ready;
+	}
+
+	void	cache::miss(u32 EA, u32 L)
+	{
+	    misses++;
+	}
+
+	void 	cache::access(u32 EA, u32 L)
+	{
+	    accesses++;
+	}
+    };
+
+    namespace caches
+    {
+	static u64	inflight(u32 line, u32 level)			// when a miss of line, found at level, can go: with the miss in flight, or once it has registers
+	{
+	    cache *C[3] = { &L1D, &L2, &L3 };
+	    u64 ready = 0;
+	    for (u32 l=1; (l<level) && (l<=3); l++)
+	    {
+		const mshrs &M = C[l-1]->mshr;
+		if (!M.active()) continue;
+		u64 pending = M.pending(line);
+		if (pending > demand) return max(ready, pending);	// a secondary miss, its data come with the primary one
+		ready = max(ready, M.free());
+	    }
+	    return ready;
+	}
+    };
+
+    caches::access_t	pipelined::caches::lookup
+    (
+	u32	EA,
+	u32	L
+    )
+    {
+	access_t A;
+	A.ready = 0;
+	if      (L1D.contains(EA, L, A.setix, A.wayix)) { A.level = 1; A.line = L1D.line(A.setix, A.wayix); A.ready = A.line.ready(); A.data = A.line.data() + L1D.offset(EA); }
+	else if (L2 .contains(EA, L, A.setix, A.wayix)) { A.level = 2; A.line = L2 .line(A.setix, A.wayix); A.data = A.line.data() + L2 .offset(EA); if (A.line.prefetched() || L2.mshr.active()) A.ready = A.line.ready(); }
+	else if (L3 .contains(EA, L, A.setix, A.wayix)) { A.level = 3; A.line = L3 .line(A.setix, A.wayix); A.data = A.line.data() + L3 .offset(EA); }
+	else  						{ A.level = 4; A.line = entry(); A.setix = 0; A.wayix = 0; A.data = MEM.data() + EA; }
+	if ((A.level > 1) && tracking()) A.ready = max(A.ready, inflight(EA / L1D.linesize(), A.level));
+	if (SB.active() && !operations::SQ.active()) A.ready = max(A.ready, SB.pending(EA / L1D.linesize(), demand));	// stores to the line not written yet (no forwarding)
+	return A;
+    }
+
+    u32		pipelined::caches::latency
+    (
+	const access_t	&A
+    )
+    {
+	switch (A.level)
+	{
+	    case 1: return params:: L1::latency;
+	    case 2: return params:: L2::latency;
+	    case 3: return params:: L3::latency;
+	    default: return params::MEM::latency;
+	}
+    }
+
+    per_machine u64	caches::demand = 0;
+
+    void	pipelined::caches::issue()
+    {
+	cache *C[2] = { &L1D, &L2 };
+	cache *M[3] = { &L1D, &L2, &L3 };					// the levels with registers for misses
+	for (u32 level = 1; level <= 2; level++)
+	{
+	    std::vector<prefetcher::request_t> &R = C[level-1]->prefetch.requests();
+	    for (u32 i=0; i<R.size(); i++)
+	    {
+		u32 EA = R[i].line * C[level-1]->linesize(), L = 1;
+		access_t A = lookup(EA, L);
+		if (A.level <= level) continue;					// already there
+		bool full = false;						// a prefetch does not wait for registers: it is dropped
+		for (u32 l=level; (l<A.level) && (l<=3); l++) full = full || (M[l-1]->mshr.active() && (M[l-1]->mshr.free() > R[i].cycle));
+		if (full) continue;
+		u64 ready = R[i].cycle + latency(A);				// in flight from where it was
+		for (u32 l=level; (l<A.level) && (l<=3); l++) if (M[l-1]->mshr.active()) M[l-1]->mshr.allocate(R[i].line, ready);
+		entry line = A.line;
+		if (A.level > 2)							// as a demand miss in L2, but not counted
+		{
+		    entry empty = L3.evict(EA, L, MEM);
+		    L2.evict(EA, L, empty);
+		    if (empty.valid()) { L1D.writeback(empty); L1D.evict(empty.addr() * L3.linesize(), L); }
+		    if ((A.level == 3) && line.valid() && (line.addr() == EA / L3.linesize())) { line = L2.fill(EA, L, line); A.line.invalidate(); }
+		    else line = L2.fill(EA, L, MEM);
+		}
+		if ((level == 1) && (A.level > 2) && L2.mshr.active()) L2.arrives(line, ready);
+		if (level == 1) line = L1D.fill(EA, L, line);
+		C[level-1]->prefetched(line, ready);
+	    }
+	    R.clear();
+	}
+    }
+
+    bool	pipelined::caches::stored
+    (
+	u32		EA,
+	const access_t	&A,
+	u64		&written
+    )
+    {
+	bool through = !L1D.writeback();
+	L1D.writes++;
+	if (!SB.active())
+	{
+	    if (through) L2.writes++;
+	    written = counters::lastissued + latency(A);
+	    return through;
+	}
+	u32 line = EA / L1D.linesize();
+	u64 cycle = counters::lastissued;
+	u64 free = SB.ready(line, demand);
+	if (free > demand) { SB.stalls++; SB.stalled += free - demand; }	// it waited for an entry
+	u64 filled = max(A.ready, cycle + ((A.level > 1) ? latency(A) : 0));	// the line is in L1D (a miss brings it in the background)
+	u64 drains = SB.drains;
+	u64 drained = SB.insert(line, cycle, filled + (through ? params::L2::latency : params::L1::latency));
+	if (through && (SB.drains > drains)) L2.writes++;			// one write of the line, for all the stores coalesced into it
+	counters::cycles = max(counters::cycles, drained);			// the machine is done once the buffer is
+	written = drained;
+	return through;
+    }
+
+    void	pipelined::caches::track
+    (
+	u32		EA,
+	u32		L,
+	const access_t	&A
+    )
+    {
+	cache *C[3] = { &L1D, &L2, &L3 };
+	u32 line = EA / L1D.linesize();
+	u64 ready = counters::lastissued + latency(A);				// the data arrive, at every level on the way
+	for (u32 l=1; (l<=A.level) && (l<=3); l++)
+	{
+	    mshrs &M = C[l-1]->mshr;
+	    if (!M.active()) continue;
+	    if (l == A.level)							// a hit, maybe on a line still in flight
+	    {
+		entry E = C[l-1]->find(EA, L);
+		if (!E.null() && (E.ready() > demand)) M.merged++;
+		return;
+	    }
+	    entry E = C[l-1]->find(EA, L);					// (L3 only holds what L2 evicts)
+	    u64 pending = M.pending(line);
+	    if (pending > demand)						// a secondary miss, its data come with the primary one
+	    {
+		M.merged++;
+		if (!E.null()) C[l-1]->arrives(E, pending);
+		return;
+	    }
+	    u64 free = M.free();
+	    if (free > demand) { M.stalls++; M.stalled += free - demand; }	// it waited for a register
+	    M.allocate(line, ready);
+	    if (!E.null()) C[l-1]->arrives(E, ready);
+	}
+    }
+
+    u8*	pipelined::operations::load
+    (
+	u32	EA,
+	u32 	L
+    )
+    {
+	caches::access_t A = caches::lookup(EA, L);
+	return load(EA, L, A);
+    }
+
+    u8*	pipelined::operations::load
+    (
+	u32			EA,
+	u32 			L,
+	caches::access_t	&A
+    )
+    {
+	if (!A.level) A = caches::lookup(EA, L);
+	caches::entry line = A.line;						// where the line is now
+	bool first[2] = { false, false };					// first hits to prefetched lines, in L1D and L2
+	caches::L1D.access(EA, L);
+	if (A.level == 1)
+	{
+	    // this is an L1 hit
+	    first[0] = caches::L1D.hitline(A.setix, A.wayix);
+	}
+	else
+	{
+	    // this is an L1 miss
+	    caches::L1D.miss(EA, L);
+
+	    // Let us try the L2
+	    caches::L2.access(EA, L);
+	    if (A.level == 2)
+	    {
+		// this is an L2 hit
+		first[1] = caches::L2.hitline(A.setix, A.wayix);
+	    }
+	    else
+	    {
+		// this is an L2 miss
+		caches::L2.miss(EA, L);
+
+		// let us free up space in L3 before we evict L2
+		caches::entry empty = caches::L3.evict(EA, L, MEM);					// evict a line from L3 to memory
+		caches::L2.evict(EA, L, empty);								// evict a line from L2 to L3 (nsets must be the same!)
+		if (empty.valid())									// if a valid entry was evicted from L2, must be evicted from L1
+		{
+		    caches::L1D.writeback(empty);							// (with its data, if L1 is write-back)
+		    caches::L1D.evict((empty.addr()) * (caches::L3.linesize()), L);
+		}
+
+		// Now, let us see if we still find the data in L3 (the evictions may have pushed it out)
+		caches::L3.access(EA, L);
+		if ((A.level == 3) && line.valid() && (line.addr() == EA / caches::L3.linesize()))
+		{
+		    // This is an L3 hit
+		    caches::L3.hitline(A.setix, A.wayix);
+		    line = caches::L2.fill(EA, L, line);
+		    A.line.invalidate();
+		}
+		else
+		{
+		    // This is an L3 miss
+		    caches::L3.miss(EA, L);
+		    line = caches::L2.fill(EA, L, MEM);
+		}
+	    }
+	    line = caches::L1D.fill(EA, L, line);
+	}
+	A.line = line;
+	A.data = line.data() + caches::L1D.offset(EA);
+	if (!functional::active && caches::tracking()) caches::track(EA, L, A);
+	if (!functional::active)						// train the prefetchers (issued before the next lookup)
+	{
+	    if (caches::L1D.prefetch.active()) caches::L1D.prefetch.train(CIA, EA, caches::L1D.linesize(), A.level > 1, first[0], caches::demand);
+	    if (caches::L2.prefetch.active() && (A.level > 1)) caches::L2.prefetch.train(CIA, EA, caches::L2.linesize(), A.level > 2, first[1], caches::demand);
+	}
+	return A.data;
+    }
+
+    void pipelined::caches::entry::store(u32 EA, double D)
+    {
+	u32 offset = EA % _cache->linesize();
+	*((double*)(data() + offset)) = D;
+	_cache->_modified[_ix] = true;
+    }
+
+    void pipelined::caches::entry::store(u32 EA, u8 B)
+    {
+	u32 offset = EA % _cache->linesize();
+	*((u8*)(data() + offset)) = B;
+	_cache->_modified[_ix] = true;
+    }
+
+    void pipelined::caches::entry::store(u32 EA, const pipelined::vector &V)
+    {
+	u32 offset = EA % _cache->linesize();
+	assert(offset == 0);
+	assert(sizeof(V) == _cache->linesize());
+	*((vector*)(data() + offset)) = V;
+	_cache->_modified[_ix] = true;
+    }
+
+    void pipelined::caches::entry::store(u32 EA, const u8 (&V)[16])
+    {
+	u32 offset = EA % _cache->linesize();
+	assert(offset == 0);
+	assert(sizeof(V) == _cache->linesize());
+	u8 *buff = (u8*)(data() + offset);
+	for (u32 i=0; i<16; i++) *((u8*)buff + i) = V[i];
+	_cache->_modified[_ix] = true;
+    }
+
+    void pipelined::caches::entry::store(u32 EA, const u8 (&V)[16], const u8 (&M)[16])
+    {
+	u32 offset = EA % _cache->linesize();
+	assert(offset == 0);
+	assert(sizeof(V) == _cache->linesize());
+	u8 *buff = (u8*)(data() + offset);
+	for (u32 i=0; i<16; i++) if (M[i]) *((u8*)buff + i) = V[i];
+	_cache->_modified[_ix] = true;
+    }
+
+    void pipelined::caches::entry::store(u32 EA, const float (&V)[4], const u32 (&M)[4])
+    {
+	u32 offset = EA % _cache->linesize();
+	assert(offset == 0);
+	assert(sizeof(V) == _cache->linesize());
+	float *buff = (float*)(data() + offset);
+	for (u32 i=0; i<4; i++) if (M[i]) *((float*)buff + i) = V[i];
+	_cache->_modified[_ix] = true;
+    }
+
+    per_machine flags_t		flags;				// flags
+
+    per_machine uint32_t	CIA;				// current instruction address
+    per_machine uint32_t	NIA;				// next instruction address
+
+    per_machine uint64_t	counters::instructions = 0;	// instruction counter
+    per_machine uint64_t	counters::operations = 0;	// operation counter
+    per_machine uint64_t	counters::cycles = 0;		// cycle counter
+    per_machine uint64_t	counters::lastissued = 0;	// last issue cycle
+    per_machine uint64_t	counters::lastcompleted = 0;	// last complete cycle
+    per_machine uint64_t	counters::lastfetched = 0;	// last fetch complete cycle
+    per_machine uint64_t	counters::lastfetch = 0;	// last fetch start cycle
+    per_machine uint64_t	counters::taken = 0;		// taken branch counter
+
+    per_machine bool		functional::active = false;
+    per_machine bool		functional::warming = false;
+    per_machine bool		functional::counting = true;
+    per_machine u64		functional::instructions = 0;
+
+    void functional::enter(bool count, bool warm)
+    {
+	counting = count;
+	if (!active)
+	{
+	    caches::L3.flush();						// the most recent data go last: L2, then L1D (if it is write-back)
+	    caches::L2.flush();
+	    caches::L1D.flush();					// from now on, MEM is the only up-to-date copy
+	}
+	if (warm)
+	{
+	    caches::L1D.sync(MEM);					// lines are clean, so evictions while warming never write stale data back
+	    caches::L2 .sync(MEM);
+	    caches::L3 .sync(MEM);
+	}
+	else
+	{
+	    caches::L1D.invalidate();					// functional stores go straight to MEM, so cached copies would go stale
+	    caches::L2 .invalidate();
+	    caches::L3 .invalidate();
+	}
+	active = true;
+	warming = warm;
+    }
+
+    void functional::leave()
+    {
+	if (warming)
+	{
+	    caches::L1D.sync(MEM);					// the warm lines get the data stored functionally
+	    caches::L2 .sync(MEM);
+	    caches::L3 .sync(MEM);
+	    counters::lastfetch = counters::cycles;			// the pipeline resumes at the warming clock
+	    counters::lastfetched = counters::cycles;
+	    counters::lastissued = counters::cycles;
+	    counters::lastcompleted = counters::cycles;
+	}
+	active = false;
+	warming = false;
+    }
+
+    namespace sampling
+    {
+	enum phase_t { OFF, FASTFORWARD, WARMING, WARMUP, MEASURE };
+
+	per_machine u64		countdown = ~(u64)0;
+	static per_machine phase_t	phase = OFF;
+	static per_machine u64		period;		// instructions from the start of a window to the start of the next one
+	static per_machine u64		window;		// instructions measured in each window
+	static per_machine u64		warmup;		// instructions simulated in detail, but not measured, before each window
+	static per_machine u64		warming;	// instructions executed with functional warming before each warmup
+	static per_machine u64		cycles;		// cycle count at the start of the current window
+	static per_machine u64		count;		// instruction count at the start of the current window
+	static per_machine u64		samples;	// windows measured
+	static per_machine double	sum;		// sum of the CPIs of the windows
+	static per_machine double	sumsq;		// sum of the squares of the CPIs of the windows
+
+	void	start(u64 period, u64 window, u64 warmup, u64 warming)
+	{
+	    assert(window > 0); assert(period > window + warmup);	// there must be something to fast-forward
+	    sampling::period = period;
+	    sampling::window = window;
+	    sampling::warmup = warmup;
+	    sampling::warming = std::min(warming, period - window - warmup);
+	    samples = 0; sum = 0; sumsq = 0;
+	    cycles = counters::cycles;					// what ran before start() is not a window
+	    count = counters::instructions;
+	    phase = MEASURE;						// as if an empty window just ended, so that we fast-forward first
+	    next();
+	}
+
+	void	next()
+	{
+	    do
+	    {
+		switch (phase)
+		{
+		    case OFF:
+			countdown = ~(u64)0;
+			return;
+		    case FASTFORWARD:
+			functional::enter(true, true);
+			phase = WARMING;
+			countdown = warming;
+			break;
+		    case WARMING:
+			functional::leave();
+			phase = WARMUP;
+			countdown = warmup;
+			break;
+		    case WARMUP:
+			phase = MEASURE;
+			countdown = window;
+			cycles = counters::cycles;
+			count = counters::instructions;
+			break;
+		    case MEASURE:
+			if (counters::instructions > count)		// a window just ended
+			{
+			    double cpi = (double)(counters::cycles - cycles) / (double)(counters::instructions - count);
+			    samples++; sum += cpi; sumsq += cpi*cpi;
+			}
+			if (period - window - warmup - warming == 0)	// warming over the whole gap: the caches stay warm from window to window
+			{
+			    functional::enter(true, true);
+			    phase = WARMING;
+			    countdown = warming;
+			    break;
+			}
+			functional::enter(true, false);			// plain fast-forward: the caches are emptied, and warmed again later
+			phase = FASTFORWARD;
+			countdown = period - window - warmup - warming;
+			break;
+		}
+	    } while (countdown == 0);
+	}
+
+	void	stop()
+	{
+	    if (functional::active) functional::leave();
+	    phase = OFF;
+	    countdown = ~(u64)0;
+	}
+
+	estimate_t	estimate(double z)
+	{
+	    estimate_t E;
+	    E.instructions = counters::instructions + functional::instructions;
+	    E.samples = samples;
+	    E.cpi = samples ? sum / samples : 0;
+	    E.stddev = (samples > 1) ? sqrt(std::max(0.0, (sumsq - samples*E.cpi*E.cpi) / (samples - 1))) : 0;
+	    E.cycles = E.cpi * E.instructions;
+	    E.error = samples ? z * E.stddev / sqrt((double)samples) * E.instructions : 0;
+	    return E;
+	}
+    };
+
+#ifdef PIPELINED_THREADS
+    machine::machine()
+    {
+	_done = false;
+	std::vector<std::string> K = params::keys(), V;		// a new machine has the parameters of the thread that creates it
+	for (u32 i=0; i<K.size(); i++) V.push_back(params::get(K[i]));
+	_thread = std::thread([this, K, V]() { for (u32 i=0; i<K.size(); i++) params::set(K[i], V[i]); params::configure(); loop(); });
+    }
+
+    machine::~machine()
+    {
+	{
+	    std::lock_guard<std::mutex> guard(_lock);
+	    _done = true;
+	}
+	_wake.notify_one();
+	_thread.join();
+    }
+
+    void machine::loop()
+    {
+	while (true)
+	{
+	    std::function<void()> job;
+	    {
+		std::unique_lock<std::mutex> guard(_lock);
+		_wake.wait(guard, [this]() { return _done || !_jobs.empty(); });
+		if (_jobs.empty()) return;				// done, and nothing left to run
+		job = std::move(_jobs.front());
+		_jobs.pop_front();
+	    }
+	    job();
+	}
+    }
+#endif
+
+    memory::memory()
+    {
+	void *base = mmap(0, span + page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);	// a page of slack for accesses that straddle the top
+	assert(base != MAP_FAILED);
+	_base = (u8*)base;
+    }
+
+    memory::~memory()
+    {
+	munmap(_base, span + page);
+    }
+
+    void memory::clear()
+    {
+	void *base = mmap(_base, span + page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);	// fresh zero pages, in place
+	assert(base == _base);
+	_mapped.clear();
+    }
+
+    std::vector<u32> memory::pages() const
+    {
+	const u64 host = sysconf(_SC_PAGESIZE);				// a multiple of page: each host page touched saves all of its pages
+	assert(host % page == 0);
+	const u64 N = span / host;
+	std::vector<bool> touched(span / page);
+	int fd = open("/proc/self/pagemap", O_RDONLY);
+	if (fd >= 0)								// an entry per host page: present (bit 63) or swapped out (bit 62)
+	{
+	    std::vector<u64> entry(1 << 16);
+	    for (u64 first = 0; first < N; first += entry.size())
+	    {
+		u64 n = std::min((u64)entry.size(), N - first);
+		ssize_t got = pread(fd, entry.data(), n*sizeof(u64), ((u64)_base/host + first)*sizeof(u64));
+		assert(got == (ssize_t)(n*sizeof(u64)));
+		for (u64 i=0; i<n; i++) if (entry[i] >> 62) std::fill(touched.begin() + (first + i)*(host/page), touched.begin() + (first + i + 1)*(host/page), true);
+	    }
+	    close(fd);
+	}
+	else									// no /proc: residency, which misses the pages swapped out
+	{
+	    std::vector<unsigned char> resident(N);
+	    int ok = mincore(_base, span, resident.data());
+	    assert(ok == 0);
+	    for (u64 i=0; i<N; i++) if (resident[i] & 1) std::fill(touched.begin() + i*(host/page), touched.begin() + (i + 1)*(host/page), true);
+	}
+	for (u32 i=0; i<_mapped.size(); i++) std::fill(touched.begin() + _mapped[i].first, touched.begin() + _mapped[i].first + _mapped[i].second, true);	// even if never read
+	std::vector<u32> P;
+	for (u32 i=0; i<touched.size(); i++) if (touched[i]) P.push_back(i);
+	return P;
+    }
+
+    bool memory::map(u64 addr, const char *path, u64 &size)
+    {
+	assert(addr % sysconf(_SC_PAGESIZE) == 0);
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	if ((fd < 0) || fstat(fd, &st))
+	{
+	    std::cerr << "memory: cannot read " << path << std::endl;
+	    if (fd >= 0) close(fd);
+	    return false;
+	}
+	size = st.st_size;
+	if (addr + size > span)
+	{
+	    std::cerr << "memory: " << path << " does not fit at 0x" << std::hex << addr << std::dec << std::endl;
+	    close(fd);
+	    return false;
+	}
+	void *base = size ? mmap(_base + addr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) : _base + addr;
+	close(fd);									// the mapping stays
+	if (base == MAP_FAILED)
+	{
+	    std::cerr << "memory: cannot map " << path << std::endl;
+	    return false;
+	}
+	assert(base == _base + addr);
+	if (size) _mapped.push_back(std::make_pair(addr/page, (size + page - 1)/page));
+	return true;
+    }
+
+    namespace image
+    {
+	per_machine std::vector<region_t>	regions;
+
+	void	define(const std::string &name, u32 addr, u64 size)
+	{
+	    assert(addr + size <= memory::span);
+	    region_t R = { name, addr, size, "" };
+	    for (u32 i=0; i<regions.size(); i++) if (regions[i].name == name) { regions[i] = R; return; }
+	    regions.push_back(R);
+	}
+
+	const region_t*	find(const std::string &name)
+	{
+	    for (u32 i=0; i<regions.size(); i++) if (regions[i].name == name) return &regions[i];
+	    return 0;
+	}
+
+	static bool	copy(u32 addr, const std::string &path, u64 &size)	// read file path into MEM at addr
+	{
+	    FILE *F = fopen(path.c_str(), "rb");
+	    if (!F) { std::cerr << "image: cannot read " << path << std::endl; return false; }
+	    fseek(F, 0, SEEK_END);
+	    size = ftell(F);
+	    fseek(F, 0, SEEK_SET);
+	    bool ok = (addr + size <= memory::span) && (fread(MEM.data() + addr, 1, size, F) == size);
+	    fclose(F);
+	    if (!ok) std::cerr << "image: cannot load " << path << " at 0x" << std::hex << addr << std::dec << std::endl;
+	    return ok;
+	}
+
+	bool	load(const char *path)
+	{
+	    FILE *F = fopen(path, "r");
+	    if (!F)
+	    {
+		std::cerr << "image: cannot read " << path << std::endl;
+		return false;
+	    }
+	    std::string dir = path;
+	    dir = (dir.find('/') == std::string::npos) ? "" : dir.substr(0, dir.rfind('/') + 1);
+	    bool ok = true;
+	    char buf[1024];
+	    for (u32 line = 1; fgets(buf, sizeof(buf), F); line++)
+	    {
+		std::string L = buf;
+		std::istringstream words(L.substr(0, L.find('#')));
+		std::string name, eq, addr, what, extra;
+		if (!(words >> name)) continue;						// blank or comment
+		char *end;
+		u64 A = (words >> eq >> addr >> what) ? strtoull(addr.c_str(), &end, 0) : 0;
+		if ((eq != "=") || addr.empty() || *end || (A >= memory::span) || (words >> extra))
+		{
+		    std::cerr << path << ":" << line << ": expected name = address file|size" << std::endl;
+		    ok = false;
+		    continue;
+		}
+		u64 size = strtoull(what.c_str(), &end, 0);
+		if (!*end)								// an output region
+		{
+		    if (A + size > memory::span) { std::cerr << path << ":" << line << ": region does not fit in memory" << std::endl; ok = false; continue; }
+		    define(name, A, size);
+		    continue;
+		}
+		std::string file = (what[0] == '/') ? what : dir + what;
+		bool loaded = (A % sysconf(_SC_PAGESIZE)) ? copy(A, file, size) : MEM.map(A, file.c_str(), size);
+		if (!loaded) { ok = false; continue; }
+		define(name, A, size);
+		regions.back().file = file;
+	    }
+	    fclose(F);
+	    return ok;
+	}
+
+	bool	dump(const std::string &name, const char *path)
+	{
+	    const region_t *R = find(name);
+	    assert(R);									// not a region
+	    FILE *F = fopen(path, "wb");
+	    bool ok = F && (fwrite(MEM.data() + R->addr, 1, R->size, F) == R->size);
+	    ok = F && (fclose(F) == 0) && ok;
+	    if (!ok) std::cerr << "image: cannot write " << path << std::endl;
+	    return ok;
+	}
+
+	bool	save(const char *path)
+	{
+	    FILE *F = fopen(path, "w");
+	    if (!F)
+	    {
+		std::cerr << "image: cannot write " << path << std::endl;
+		return false;
+	    }
+	    std::string base = path;
+	    if (base.find('/') != std::string::npos) base = base.substr(base.rfind('/') + 1);
+	    bool ok = true;
+	    for (u32 i=0; i<regions.size(); i++)
+	    {
+		const region_t &R = regions[i];
+		std::string file = std::string(path) + "." + R.name;
+		if (file == R.file) { std::cerr << "image: " << file << " is mapped in MEM, save to another path" << std::endl; ok = false; continue; }
+		ok = dump(R.name, file.c_str()) && ok;
+		fprintf(F, "%s\t= 0x%08x\t%s.%s\t# %lu bytes\n", R.name.c_str(), R.addr, base.c_str(), R.name.c_str(), R.size);
+	    }
+	    ok = !ferror(F) && ok;
+	    ok = (fclose(F) == 0) && ok;
+	    return ok;
+	}
+    };
+
+    namespace golden
+    {
+	const char	header[] = "test,point,instructions,operations,cycles,"
+				   "L1D.accesses,L1D.hits,L1D.misses,L1I.accesses,L1I.hits,L1I.misses,"
+				   "L2.accesses,L2.hits,L2.misses,L3.accesses,L3.hits,L3.misses";
+
+	void	record(const char *test, const std::string &point)
+	{
+	    const char *path = getenv("PIPELINED_GOLDEN");
+	    if (!path) return;
+	    FILE *F = fopen(path, "a");
+	    if (!F) { perror(path); return; }
+	    fseek(F, 0, SEEK_END);
+	    if (ftell(F) == 0) fprintf(F, "%s\n", header);				// a new file
+	    fprintf(F, "%s,%s,%lu,%lu,%lu", test, point.c_str(), counters::instructions, counters::operations, counters::cycles);
+	    caches::cache *C[4] = { &caches::L1D, &caches::L1I, &caches::L2, &caches::L3 };
+	    for (u32 i=0; i<4; i++) fprintf(F, ",%lu,%lu,%lu", C[i]->accesses, C[i]->hits, C[i]->misses);
+	    fprintf(F, "\n");
+	    fclose(F);
+	}
+    };
+
+    namespace stats
+    {
+	per_machine histogram			dispatch;
+	static per_machine std::vector<stat_t>	registry;
+	static per_machine bool			registered = false;
+
+	static stat_t	make(const std::string &name, const std::string &description, kind_t kind)
+	{
+	    stat_t S;
+	    S.name = name; S.description = description; S.kind = kind;
+	    S.counter = 0; S.base = 0; S.hist = 0;
+	    return S;
+	}
+
+	static void	add(const stat_t &S)
+	{
+	    for (u32 i=0; i<registry.size(); i++) assert(registry[i].name != S.name);
+	    registry.push_back(S);
+	}
+
+	static per_machine std::vector<branches::predictor::site_t>	sites;	// branches::BP.sites() at the last reset
+
+	static double	ratio(const std::string &a, const std::string &b)	// a/b, 0 if b is 0
+	{
+	    double d = value(b);
+	    return d ? value(a)/d : 0.0;
+	}
+
+	static void	builtins()						// the statistics of the calling machine (the addresses are per machine)
+	{
+	    if (registered) return;
+	    registered = true;
+	    counter("core.instructions", counters::instructions, "instructions simulated in timing mode");
+	    counter("core.operations", counters::operations, "operations simulated in timing mode");
+	    counter("core.cycles", counters::cycles, "cycles simulated");
+	    counter("core.functional_instructions", functional::instructions, "instructions executed in functional mode");
+	    formula("core.ipc", []() { return ratio("core.instructions", "core.cycles"); }, "instructions per cycle");
+	    formula("core.cpi", []() { return ratio("core.cycles", "core.instructions"); }, "cycles per instruction");
+
+	    const char *C[] = { "L1D", "L1I", "L2", "L3" };
+	    caches::cache *L[] = { &caches::L1D, &caches::L1I, &caches::L2, &caches::L3 };
+	    for (u32 i=0; i<4; i++)
+	    {
+		std::string c = std::string("caches.") + C[i];
+		counter(c + ".accesses", L[i]->accesses, "accesses");
+		counter(c + ".hits", L[i]->hits, "hits");
+		counter(c + ".misses", L[i]->misses, "misses");
+		formula(c + ".miss_rate", [c]() { return ratio(c + ".misses", c + ".accesses"); }, "misses per access");
+		if (L[i] == &caches::L1I) continue;				// the levels with MSHRs
+		counter(c + ".writes", L[i]->writes, "writes from above: stores, stores written through and lines written back");
+		std::string m = c + ".mshr";
+		counter(m + ".allocated", L[i]->mshr.allocated, "primary misses, each one took a register");
+		counter(m + ".merged", L[i]->mshr.merged, "secondary misses, merged with a miss in flight");
+		counter(m + ".stalls", L[i]->mshr.stalls, "primary misses that waited for a free register");
+		counter(m + ".stall_cycles", L[i]->mshr.stalled, "cycles they waited");
+		if (L[i] == &caches::L3) continue;				// the levels with a prefetcher
+		std::string p = c + ".prefetch";
+		counter(p + ".issued", L[i]->prefetch.issued, "lines brought in by prefetches");
+		counter(p + ".useful", L[i]->prefetch.useful, "prefetched lines later hit by a demand access");
+		counter(p + ".late", L[i]->prefetch.late, "useful prefetches not ready when the demand access could issue");
+		counter(p + ".useless", L[i]->prefetch.useless, "prefetched lines evicted before any demand access hit them");
+		formula(p + ".accuracy", [p]() { return ratio(p + ".useful", p + ".issued"); }, "useful prefetches per prefetch");
+		formula(p + ".coverage", [p, c]() { return value(p + ".useful")/std::max(1.0, value(p + ".useful") + value(c + ".misses")); }, "demand misses removed, per miss there would have been");
+	    }
+
+	    const char *U[] = { "LDU", "STU", "FXU", "FPU", "BRU", "VU" };
+	    units::unit *X[] = { &units::LDU, &units::STU, &units::FXU, &units::FPU, &units::BRU, &units::VU };
+	    for (u32 i=0; i<6; i++)
+	    {
+		std::string u = std::string("units.") + U[i];
+		counter(u + ".operations", X[i]->operations, "operations issued");
+		counter(u + ".busy_cycles", X[i]->claims, "cycles reserved by its operations");
+		formula(u + ".utilization", [u]() { return ratio(u + ".busy_cycles", "core.cycles"); }, "busy cycles per cycle");
+	    }
+
+	    counter("storebuffer.stores", caches::SB.stores, "stores that went into the store buffer");
+	    counter("storebuffer.coalesced", caches::SB.coalesced, "stores merged into the entry of an earlier store to the same line");
+	    counter("storebuffer.drains", caches::SB.drains, "entries written to the cache, one line write each");
+	    counter("storebuffer.stalls", caches::SB.stalls, "stores that waited for a free entry");
+	    counter("storebuffer.stall_cycles", caches::SB.stalled, "cycles they waited");
+
+	    counter("storequeue.stores", operations::SQ.stores, "stores that went into the store queue");
+	    counter("storequeue.stalls", operations::SQ.stalls, "stores that waited for a free entry");
+	    counter("storequeue.forwarded", operations::SQ.forwarded, "loads that got their data from an older store in the queue");
+	    counter("storequeue.violations", operations::SQ.violations, "loads that went ahead of a store they depended on, and were replayed");
+	    counter("storequeue.waits", operations::SQ.waits, "loads the store set predictor held back until a store of their set issued");
+	    counter("storequeue.false_dependences", operations::SQ.falsedeps, "held back loads that waited for a store they did not depend on");
+
+	    counter("prf.rename_stalls", PRF::stalls, "renames that waited for the earliest free physical register");
+	    counter("vrf.rename_stalls", VRF::stalls, "renames that waited for the earliest free physical vector register");
+	    counter("branches.executed", units::BRU.operations, "branch operations");
+	    counter("branches.taken", counters::taken, "taken branches, each one a fetch redirect unless predicted");
+	    formula("branches.taken_rate", []() { return ratio("branches.taken", "branches.executed"); }, "taken branches per branch");
+	    counter("branches.predicted", branches::BP.predicted, "conditional branches the direction predictor predicted");
+	    counter("branches.mispredicted", branches::BP.mispredicted, "of those, predicted the wrong way");
+	    formula("branches.accuracy", []() { return 1.0 - ratio("branches.mispredicted", "branches.predicted"); }, "right predictions per prediction");
+	    counter("branches.btb_misses", branches::BP.btbmisses, "taken branches the BTB had no target for, redirected at decode");
+	    counter("branches.redirects", branches::BP.redirects, "fetches down the wrong path, redirected once the branch completed");
+	    distribution("backend.dispatch_to_issue", dispatch, "cycles from dispatch to issue, per operation");
+	}
+
+	void	counter(const std::string &name, const u64 &var, const std::string &description)
+	{
+	    builtins();
+	    stat_t S = make(name, description, COUNTER);
+	    S.counter = &var; S.base = var;
+	    add(S);
+	}
+
+	void	distribution(const std::string &name, histogram &H, const std::string &description)
+	{
+	    builtins();
+	    stat_t S = make(name, description, HISTOGRAM);
+	    S.hist = &H;
+	    add(S);
+	}
+
+	void	formula(const std::string &name, std::function<double()> F, const std::string &description)
+	{
+	    builtins();
+	    stat_t S = make(name, description, FORMULA);
+	    S.formula = F;
+	    add(S);
+	}
+
+	const stat_t*	find(const std::string &name)
+	{
+	    builtins();
+	    for (u32 i=0; i<registry.size(); i++) if (registry[i].name == name) return &registry[i];
+	    return 0;
+	}
+
+	std::vector<std::string>	names()
+	{
+	    builtins();
+	    std::vector<std::string> N;
+	    for (u32 i=0; i<registry.size(); i++) N.push_back(registry[i].name);
+	    return N;
+	}
+
+	double	value(const std::string &name)
+	{
+	    const stat_t *S = find(name);
+	    assert(S && (S->kind != HISTOGRAM));
+	    if (S->kind == COUNTER) return (double)(*S->counter - S->base);
+	    return S->formula();
+	}
+
+	void	reset()
+	{
+	    builtins();
+	    for (u32 i=0; i<registry.size(); i++)
+	    {
+		stat_t &S = registry[i];
+		if (S.kind == COUNTER)   S.base = *S.counter;
+		if (S.kind == HISTOGRAM) S.hist->clear();
+	    }
+	    sites = branches::BP.sites();
+	}
+
+	static std::vector<stat_t>	exported()			// the registry, then branches.sites.<address>.* for each static branch executed since the last reset
+	{
+	    builtins();
+	    std::vector<stat_t> E = registry;
+	    const std::vector<branches::predictor::site_t> &S = branches::BP.sites();
+	    for (u32 i=0; i<S.size(); i++)
+	    {
+		branches::predictor::site_t B = { 0, 0, 0, 0 };
+		if (i < sites.size()) B = sites[i];
+		if (S[i].executed == B.executed) continue;
+		char address[16];
+		snprintf(address, sizeof(address), "0x%04x", 4*i);
+		std::string b = std::string("branches.sites.") + address;
+		const u64 *counter[4] = { &S[i].executed, &S[i].taken, &S[i].mispredicted, &S[i].btbmisses };
+		const u64 base[4] = { B.executed, B.taken, B.mispredicted, B.btbmisses };
+		const char *name[4] = { ".executed", ".taken", ".mispredicted", ".btb_misses" };
+		for (u32 k=0; k<4; k++)
+		{
+		    stat_t C = make(b + name[k], "", COUNTER);
+		    C.counter = counter[k]; C.base = base[k];
+		    E.push_back(C);
+		}
+		double accuracy = 1.0 - (double)(S[i].mispredicted - B.mispredicted)/(S[i].executed - B.executed);
+		stat_t A = make(b + ".accuracy", "right direction predictions per execution", FORMULA);
+		A.formula = [accuracy]() { return accuracy; };
+		E.push_back(A);
+	    }
+	    return E;
+	}
+
+	static u32	used(const histogram &H)				// buckets up to the last one with samples
+	{
+	    u32 n = H.size();
+	    while (n && !H.bucket(n - 1)) n--;
+	    return n;
+	}
+
+	static std::string	label(const histogram &H, u32 i)		// of bucket i: lo, lo-hi or lo+
+	{
+	    if (i + 1 == H.size()) return std::to_string(H.low(i)) + "+";
+	    u64 lo = H.low(i), hi = H.low(i + 1) - 1;
+	    return (lo == hi) ? std::to_string(lo) : std::to_string(lo) + "-" + std::to_string(hi);
+	}
+
+	static std::string	number(double v)
+	{
+	    char buf[32];
+	    snprintf(buf, sizeof(buf), "%.6g", v);
+	    return buf;
+	}
+
+	static std::string	number(const stat_t &S)			// value of a counter or formula, as text
+	{
+	    if (S.kind == COUNTER) return std::to_string(*S.counter - S.base);
+	    return number(S.formula());
+	}
+
+	typedef struct node						// a component, or a statistic (a leaf)
+	{
+	    std::string		name;
+	    const stat_t*	stat;
+	    std::vector<node>	children;
+	} node_t;
+
+	static void	emit(std::ostream &out, const node_t &N, u32 depth)
+	{
+	    std::string indent(2*depth, ' ');
+	    if (N.stat && (N.stat->kind != HISTOGRAM)) { out << number(*N.stat); return; }
+	    out << "{\n";
+	    if (N.stat)
+	    {
+		const histogram &H = *N.stat->hist;
+		out << indent << "  \"samples\": " << H.samples() << ",\n";
+		out << indent << "  \"mean\": " << number(H.mean()) << ",\n";
+		out << indent << "  \"buckets\": {";
+		for (u32 i=0; i<used(H); i++) out << (i ? ", " : " ") << "\"" << label(H, i) << "\": " << H.bucket(i);
+		out << " }\n";
+	    }
+	    for (u32 i=0; i<N.children.size(); i++)
+	    {
+		out << indent << "  \"" << N.children[i].name << "\": ";
+		emit(out, N.children[i], depth + 1);
+		out << ((i + 1 < N.children.size()) ? ",\n" : "\n");
+	    }
+	    out << indent << "}";
+	}
+
+	void	json(std::ostream &out)
+	{
+	    std::vector<stat_t> E = exported();
+	    node_t root; root.stat = 0;
+	    for (u32 i=0; i<E.size(); i++)					// the tree of components, in the order of registration
+	    {
+		node_t *N = &root;
+		std::stringstream path(E[i].name);
+		std::string part;
+		while (std::getline(path, part, '.'))
+		{
+		    u32 c = 0;
+		    while ((c < N->children.size()) && (N->children[c].name != part)) c++;
+		    if (c == N->children.size()) { node_t child; child.name = part; child.stat = 0; N->children.push_back(child); }
+		    N = &N->children[c];
+		}
+		assert(!N->stat && N->children.empty());			// a statistic cannot also be a component
+		N->stat = &E[i];
+	    }
+	    emit(out, root, 0);
+	    out << std::endl;
+	}
+
+	void	csv(std::ostream &out)
+	{
+	    std::vector<stat_t> E = exported();
+	    out << "name,value" << std::endl;
+	    for (u32 i=0; i<E.size(); i++)
+	    {
+		const stat_t &S = E[i];
+		if (S.kind != HISTOGRAM) { out << S.name << "," << number(S) << std::endl; continue; }
+		const histogram &H = *S.hist;
+		out << S.name << ".samples," << H.samples() << std::endl;
+		out << S.name << ".mean," << number(H.mean()) << std::endl;
+		for (u32 b=0; b<used(H); b++) out << S.name << "[" << label(H, b) << "]," << H.bucket(b) << std::endl;
+	    }
+	}
+
+	bool	dump(const char *path)
+	{
+	    std::ofstream out(path);
+	    if (!out) { std::cerr << "stats: cannot write " << path << std::endl; return false; }
+	    std::string p(path);
+	    if ((p.size() >= 5) && (p.compare(p.size() - 5, 5, ".json") == 0)) json(out);
+	    else csv(out);
+	    out.close();
+	    if (!out) { std::cerr << "stats: error writing " << path << std::endl; return false; }
+	    return true;
+	}
+    };
+
+    void zeromem()
+    {
+	MEM.clear();
+    }
+
+    void zeroctrs()
+    {
+    	operations::operation::zero();;
+    	instructions::instruction::zero();
 	counters::instructions = 0;
 	counters::operations = 0;
 	counters::cycles = 0;
 	counters::lastissued = 0;
 	counters::lastfetched = 0;
 	counters::lastfetch = 0;
+	counters::taken = 0;
+	functional::instructions = 0;
 	PRF::next = 0;
 	VRF::next = 0;
 	for (u32 i=0; i<params::GPR::N; i++) GPR[i].idx() = PRF::next++;
@@ -594,6 +2331,10 @@ namespace pipelined
 	for (u32 i=0; i<params::VRF::N; i++) VRF::V[i].used() = 0;
 	for (u32 i=0; i<params::VR::N;  i++) VR[i].ready() = 0;
 	for (u32 i=0; i<params::VR::N;  i++) VR[i].busy() = true;
+	PRF::free.reset(PRF::R);
+	VRF::free.reset(VRF::V);
+	PRF::stalls = 0;
+	VRF::stalls = 0;
 	units::FXU.clear();
 	units::FPU.clear();
 	units::LDU.clear();
@@ -602,15 +2343,413 @@ namespace pipelined
 	units::VU.clear();
 	flags.clear();
 	operations::issued.clear();
+	operations::objects.reset();
+	instructions::flush();
+	instructions::objects.reset();
 	pipelined::caches::L1D.clear();
+	pipelined::caches::SB.clear();
+	operations::SQ.clear();
+	branches::BP.clear();
 	pipelined::caches::L1I.clear();
 	pipelined::caches:: L2.clear();
 	pipelined::caches:: L3.clear();
+	stats::reset();							// a new region
     }
 
+    namespace params
+    {
+	typedef struct
+	{
+	    const char		*key;		// name of the parameter
+	    u32			*value;		// this machine's value (numbers)
+	    replacement_t	*policy;	// this machine's value (replacement policies)
+	    prefetcher_t	*prefetcher;	// this machine's value (prefetchers)
+	    predictor_t		*predictor;	// this machine's value (branch predictors)
+	} param_t;
+
+	static const char	*policies[] = { "lru", "plru", "srrip", "brrip", "random" };	// names of the replacement_t values
+	static const char	*prefetchers[] = { "none", "nextline", "stride", "stream" };	// names of the prefetcher_t values
+	static const char	*predictors[] = { "none", "bimodal", "gshare", "tage" };		// names of the predictor_t values
+
+	static std::vector<param_t>	table()	// the parameters of the calling machine (the addresses are per machine)
+	{
+	    param_t T[] =
+	    {
+		{ "L1.nsets",			&L1::nsets,			0,			0,			0 },
+		{ "L1.nways",			&L1::nways,			0,			0,			0 },
+		{ "L1.linesize",		&L1::linesize,			0,			0,			0 },
+		{ "L1.latency",			&L1::latency,			0,			0,			0 },
+		{ "L1.replacement",		0,				&L1::replacement,	0,			0 },
+		{ "L1.prefetcher",		0,				0,			&L1::prefetcher,	0 },
+		{ "L1.prefetchdegree",		&L1::prefetchdegree,		0,			0,			0 },
+		{ "L1.prefetchdistance",	&L1::prefetchdistance,		0,			0,			0 },
+		{ "L1.mshrs",			&L1::mshrs,			0,			0,			0 },
+		{ "L1.writeback",		&L1::writeback,			0,			0,			0 },
+		{ "L2.nsets",			&L2::nsets,			0,			0,			0 },
+		{ "L2.nways",			&L2::nways,			0,			0,			0 },
+		{ "L2.linesize",		&L2::linesize,			0,			0,			0 },
+		{ "L2.latency",			&L2::latency,			0,			0,			0 },
+		{ "L2.replacement",		0,				&L2::replacement,	0,			0 },
+		{ "L2.prefetcher",		0,				0,			&L2::prefetcher,	0 },
+		{ "L2.prefetchdegree",		&L2::prefetchdegree,		0,			0,			0 },
+		{ "L2.prefetchdistance",	&L2::prefetchdistance,		0,			0,			0 },
+		{ "L2.mshrs",			&L2::mshrs,			0,			0,			0 },
+		{ "L3.nsets",			&L3::nsets,			0,			0,			0 },
+		{ "L3.nways",			&L3::nways,			0,			0,			0 },
+		{ "L3.linesize",		&L3::linesize,			0,			0,			0 },
+		{ "L3.latency",			&L3::latency,			0,			0,			0 },
+		{ "L3.replacement",		0,				&L3::replacement,	0,			0 },
+		{ "L3.mshrs",			&L3::mshrs,			0,			0,			0 },
+		{ "MEM.latency",		&MEM::latency,			0,			0,			0 },
+		{ "PRF.N",			&PRF::N,			0,			0,			0 },
+		{ "VRF.N",			&VRF::N,			0,			0,			0 },
+		{ "SB.N",			&SB::N,				0,			0,			0 },
+		{ "SQ.N",			&SQ::N,				0,			0,			0 },
+		{ "SQ.forward",			&SQ::forward,			0,			0,			0 },
+		{ "SQ.penalty",			&SQ::penalty,			0,			0,			0 },
+		{ "SQ.storesets",		&SQ::storesets,			0,			0,			0 },
+		{ "BP.predictor",		0,				0,			0,			&BP::predictor },
+		{ "BP.entries",			&BP::entries,			0,			0,			0 },
+		{ "BP.history",			&BP::history,			0,			0,			0 },
+		{ "BP.btb",			&BP::btb,			0,			0,			0 },
+		{ "BP.penalty",			&BP::penalty,			0,			0,			0 },
+		{ "Frontend.DECODE.latency",	&Frontend::DECODE::latency,	0,			0,			0 },
+		{ "Frontend.DISPATCH.latency",	&Frontend::DISPATCH::latency,	0,			0,			0 },
+		{ "Backend.maxissue",		&Backend::maxissue,		0,			0,			0 }
+	    };
+	    return std::vector<param_t>(T, T + sizeof(T)/sizeof(T[0]));
+	}
+
+	static std::string	trim(const std::string &s)
+	{
+	    size_t first = s.find_first_not_of(" \t\r\n");
+	    if (first == std::string::npos) return "";
+	    return s.substr(first, s.find_last_not_of(" \t\r\n") - first + 1);
+	}
+
+	std::vector<std::string>	keys()
+	{
+	    std::vector<param_t> T = table();
+	    std::vector<std::string> K;
+	    for (u32 i=0; i<T.size(); i++) K.push_back(T[i].key);
+	    return K;
+	}
+
+	bool	set(const std::string &key, const std::string &value)
+	{
+	    std::vector<param_t> T = table();
+	    u32 i; for (i=0; i<T.size(); i++) if (key == T[i].key) break;
+	    if (i == T.size())
+	    {
+		std::cerr << "params: unknown parameter " << key << std::endl;
+		return false;
+	    }
+	    std::string v = value;
+	    std::transform(v.begin(), v.end(), v.begin(), ::tolower);
+	    if (T[i].policy)
+	    {
+		for (u32 k=0; k<sizeof(policies)/sizeof(policies[0]); k++) if (v == policies[k]) { *T[i].policy = (replacement_t)k; return true; }
+		std::cerr << "params: " << key << " must be one of lru, plru, srrip, brrip, random (not " << value << ")" << std::endl;
+		return false;
+	    }
+	    if (T[i].prefetcher)
+	    {
+		for (u32 k=0; k<sizeof(prefetchers)/sizeof(prefetchers[0]); k++) if (v == prefetchers[k]) { *T[i].prefetcher = (prefetcher_t)k; return true; }
+		std::cerr << "params: " << key << " must be one of none, nextline, stride, stream (not " << value << ")" << std::endl;
+		return false;
+	    }
+	    if (T[i].predictor)
+	    {
+		for (u32 k=0; k<sizeof(predictors)/sizeof(predictors[0]); k++) if (v == predictors[k]) { *T[i].predictor = (predictor_t)k; return true; }
+		std::cerr << "params: " << key << " must be one of none, bimodal, gshare, tage (not " << value << ")" << std::endl;
+		return false;
+	    }
+	    char *end;
+	    unsigned long long n = v.empty() ? 0 : strtoull(v.c_str(), &end, 0);
+	    if (!v.empty() && (*end == 'k')) { n *= 1024; end++; }
+	    else if (!v.empty() && (*end == 'm')) { n *= 1024*1024; end++; }
+	    if (v.empty() || (v[0] == '-') || *end || (n > 0xffffffffull))
+	    {
+		std::cerr << "params: bad value " << value << " for " << key << std::endl;
+		return false;
+	    }
+	    *T[i].value = n;
+	    return true;
+	}
+
+	std::string	get(const std::string &key)
+	{
+	    std::vector<param_t> T = table();
+	    for (u32 i=0; i<T.size(); i++)
+	    {
+		if (key != T[i].key) continue;
+		if (T[i].policy)     return policies[*T[i].policy];
+		if (T[i].prefetcher) return prefetchers[*T[i].prefetcher];
+		if (T[i].predictor)  return predictors[*T[i].predictor];
+		return std::to_string(*T[i].value);
+	    }
+	    assert(false);							// not a parameter
+	    return "";
+	}
+
+	bool	load(const char *path)
+	{
+	    FILE *F = fopen(path, "r");
+	    if (!F)
+	    {
+		std::cerr << "params: cannot read " << path << std::endl;
+		return false;
+	    }
+	    bool ok = true;
+	    char buf[1024];
+	    for (u32 line = 1; fgets(buf, sizeof(buf), F); line++)
+	    {
+		std::string L = buf;
+		L = trim(L.substr(0, L.find('#')));
+		if (L.empty()) continue;
+		size_t eq = L.find('=');
+		if (eq == std::string::npos)
+		{
+		    std::cerr << path << ":" << line << ": expected key = value" << std::endl;
+		    ok = false;
+		    continue;
+		}
+		if (!set(trim(L.substr(0, eq)), trim(L.substr(eq + 1)))) { std::cerr << path << ":" << line << ": parameter not set" << std::endl; ok = false; }
+	    }
+	    fclose(F);
+	    return ok;
+	}
+
+	std::string	check()
+	{
+	    u32 nsets[3] = { L1::nsets, L2::nsets, L3::nsets };
+	    u32 nways[3] = { L1::nways, L2::nways, L3::nways };
+	    replacement_t policy[3] = { L1::replacement, L2::replacement, L3::replacement };
+	    for (u32 l=0; l<3; l++)
+	    {
+		std::string L = "L" + std::to_string(l+1);
+		if ((nsets[l] == 0) || (nways[l] == 0)) return L + ".nsets and " + L + ".nways must be positive";
+		if ((policy[l] == PLRU) && ((nways[l] & (nways[l] - 1)) || (nways[l] > 64))) return L + ".nways must be a power of 2, at most 64, for plru";
+	    }
+	    if (L2::nsets != L3::nsets) return "L2.nsets must be the same as L3.nsets";
+	    if ((L1::prefetchdegree == 0) || (L1::prefetchdegree > 16) || (L2::prefetchdegree == 0) || (L2::prefetchdegree > 16)) return "prefetchdegree must be 1 to 16";
+	    if ((L1::prefetchdistance == 0) || (L2::prefetchdistance == 0)) return "prefetchdistance must be positive";
+	    if ((L1::mshrs > 64) || (L2::mshrs > 64) || (L3::mshrs > 64)) return "mshrs must be at most 64";
+	    if (L1::writeback > 1) return "L1.writeback must be 0 or 1";
+	    if (SB::N > 64) return "SB.N must be at most 64";
+	    if (SQ::N > 256) return "SQ.N must be at most 256";
+	    if (SQ::forward == 0) return "SQ.forward must be positive";
+	    if ((BP::entries < 16) || (BP::entries > (1u << 20)) || (BP::entries & (BP::entries - 1))) return "BP.entries must be a power of 2, 16 to 1M";
+	    if (BP::history > 32) return "BP.history must be at most 32";
+	    if (BP::btb > 65536) return "BP.btb must be at most 64K";
+	    if ((L2::linesize != L1::linesize) || (L3::linesize != L1::linesize)) return "all cache levels must have the same linesize";
+	    if ((L1::linesize < sizeof(vector)) || (L1::linesize & (L1::linesize - 1))) return "linesize must be a power of 2, at least 16 bytes (one vector)";
+	    if (PRF::N <= GPR::N + FPR::N) return "PRF.N must be larger than GPR.N + FPR.N = " + std::to_string(GPR::N + FPR::N);
+	    if (VRF::N <= VR::N) return "VRF.N must be larger than VR.N = " + std::to_string(VR::N);
+	    if ((Backend::maxissue == 0) || (Backend::maxissue > 255)) return "Backend.maxissue must be 1 to 255";	// operations::slots counts in a byte
+	    return "";
+	}
+
+	void	configure()
+	{
+	    assert(check().empty());
+	    pipelined::MEM.clear();
+	    pipelined::PRF::R.assign(PRF::N, preg<u64>());
+	    pipelined::VRF::V.assign(VRF::N, preg<vector>());
+	    caches::L1D.replacement(L1::replacement); caches::L1D.configure(L1::nsets, L1::nways, L1::linesize);
+	    caches::L1I.replacement(L1::replacement); caches::L1I.configure(L1::nsets, L1::nways, L1::linesize);
+	    caches::L2 .replacement(L2::replacement); caches::L2 .configure(L2::nsets, L2::nways, L2::linesize);
+	    caches::L3 .replacement(L3::replacement); caches::L3 .configure(L3::nsets, L3::nways, L3::linesize);
+	    caches::L1D.prefetch.configure(L1::prefetcher, L1::prefetchdegree, L1::prefetchdistance);	// L1I has none
+	    caches::L2 .prefetch.configure(L2::prefetcher, L2::prefetchdegree, L2::prefetchdistance);
+	    caches::L1D.mshr.configure(L1::mshrs);						// L1I has none
+	    caches::L2 .mshr.configure(L2::mshrs);
+	    caches::L3 .mshr.configure(L3::mshrs);
+	    caches::L1D.writeback(L1::writeback != 0);
+	    caches::SB.configure(SB::N);
+	    operations::SQ.configure(SQ::N, SQ::storesets);
+	    branches::BP.configure(BP::predictor, BP::entries, BP::history, BP::btb);
+	    zeroctrs();								// maps the architected registers to the new register files
+	}
+
+	void	init(int &argc, char **argv)
+	{
+	    const char *path = getenv("PIPELINED_CONFIG");
+	    bool ok = !path || load(path);
+	    int n = 1;
+	    for (int i=1; i<argc; i++)
+	    {
+		std::string arg = argv[i];
+		size_t eq = arg.find('=');
+		if ((arg == "-c") && (i + 1 < argc))					ok = load(argv[++i]) && ok;
+		else if ((eq != std::string::npos) && (arg.find('.') < eq))	ok = set(arg.substr(0, eq), arg.substr(eq + 1)) && ok;
+		else								argv[n++] = argv[i];	// not ours
+	    }
+	    argc = n; argv[argc] = 0;
+	    std::string why = check();
+	    if (!why.empty()) { std::cerr << "params: " << why << std::endl; ok = false; }
+	    if (!ok) exit(1);
+	    configure();
+	}
+    };
+
     namespace operations
     {
-	bool process(operation* op, u64 dispatch) { return op->process(dispatch); } 
+	bool process(operation* op, u64 dispatch)
+	{
+	    bool taken = op->process(dispatch);
+	    delete op;								// back to the pool
+	    return taken;
+	}
+    };
+
+    namespace branches
+    {
+	const u32	predictor::lengths[ntagged] = { 4, 8, 16, 32 };
+
+	static u32	fold(u64 history, u32 length, u32 bits)		// the newest length bits of history, xored down to bits bits
+	{
+	    u64 h = history & (((u64)1 << length) - 1);
+	    u32 f = 0;
+	    for (; h; h >>= bits) f ^= h & ((1u << bits) - 1);
+	    return f;
+	}
+
+	void	predictor::configure(params::predictor_t kind, u32 entries, u32 history, u32 btb)
+	{
+	    _kind = kind;
+	    _history = history;
+	    _counters.resize(entries);
+	    _tagged.resize((kind == params::TAGE) ? ntagged * (entries / 4) : 0);	// each tagged table has a quarter of the entries of the base one
+	    _btb.resize(btb);
+	    clear();
+	}
+
+	void	predictor::clear()
+	{
+	    tagged_t T = { 0, 0, 0 };						// tag 0 never matches
+	    btb_t B = { invalid, 0 };
+	    std::fill(_counters.begin(), _counters.end(), 1);			// weakly not taken
+	    std::fill(_tagged.begin(), _tagged.end(), T);
+	    std::fill(_btb.begin(), _btb.end(), B);
+	    _sites.clear();
+	    _ghr = 0;
+	    _clock = 0;
+	    predicted = 0;
+	    mispredicted = 0;
+	    btbmisses = 0;
+	    redirects = 0;
+	}
+
+	bool	predictor::bimodal(u32 ix, bool taken)
+	{
+	    u8 &c = _counters[ix];
+	    bool guess = c >= 2;
+	    if (taken && (c < 3)) c++;
+	    if (!taken && (c > 0)) c--;
+	    return guess;
+	}
+
+	bool	predictor::tage(u32 pc, bool taken)
+	{
+	    u32 n = _tagged.size() / ntagged, bits = __builtin_ctz(n);
+	    u32 ix[ntagged], tag[ntagged];
+	    i32 provider = -1, alternate = -1;					// the tables with the longest and second longest matching history
+	    for (u32 t=0; t<ntagged; t++)
+	    {
+		ix[t] = t*n + (((pc / 4) ^ fold(_ghr, lengths[t], bits)) & (n - 1));
+		tag[t] = 0x400 | (((pc / 4) ^ fold(_ghr, lengths[t], 10) ^ (fold(_ghr, lengths[t], 9) << 1)) & 0x3ff);
+		if (_tagged[ix[t]].tag == tag[t]) { alternate = provider; provider = t; }
+	    }
+	    u32 base = (pc / 4) & (_counters.size() - 1);
+	    bool alt = (alternate >= 0) ? (_tagged[ix[alternate]].ctr >= 4) : (_counters[base] >= 2);
+	    bool guess = alt;
+	    if (provider < 0) guess = bimodal(base, taken);
+	    else
+	    {
+		tagged_t &P = _tagged[ix[provider]];
+		guess = P.ctr >= 4;
+		if (taken && (P.ctr < 7)) P.ctr++;
+		if (!taken && (P.ctr > 0)) P.ctr--;
+		if ((guess != alt) && (guess == taken) && (P.u < 3)) P.u++;	// useful: it was right where the shorter history was wrong
+		if ((guess != alt) && (guess != taken) && (P.u > 0)) P.u--;
+	    }
+	    if ((guess != taken) && (provider + 1 < (i32)ntagged))		// take an entry in a table with a longer history
+	    {
+		u32 t = provider + 1;
+		while ((t < ntagged) && _tagged[ix[t]].u) t++;
+		if (t < ntagged) { tagged_t E = { (u16)tag[t], (u8)(taken ? 4 : 3), 0 }; _tagged[ix[t]] = E; }
+		else for (t = provider + 1; t < ntagged; t++) _tagged[ix[t]].u--;	// none free: make room for next time
+	    }
+	    if (++_clock % aging == 0) for (u32 i=0; i<_tagged.size(); i++) _tagged[i].u >>= 1;
+	    return guess;
+	}
+
+	bool	predictor::direction(u32 pc, bool taken)
+	{
+	    u32 mask = _counters.size() - 1;
+	    bool guess;
+	    switch (_kind)
+	    {
+		case params::BIMODAL:	guess = bimodal((pc / 4) & mask, taken); break;
+		case params::GSHARE:	guess = bimodal(((pc / 4) ^ (u32)(_ghr & (((u64)1 << _history) - 1))) & mask, taken); break;
+		default:		guess = tage(pc, taken); break;
+	    }
+	    _ghr = (_ghr << 1) | taken;
+	    return guess;
+	}
+
+	void	predictor::resolve(u32 pc, bool conditional, bool taken, u32 target, u64 decoded)
+	{
+	    if (pc / 4 >= _sites.size()) { site_t S = { 0, 0, 0, 0 }; _sites.resize(pc / 4 + 1, S); }
+	    site_t &S = _sites[pc / 4];
+	    S.executed++;
+	    if (taken) S.taken++;
+	    bool guess = true;							// an unconditional branch is always taken
+	    if (conditional)
+	    {
+		predicted++;
+		guess = direction(pc, taken);
+		if (guess != taken) { mispredicted++; S.mispredicted++; }
+	    }
+	    btb_t *B = _btb.empty() ? 0 : &_btb[(pc / 4) % _btb.size()];
+	    bool hit = B && (B->pc == pc);
+	    bool wrong = guess && hit && (!taken || (B->target != target));	// fetch went on at the target the BTB had
+	    if (taken && !wrong)
+	    {
+		if (!guess) wrong = true;					// fetch went on past it
+		else if (!hit)							// the target is known once the branch is decoded
+		{
+		    btbmisses++; S.btbmisses++;
+		    counters::lastfetch = max(counters::lastfetch, decoded);
+		}
+	    }
+	    if (taken && B) { B->pc = pc; B->target = target; }
+	    if (wrong) { redirects++; counters::lastfetch = counters::lastcompleted + params::BP::penalty; }
+	}
+
+	void	predictor::save(checkpoint::writer &W, const std::string &name) const
+	{
+	    u64 state[6] = { _ghr, _clock, predicted, mispredicted, btbmisses, redirects };
+	    W.put(name + ".state", state);
+	    W.put(name + ".counters", _counters);
+	    W.put(name + ".tagged", _tagged);
+	    W.put(name + ".btb", _btb);
+	    W.put(name + ".sites", _sites);
+	}
+
+	void	predictor::restore(const checkpoint::reader &R, const std::string &name)
+	{
+	    u64 size[3] = { _counters.size(), _tagged.size(), _btb.size() };
+	    u64 state[6];
+	    R.get(name + ".state", state);
+	    _ghr = state[0]; _clock = state[1]; predicted = state[2]; mispredicted = state[3]; btbmisses = state[4]; redirects = state[5];
+	    R.get(name + ".counters", _counters);
+	    R.get(name + ".tagged", _tagged);
+	    R.get(name + ".btb", _btb);
+	    R.get(name + ".sites", _sites);
+	    assert((_counters.size() == size[0]) && (_tagged.size() == size[1]) && (_btb.size() == size[2]));	// restored with the parameters
+	}
     };
 
     namespace instructions
@@ -619,13 +2758,261 @@ namespace pipelined
 	{ 
 	    inst->count() = counters::instructions;
 	    counters::instructions++;
+	    CIA = inst->addr();
 	    inst->fetch();	// fetch time
 	    inst->decode();	// decode time
 	    inst->dispatch();	// dispatch time
 	    if (tracing) inst->output(std::cout);
 	    bool taken = inst->process();
-	    if (taken) counters::lastfetch = counters::lastcompleted;
+	    if (branches::BP.active())
+	    {
+		instruction::branch_t kind = inst->branch();
+		if (kind != instruction::NOBRANCH) branches::BP.resolve(inst->addr(), kind == instruction::CONDITIONAL, taken, NIA, inst->decoded());
+	    }
+	    else if (taken) counters::lastfetch = counters::lastcompleted + params::BP::penalty;	// fetch went on past it
+	    if (taken) counters::taken++;
 	    return taken;
 	}
+
+	void flush()
+	{
+	    for (u32 i=0; i<dcache.size(); i++) delete dcache[i].inst;	// back to the pool
+	    dcache.clear();
+	}
+    };
+
+    namespace checkpoint
+    {
+	static const u64	layout = sizeof(preg<u64>) | sizeof(preg<vector>) << 8 | sizeof(flags_t) << 16 | sizeof(header_t) << 32;
+
+	static u64	align(u64 offset)	{ return (offset + page - 1) / page * page; }
+
+	bool	writer::open(const char *path)
+	{
+	    close();
+	    _file = fopen(path, "wb");
+	    if (!_file) return false;
+	    memset(&_header, 0, sizeof(_header));
+	    std::copy(magic, magic + sizeof(magic), _header.magic);
+	    _header.layout = layout;
+	    _end = align(sizeof(_header));
+	    return true;
+	}
+
+	void	writer::put(const std::string &name, const void *data, u64 size)
+	{
+	    assert(_file);
+	    assert(_header.nsections < maxsections);
+	    assert(name.size() < sizeof(_header.table[0].name));
+	    section_t &S = _header.table[_header.nsections++];
+	    strcpy(S.name, name.c_str());
+	    S.offset = _end;
+	    S.size = size;
+	    fseek(_file, S.offset, SEEK_SET);
+	    fwrite(data, 1, size, _file);
+	    _end = align(S.offset + size);
+	}
+
+	void	writer::append(const void *data, u64 size)
+	{
+	    assert(_file);
+	    assert(_header.nsections > 0);
+	    section_t &S = _header.table[_header.nsections - 1];
+	    fwrite(data, 1, size, _file);						// right where the section ends so far
+	    S.size += size;
+	    _end = align(S.offset + S.size);
+	}
+
+	bool	writer::close()
+	{
+	    if (!_file) return true;
+	    fseek(_file, 0, SEEK_SET);
+	    fwrite(&_header, 1, sizeof(_header), _file);
+	    bool ok = !ferror(_file);
+	    ok = (fclose(_file) == 0) && ok;
+	    _file = 0;
+	    return ok;
+	}
+
+	bool	reader::open(const char *path)
+	{
+	    close();
+	    int fd = ::open(path, O_RDONLY);
+	    struct stat st;
+	    if ((fd < 0) || fstat(fd, &st))
+	    {
+		std::cerr << "checkpoint: cannot read " << path << std::endl;
+		if (fd >= 0) ::close(fd);
+		return false;
+	    }
+	    _length = st.st_size;
+	    void *base = (_length >= sizeof(header_t)) ? mmap(0, _length, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+	    ::close(fd);								// the mapping stays
+	    if (base == MAP_FAILED)
+	    {
+		std::cerr << "checkpoint: " << path << " is not a checkpoint" << std::endl;
+		return false;
+	    }
+	    _base = (const u8*)base;
+	    _header = (const header_t*)_base;
+	    std::string why;
+	    if (!std::equal(magic, magic + sizeof(magic), _header->magic))	why = "is not a checkpoint";
+	    else if (_header->layout != layout)				why = "was written by a different build";
+	    else if (_header->nsections > maxsections)				why = "is corrupt";
+	    else for (u32 i=0; i<_header->nsections; i++)
+	    {
+		const section_t &S = _header->table[i];
+		if ((S.offset % page) || (S.offset > _length) || (S.size > _length - S.offset)) why = "is truncated";
+	    }
+	    if (!why.empty())
+	    {
+		std::cerr << "checkpoint: " << path << " " << why << std::endl;
+		close();
+		return false;
+	    }
+	    return true;
+	}
+
+	void	reader::close()
+	{
+	    if (_base) munmap((void*)_base, _length);
+	    _base = 0; _length = 0; _header = 0;
+	}
+
+	const u8*	reader::get(const std::string &name, u64 &size) const
+	{
+	    assert(_header);
+	    for (u32 i=0; i<_header->nsections; i++)
+	    {
+		const section_t &S = _header->table[i];
+		if (name != S.name) continue;
+		size = S.size;
+		return _base + S.offset;
+	    }
+	    assert(false);								// every section is always saved
+	    return 0;
+	}
+
+	template<typename T> static std::vector<u32> indices(const std::vector<T> &R)	// the physical registers architected registers R are mapped to
+	{
+	    std::vector<u32> I;
+	    for (u32 i=0; i<R.size(); i++) I.push_back(R[i].idx());
+	    return I;
+	}
+
+	bool	save(const char *path)
+	{
+	    assert(!functional::active);						// the timing state is only meaningful in timing mode
+	    writer W;
+	    if (!W.open(path))
+	    {
+		std::cerr << "checkpoint: cannot write " << path << std::endl;
+		return false;
+	    }
+
+	    std::string P;								// the parameters, as in a config file
+	    std::vector<std::string> keys = params::keys();
+	    for (u32 i=0; i<keys.size(); i++) P += keys[i] + " = " + params::get(keys[i]) + "\n";
+	    W.put("params", P.data(), P.size());
+
+	    u64 C[] = { counters::instructions, counters::operations, counters::cycles, counters::lastissued, counters::lastcompleted,
+			counters::lastfetch, counters::lastfetched, functional::instructions, PRF::next, PRF::stalls, VRF::next, VRF::stalls, counters::taken };
+	    u32 IA[] = { CIA, NIA };
+	    W.put("counters", C);
+	    W.put("IA", IA);
+	    W.put("flags", flags);
+	    W.put("GPR", indices(GPR));
+	    W.put("FPR", indices(FPR));
+	    W.put("VR", indices(VR));
+	    W.put("PRF.R", PRF::R);
+	    W.put("VRF.V", VRF::V);
+	    units::LDU.save(W, "units.LDU");
+	    units::STU.save(W, "units.STU");
+	    units::FXU.save(W, "units.FXU");
+	    units::FPU.save(W, "units.FPU");
+	    units::BRU.save(W, "units.BRU");
+	    units::VU .save(W, "units.VU");
+	    operations::issued.save(W, "issued");
+	    caches::L1D.save(W, "L1D");
+	    caches::L1I.save(W, "L1I");
+	    caches::L2 .save(W, "L2");
+	    caches::L3 .save(W, "L3");
+	    caches::SB .save(W, "SB");
+	    operations::SQ.save(W, "SQ");
+	    branches::BP.save(W, "BP");
+	    std::vector<u32> pages = MEM.pages();					// last, the bulk of the file: the touched pages only
+	    W.put("MEM.pages", pages);
+	    W.put("MEM", 0, 0);
+	    for (u32 i=0; i<pages.size(); i++) W.append(MEM.data() + (u64)pages[i]*memory::page, memory::page);
+
+	    if (!W.close())
+	    {
+		std::cerr << "checkpoint: error writing " << path << std::endl;
+		return false;
+	    }
+	    return true;
+	}
+
+	bool	restore(const char *path)
+	{
+	    assert(!functional::active);
+	    reader R;
+	    if (!R.open(path)) return false;
+
+	    u64 size;
+	    const char *P = (const char*)R.get("params", size);
+	    std::string text(P, P + size);
+	    bool ok = true;
+	    for (size_t b = 0, e; b < text.size(); b = e + 1)
+	    {
+		e = text.find('\n', b);
+		std::string L = text.substr(b, e - b);
+		size_t eq = L.find(" = ");
+		ok = (eq != std::string::npos) && params::set(L.substr(0, eq), L.substr(eq + 3)) && ok;
+	    }
+	    if (!ok || !params::check().empty())
+	    {
+		std::cerr << "checkpoint: " << path << " has bad parameters" << std::endl;
+		return false;
+	    }
+	    params::configure();							// the geometry of everything below, and a clean machine
+
+	    u64 C[13]; u32 IA[2];
+	    R.get("counters", C);
+	    counters::instructions = C[0]; counters::operations = C[1]; counters::cycles = C[2]; counters::lastissued = C[3]; counters::lastcompleted = C[4];
+	    counters::lastfetch = C[5]; counters::lastfetched = C[6]; functional::instructions = C[7]; PRF::next = C[8]; PRF::stalls = C[9]; VRF::next = C[10]; VRF::stalls = C[11]; counters::taken = C[12];
+	    R.get("IA", IA);
+	    CIA = IA[0]; NIA = IA[1];
+	    R.get("flags", flags);
+
+	    std::vector<u32> I;
+	    R.get("GPR", I); assert(I.size() == GPR.size()); for (u32 i=0; i<I.size(); i++) GPR[i].idx() = I[i];
+	    R.get("FPR", I); assert(I.size() == FPR.size()); for (u32 i=0; i<I.size(); i++) FPR[i].idx() = I[i];
+	    R.get("VR",  I); assert(I.size() == VR.size());  for (u32 i=0; i<I.size(); i++) VR[i].idx()  = I[i];
+	    R.get("PRF.R", PRF::R); assert(PRF::R.size() == params::PRF::N);
+	    R.get("VRF.V", VRF::V); assert(VRF::V.size() == params::VRF::N);
+	    PRF::free.reset(PRF::R);
+	    VRF::free.reset(VRF::V);
+	    units::LDU.restore(R, "units.LDU");
+	    units::STU.restore(R, "units.STU");
+	    units::FXU.restore(R, "units.FXU");
+	    units::FPU.restore(R, "units.FPU");
+	    units::BRU.restore(R, "units.BRU");
+	    units::VU .restore(R, "units.VU");
+	    operations::issued.restore(R, "issued");
+	    caches::L1D.restore(R, "L1D");
+	    caches::L1I.restore(R, "L1I");
+	    caches::L2 .restore(R, "L2");
+	    caches::L3 .restore(R, "L3");
+	    caches::SB .restore(R, "SB");
+	    operations::SQ.restore(R, "SQ");
+	    branches::BP.restore(R, "BP");
+	    std::vector<u32> pages;
+	    R.get("MEM.pages", pages);
+	    const u8 *data = R.get("MEM", size);
+	    assert(size == pages.size()*memory::page);
+	    for (u32 i=0; i<pages.size(); i++) std::copy(data + (u64)i*memory::page, data + (u64)(i+1)*memory::page, MEM.data() + (u64)pages[i]*memory::page);
+	    return true;
+	}
     };
 };
@@ -0,0 +1,44 @@
+#include<pipelined.hh>
+#include<ISA.hh>
+#include<spmv.hh>
+
+namespace pipelined
+{
+    void spmv				// y = A*x, A in compressed sparse row form
+    (
+        double		*y,	// GPR[3]
+	double		*val,	// GPR[4]: nonzeros, row by row
+	uint32_t	*col,	// GPR[5]: column of each nonzero
+	uint32_t	*rowptr,// GPR[6]: first nonzero of each row, and one past the last
+	double		*x,	// GPR[7]
+	uint32_t	 m	// GPR[8]
+    )
+    {
+
+loopi:	cmpi(r8, 0);			// m == 0?
+	beq(end);			// while (m != 0)
+	lwz(r9, r6);			// r9 = rowptr[i]
+	addi(r6, r6, 4);		// rowptr++
+	lwz(r10, r6);			// r10 = rowptr[i+1]
+	sub(r10, r10, r9);		// r10 = nonzeros in row i
+	zd(f0);				// f0 = 0
+loopk:	cmpi(r10, 0);			// no more nonzeros?
+	beq(nexti);			// while (nonzeros != 0)
+	lwz(r11, r5);			// r11 = col[k]
+	muli(r11, r11, 8);		// r11 = 8*col[k]
+	add(r11, r11, r7);		// r11 = &x[col[k]]
+	lfd(f1, r11);			// f1 = x[col[k]]
+	lfd(f2, r4);			// f2 = val[k]
+	fmul(f3, f2, f1);		// f3 = val[k]*x[col[k]]
+	fadd(f0, f0, f3);		// f0 += val[k]*x[col[k]]
+	addi(r4, r4, 8);		// val++
+	addi(r5, r5, 4);		// col++
+	addi(r10, r10, -1);		// nonzeros--
+	b(loopk);
+nexti:	stfd(f0, r3);			// y[i] = f0
+	addi(r3, r3, 8);		// y++
+	addi(r8, r8, -1);		// m--
+	b(loopi);
+end:	return;
+    }
+};
@@ -0,0 +1,89 @@
+#include<pipelined.hh>
+#include<sgemv.hh>
+#include<stdio.h>
+#include<sstream>
+#include"kernels.hh"
+
+using namespace pipelined;
+
+// Runs sgemv, whose inner loop runs m/4 times per column, with no branch predictor and with each one. Checks that
+// the results are still right, that the records of the static branches in the statistics add up to the counters, that with no
+// penalty any predictor saves cycles over none, that gshare and TAGE learn the short loops that bimodal mispredicts
+// at every exit (and TAGE the longer ones too), that mispredictions cost the penalty and that with no BTB the taken
+// branches that were predicted wait for decode.
+
+typedef struct
+{
+    u64		cycles;
+    u64		mispredicted;
+    u64		btbmisses;
+} result_t;
+
+static bool	configure(const char *predictor, u32 btb, u32 penalty)
+{
+    bool ok = params::set("BP.predictor", predictor);
+    ok = params::set("BP.btb", std::to_string(btb)) && params::set("BP.penalty", std::to_string(penalty)) && ok;
+    params::configure();
+    return ok;
+}
+
+static bool	consistent()							// the records of the static branches in the statistics add up to the counters
+{
+    std::stringstream csv;
+    stats::csv(csv);
+    std::string line;
+    u64 executed = 0, mispredicted = 0, btbmisses = 0;
+    while (std::getline(csv, line))
+    {
+	if (line.compare(0, 15, "branches.sites.") != 0) continue;
+	std::string name = line.substr(0, line.find(','));
+	u64 n = std::stoull(line.substr(line.find(',') + 1));
+	if (name.find(".executed") != std::string::npos) executed += n;
+	if (name.find(".mispredicted") != std::string::npos) mispredicted += n;
+	if (name.find(".btb_misses") != std::string::npos) btbmisses += n;
+    }
+    const branches::predictor &P = branches::BP;
+    return !P.active() || ((executed == units::BRU.operations) && (mispredicted == P.mispredicted) && (btbmisses == P.btbmisses));
+}
+
+static result_t	columns(u32 m, u32 n, bool &pass)			// sgemv: y += A*x, a column at a time
+{
+    kernels::columns(m, n);
+    sgemv(0,0,0,m,n,m);
+    result_t R = { counters::cycles, branches::BP.mispredicted, branches::BP.btbmisses };
+    pass = consistent() && kernels::columnsok(m, n) && pass;
+    return R;
+}
+
+int main
+(
+    int		  argc,
+    char	**argv
+)
+{
+    pipelined::params::init(argc, argv);
+
+    typedef struct { const char *predictor; u32 btb, penalty; } config_t;
+    const config_t configs[] = { { "none", 512, 0 }, { "bimodal", 512, 0 }, { "gshare", 512, 0 }, { "tage", 512, 0 }, { "bimodal", 512, 20 }, { "tage", 0, 0 } };
+    bool pass = true;
+    result_t none[2], bimodal[2], gshare[2];
+    for (u32 c=0; c<sizeof(configs)/sizeof(configs[0]); c++)
+    {
+	const config_t &C = configs[c];
+	bool ok = configure(C.predictor, C.btb, C.penalty);
+	result_t R[2] = { columns(8, 256, ok), columns(64, 256, ok) };	// 2 and 16 iterations of the inner loop
+	std::string kind = C.predictor;
+	if (kind == "none") { none[0] = R[0]; none[1] = R[1]; ok = (R[0].mispredicted == 0) && ok; }
+	else if (!C.penalty) for (u32 k=0; k<2; k++) ok = (R[k].cycles < none[k].cycles) && ok;
+	if (kind == "bimodal" && !C.penalty) { bimodal[0] = R[0]; bimodal[1] = R[1]; }
+	if (kind == "gshare") { gshare[0] = R[0]; gshare[1] = R[1]; ok = (R[0].mispredicted*10 < bimodal[0].mispredicted) && ok; }
+	if (kind == "tage" && C.btb) ok = (R[0].mispredicted <= gshare[0].mispredicted) && (R[1].mispredicted*10 < gshare[1].mispredicted) && ok;
+	if (C.penalty) for (u32 k=0; k<2; k++) ok = (R[k].mispredicted == bimodal[k].mispredicted) && (R[k].cycles > bimodal[k].cycles) && ok;
+	if (!C.btb) ok = (R[1].btbmisses + R[1].mispredicted >= counters::taken) && ok;	// the taken ones not mispredicted
+	printf("%-8s BTB = %3u, penalty = %2u : m = 8 cyc = %6lu, mispredicted = %4lu; m = 64 cyc = %6lu, mispredicted = %4lu, BTB misses = %4lu | %s\n",
+	       C.predictor, C.btb, C.penalty, R[0].cycles, R[0].mispredicted, R[1].cycles, R[1].mispredicted, R[1].btbmisses, kernels::verdict(ok));
+	pass = ok && pass;
+    }
+    configure("none", 512, 0);
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,135 @@
+#include<pipelined.hh>
+#include<mxv.hh>
+#include<stdio.h>
+#include<chrono>
+
+using namespace pipelined;
+
+// Warms up the machine with a run of mxv and checkpoints it. Then runs mxv again straight on, and again
+// after scrambling the machine (other data, other parameters) and restoring the checkpoint: the two runs
+// must be identical, cycle by cycle, for each replacement policy.
+
+static const char	path[] = "checkpoint.ckpt";
+static const u32	footprint = 1 << 20;		// bytes of MEM the runs use
+
+typedef struct
+{
+    u64			instructions;
+    u64			cycles;
+    u64			lastcompleted;
+    u64			hits[4];	// L1D, L1I, L2, L3
+    u64			misses[4];
+    std::vector<u8>	mem;		// the footprint, after writing back the caches
+} result_t;
+
+static double	seconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void	setup(u32 m, u32 n)
+{
+    const u32 Y = 0;
+    const u32 X = Y + m*sizeof(double);
+    const u32 A = X + n*sizeof(double);
+
+    zeromem();
+    for (u32 i=0; i<m; i++) *((double*)(MEM.data() + Y + i*sizeof(double))) = 0.0;
+    for (u32 j=0; j<n; j++) *((double*)(MEM.data() + X + j*sizeof(double))) = (double)j;
+    for (u32 i=0; i<m; i++) for (u32 j=0; j<n; j++) *((double*)(MEM.data() + A + (i*n+j)*sizeof(double))) = (double)i;
+    zeroctrs();
+}
+
+static void	arguments(u32 m, u32 n)
+{
+    GPR[3].data() = 0;
+    GPR[4].data() = (m + n)*sizeof(double);
+    GPR[5].data() = m*sizeof(double);
+    GPR[6].data() = m;
+    GPR[7].data() = n;
+}
+
+static result_t	run()
+{
+    mxv(0,0,0,0,0);
+    result_t R;
+    R.instructions = counters::instructions;
+    R.cycles = counters::cycles;
+    R.lastcompleted = counters::lastcompleted;
+    caches::cache *C[4] = { &caches::L1D, &caches::L1I, &caches::L2, &caches::L3 };
+    for (u32 i=0; i<4; i++) { R.hits[i] = C[i]->hits; R.misses[i] = C[i]->misses; }
+    caches::L2.flush();
+    caches::L3.flush();
+    caches::L1D.flush();
+    R.mem.assign(MEM.data(), MEM.data() + footprint);
+    return R;
+}
+
+static bool	same(const result_t &A, const result_t &B)
+{
+    return (A.instructions == B.instructions) && (A.cycles == B.cycles) && (A.lastcompleted == B.lastcompleted)
+	&& std::equal(A.hits, A.hits + 4, B.hits) && std::equal(A.misses, A.misses + 4, B.misses) && (A.mem == B.mem);
+}
+
+static bool	compare(const char *policy, u32 m, u32 n)
+{
+    params::set("L1.replacement", policy);
+    params::set("L2.replacement", policy);
+    params::set("L3.replacement", policy);
+    params::configure();
+
+    setup(m, n);
+    double t0 = seconds();
+    arguments(m, n);
+    mxv(0,0,0,0,0);						// the warm-up
+    double t1 = seconds();
+    arguments(m, n);
+    bool saved = checkpoint::save(path);
+    result_t A = run();
+
+    params::set("L1.nsets", "16");				// scramble the machine
+    params::set("L2.replacement", "random");
+    params::configure();
+    setup(n, m);
+    arguments(n, m);
+    mxv(0,0,0,0,0);
+
+    double t2 = seconds();
+    bool restored = checkpoint::restore(path);
+    double t3 = seconds();
+    result_t B = run();
+
+    bool pass = saved && restored && same(A, B) && (params::get("L2.replacement") == policy);
+    printf("%-6s M = %4d, N = %4d : cyc = %8lu (straight on) %8lu (restored), warm-up %7.4f s, restore %7.4f s | %s\n",
+	   policy, m, n, A.cycles, B.cycles, t1 - t0, t3 - t2, pass ? "PASS" : "FAIL");
+    return pass;
+}
+
+int main
+(
+    int		  argc,
+    char	**argv
+)
+{
+    pipelined::params::init(argc, argv);
+
+    bool pass = true;
+    const char *policies[] = { "lru", "plru", "srrip", "brrip", "random" };
+    for (u32 p=0; p<5; p++) pass = compare(policies[p], 16, 2048) && pass;
+    pass = compare("lru", 64, 64) && pass;
+    params::set("L1.prefetcher", "stride");			// with the prefetchers in flight
+    params::set("L2.prefetcher", "stream");
+    pass = compare("lru", 16, 2048) && pass;
+    params::set("L1.mshrs", "8");				// and with misses in flight
+    params::set("L3.mshrs", "4");
+    pass = compare("lru", 16, 2048) && pass;
+    params::set("L1.writeback", "1");				// and with stores in the store buffer
+    params::set("SB.N", "8");
+    pass = compare("lru", 16, 2048) && pass;
+    params::set("SQ.N", "16");					// and with stores in the store queue
+    pass = compare("lru", 16, 2048) && pass;
+    params::set("BP.predictor", "tage");			// and with a trained branch predictor
+    pass = compare("lru", 16, 2048) && pass;
+    remove(path);
+    return pass ? 0 : 1;
+}
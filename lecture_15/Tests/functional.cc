@@ -0,0 +1,110 @@
+#include<pipelined.hh>
+#include<mxv.hh>
+#include<memcpy.hh>
+#include<vmemcpy.hh>
+#include<stdio.h>
+#include<string.h>
+#include<chrono>
+
+using namespace pipelined;
+
+// Runs the kernels in timing and in functional mode; both must leave the same architected state (memory),
+// and the functional run must execute the same number of instructions. Then switches modes between
+// dependent copies, so that each mode has to see the data written by the other.
+
+static const u32	footprint = 1 << 20;		// bytes of MEM the kernels use, compared between modes
+
+static double	seconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void	setup_mxv(u32 m, u32 n)
+{
+    const u32 Y = 0;
+    const u32 X = Y + m*sizeof(double);
+    const u32 A = X + n*sizeof(double);
+
+    zeromem();
+    for (u32 i=0; i<m; i++) *((double*)(MEM.data() + Y + i*sizeof(double))) = 0.0;
+    for (u32 j=0; j<n; j++) *((double*)(MEM.data() + X + j*sizeof(double))) = (double)j;
+    for (u32 i=0; i<m; i++) for (u32 j=0; j<n; j++) *((double*)(MEM.data() + A + (i*n+j)*sizeof(double))) = (double)i;
+
+    zeroctrs();
+    GPR[3].data() = Y;
+    GPR[4].data() = A;
+    GPR[5].data() = X;
+    GPR[6].data() = m;
+    GPR[7].data() = n;
+}
+
+static bool	compare_mxv(u32 m, u32 n)		// same memory and instruction count in both modes
+{
+    setup_mxv(m, n);
+    double t0 = seconds();
+    mxv(0,0,0,0,0);
+    double t1 = seconds();
+    caches::L2.flush();
+    caches::L3.flush();
+    std::vector<u8> timing(MEM.data(), MEM.data() + footprint);
+    u64 instructions = counters::instructions;
+    u64 cycles = counters::cycles;
+
+    setup_mxv(m, n);
+    double t2 = seconds();
+    {
+	functional::region fast;
+	mxv(0,0,0,0,0);
+    }
+    double t3 = seconds();
+
+    bool same = std::equal(timing.begin(), timing.end(), MEM.data()) && (functional::instructions == instructions) && (counters::cycles == 0);
+    printf("mxv M = %4d, N = %4d : instr = %8lu (functional %8lu), cyc = %8lu, speedup = %8.1f | %s\n",
+	   m, n, instructions, functional::instructions, cycles, (t1 - t0)/(t3 - t2), same ? "PASS" : "FAIL");
+    return same;
+}
+
+static void	copy(u32 to, u32 from, u32 n, bool functional, bool vector)
+{
+    if (functional) functional::enter();
+    GPR[3].data() = to;
+    GPR[4].data() = from;
+    GPR[5].data() = n;
+    if (vector) pipelined::vmemcpy(0,0,0);
+    else        pipelined::memcpy(0,0,0);
+    if (functional) functional::leave();
+}
+
+static bool	switching(u32 n)				// each mode must read what the other mode wrote last
+{
+    const u32 A = 0, B = 4096, D = 8192, E = 12288, F = 16384;
+    zeromem();
+    zeroctrs();
+    for (u32 i=0; i<n; i++) { MEM[A + i] = rand() & 0xff; MEM[B + i] = rand() & 0xff; }
+
+    copy(D, A, n, false, false);			// D is now in the caches
+    copy(D, B, n, true,  true);				// overwritten in MEM: the cached copy must not be used
+    copy(E, D, n, false, true);				// E is modified in the caches only
+    copy(F, E, n, true,  false);			// so it must be written back before functional mode reads it
+    caches::L2.flush();
+    caches::L3.flush();
+
+    bool same = true;
+    for (u32 i=0; i<n; i++) if ((MEM[E + i] != MEM[B + i]) || (MEM[F + i] != MEM[B + i])) same = false;
+    printf("switching n = %4d : instr = %8lu timing + %8lu functional | %s\n", n, counters::instructions, functional::instructions, same ? "PASS" : "FAIL");
+    return same;
+}
+
+int main
+(
+    int		  argc,
+    char	**argv
+)
+{
+    pipelined::params::init(argc, argv);
+
+    bool pass = true;
+    for (u32 m = 4; m <= 32; m *= 2) for (u32 n = m; n <= 256; n *= 4) pass = compare_mxv(m, n) && pass;
+    for (u32 n = 1; n <= 4096; n *= 8) pass = switching(n) && pass;
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,127 @@
+#include<pipelined.hh>
+#include<sgemv.hh>
+#include<stdio.h>
+#include<chrono>
+
+using namespace pipelined;
+
+// Builds the sgemv inputs with loops, as Tests/sgemv.cc does, and saves them as a memory image. Then loads
+// the image into a cleared MEM and runs sgemv again: the cycles and the output region must be the same, and
+// the files the inputs were mapped from must not change when MEM is written.
+
+static const char	path[] = "image.img";
+
+static double	seconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static const u32	Y = 0x00000000;			// on page boundaries, so that they are mapped
+static const u32	X = 0x00100000;
+static const u32	A = 0x00200000;
+static const u32	S = 0x00000ff8;			// m and n, off a page boundary, so that they are copied
+
+static void	build(u32 m, u32 n)
+{
+    zeromem();
+    for (u32 i=0; i<m; i++) *((float*)(MEM.data() + Y + i*sizeof(float))) = 0.0;
+    for (u32 j=0; j<n; j++) *((float*)(MEM.data() + X + j*sizeof(float))) = 1.0;
+    for (u32 i=0; i<m; i++) for (u32 j=0; j<n; j++) *((float*)(MEM.data() + A + (i+m*j)*sizeof(float))) = (float)i;
+    *((u32*)(MEM.data() + S)) = m;
+    *((u32*)(MEM.data() + S + 4)) = n;
+    image::regions.clear();
+    image::define("S", S, 8);
+    image::define("x", X, n*sizeof(float));
+    image::define("A", A, m*n*sizeof(float));
+}
+
+static u64	run()
+{
+    u32 m = *((u32*)(MEM.data() + S));
+    u32 n = *((u32*)(MEM.data() + S + 4));
+    zeroctrs();
+    GPR[3].data() = Y;
+    GPR[4].data() = A;
+    GPR[5].data() = X;
+    GPR[6].data() = m;
+    GPR[7].data() = n;
+    GPR[8].data() = m;
+    sgemv((float*)(MEM.data() + Y), (float*)(MEM.data() + A), (float*)(MEM.data() + X), m, n, m);
+    caches::L2.flush();
+    caches::L3.flush();
+    return counters::cycles;
+}
+
+static bool	contents(const char *file, const u8 *data, u64 size)	// does file hold exactly size bytes of data?
+{
+    FILE *F = fopen(file, "rb");
+    if (!F) return false;
+    std::vector<u8> buf(size + 1);
+    bool same = (fread(buf.data(), 1, size + 1, F) == size) && std::equal(data, data + size, buf.data());
+    fclose(F);
+    return same;
+}
+
+static bool	compare(u32 m, u32 n)
+{
+    double t0 = seconds();
+    build(m, n);
+    double t1 = seconds();
+    bool pass = image::save(path);
+    std::vector<u8> A0(MEM.data() + A, MEM.data() + A + m*n*sizeof(float));
+    u64 built = run();
+    std::vector<u8> y(MEM.data() + Y, MEM.data() + Y + m*sizeof(float));
+    for (u32 i=0; i<m; i++) if (((float*)y.data())[i] != (float)n*i) pass = false;
+
+    zeromem();
+    image::regions.clear();
+    double t2 = seconds();
+    pass = image::load(path) && pass;
+    double t3 = seconds();
+    pass = (image::regions.size() == 3) && (image::find("A")->size == m*n*sizeof(float)) && pass;
+    u64 loaded = run();
+    pass = (loaded == built) && std::equal(y.begin(), y.end(), MEM.data() + Y) && pass;
+
+    image::define("y", Y, m*sizeof(float));					// the output region
+    pass = image::dump("y", "image.y") && contents("image.y", y.data(), y.size()) && pass;
+    MEM[A] = ~MEM[A];								// copy-on-write: the input file keeps its contents
+    pass = contents("image.img.A", A0.data(), A0.size()) && pass;
+
+    printf("sgemv M = %4d, N = %6d : cyc = %8lu (built) %8lu (loaded), built in %7.4f s, loaded in %7.4f s | %s\n",
+	   m, n, built, loaded, t1 - t0, t3 - t2, pass ? "PASS" : "FAIL");
+    return pass;
+}
+
+static bool	staging(u32 m, u32 n)				// a large input: built once, then only loaded
+{
+    double t0 = seconds();
+    build(m, n);
+    double t1 = seconds();
+    bool pass = image::save(path);
+    std::vector<u8> A0(MEM.data() + A, MEM.data() + A + m*n*sizeof(float));
+    zeromem();
+    image::regions.clear();
+    double t2 = seconds();
+    pass = image::load(path) && pass;
+    double t3 = seconds();
+    pass = std::equal(A0.begin(), A0.end(), MEM.data() + A) && pass;
+    printf("sgemv M = %4d, N = %6d : %lu MiB input, built in %7.4f s, loaded in %7.4f s | %s\n",
+	   m, n, A0.size() >> 20, t1 - t0, t3 - t2, pass ? "PASS" : "FAIL");
+    return pass;
+}
+
+int main
+(
+    int		  argc,
+    char	**argv
+)
+{
+    pipelined::params::init(argc, argv);
+
+    bool pass = true;
+    for (u32 m = 4; m <= 16; m *= 2) for (u32 n = 256; n <= 4096; n *= 4) pass = compare(m, n) && pass;
+    pass = staging(16, 256*1024) && pass;
+    const char *files[] = { "image.img", "image.img.S", "image.img.x", "image.img.A", "image.y" };
+    for (u32 i=0; i<5; i++) remove(files[i]);
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,98 @@
+#ifndef _KERNELS_HH_
+#define _KERNELS_HH_
+
+#include<pipelined.hh>
+
+// The inputs and the checks of the kernels that the tests of the machine features run. A setup clears memory,
+// writes the inputs, zeroes the counters and puts the arguments in the registers; the test then calls the kernel.
+// A check writes back what the caches hold and compares the outputs in MEM with the expected ones.
+
+namespace kernels
+{
+    using namespace pipelined;
+
+    inline const char	*verdict(bool pass)
+    {
+	return pass ? "PASS" : "FAIL";
+    }
+
+    inline void	flush()								// the newest data are in L1D (write-back), so it goes last
+    {
+	caches::L2.flush();
+	caches::L3.flush();
+	caches::L1D.flush();
+    }
+
+    inline void	copyargs(u32 n)							// memcpy and vmemcpy: n bytes from 0 to n
+    {
+	GPR[3].data() = n;
+	GPR[4].data() = 0;
+	GPR[5].data() = n;
+    }
+
+    inline void	copy(u32 n)
+    {
+	zeromem();
+	for (u32 i=0; i<n; i++) MEM[i] = (i * 2654435761u) >> 24;
+	zeroctrs();
+	copyargs(n);
+    }
+
+    inline bool	copied(u32 n)
+    {
+	flush();
+	for (u32 i=0; i<n; i++) if (MEM[n + i] != MEM[i]) return false;
+	return true;
+    }
+
+    inline void	columns(u32 m, u32 n)						// sgemv: y += A*x, a column at a time, with y = 0, x[j] = j and A[i][j] = i
+    {
+	const u32 Y = 0;
+	const u32 X = Y + m*sizeof(float);
+	const u32 A = X + n*sizeof(float);
+
+	zeromem();
+	for (u32 j=0; j<n; j++) *((float*)(MEM.data() + X + j*sizeof(float))) = (float)j;
+	for (u32 i=0; i<m; i++) for (u32 j=0; j<n; j++) *((float*)(MEM.data() + A + (i+m*j)*sizeof(float))) = (float)i;
+	zeroctrs();
+	GPR[3].data() = Y;
+	GPR[4].data() = A;
+	GPR[5].data() = X;
+	GPR[6].data() = m;
+	GPR[7].data() = n;
+	GPR[8].data() = m;
+    }
+
+    inline bool	columnsok(u32 m, u32 n)						// y[i] = i*n*(n-1)/2
+    {
+	flush();
+	for (u32 i=0; i<m; i++) if (*((float*)(MEM.data() + i*sizeof(float))) != (float)((n*(n-1))/2)*i) return false;
+	return true;
+    }
+
+    inline void	rows(u32 m, u32 n)						// mxv: y = A*x, a row at a time, with x[j] = j and A[i][j] = i
+    {
+	const u32 Y = 0;
+	const u32 X = Y + m*sizeof(double);
+	const u32 A = X + n*sizeof(double);
+
+	zeromem();
+	for (u32 j=0; j<n; j++) *((double*)(MEM.data() + X + j*sizeof(double))) = (double)j;
+	for (u32 i=0; i<m; i++) for (u32 j=0; j<n; j++) *((double*)(MEM.data() + A + (i*n+j)*sizeof(double))) = (double)i;
+	zeroctrs();
+	GPR[3].data() = Y;
+	GPR[4].data() = A;
+	GPR[5].data() = X;
+	GPR[6].data() = m;
+	GPR[7].data() = n;
+    }
+
+    inline bool	rowsok(u32 m, u32 n)						// y[i] = i*n*(n-1)/2
+    {
+	flush();
+	for (u32 i=0; i<m; i++) if (*((double*)(MEM.data() + i*sizeof(double))) != (double)((n*(n-1))/2)*i) return false;
+	return true;
+    }
+};
+
+#endif
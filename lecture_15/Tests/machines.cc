@@ -0,0 +1,97 @@
+#include<pipelined.hh>
+#include<mxv.hh>
+#include<stdio.h>
+
+using namespace pipelined;
+
+// Runs the same mxv points on the main thread and then on several machines at once;
+// each machine must reproduce exactly the cycles and cache statistics of the sequential run.
+
+typedef struct
+{
+    u64	cycles;
+    u64	operations;
+    u64	L1Dhits;
+    u64	L2misses;
+    u64	L3misses;
+    bool pass;
+} result_t;
+
+result_t run_mxv(u32 m, u32 n)
+{
+    zeromem();
+
+    const uint32_t Y = 0;
+    const uint32_t X = Y + m*sizeof(double);
+    const uint32_t A = X + n*sizeof(double);
+
+    for (uint32_t i=0; i<m; i++) *((double*)(MEM.data() + Y + i*sizeof(double))) = 0.0;
+    for (uint32_t j=0; j<n; j++) *((double*)(MEM.data() + X + j*sizeof(double))) = (double)j;
+    for (uint32_t i=0; i<m; i++) for (uint32_t j=0; j<n; j++) *((double*)(MEM.data() + A + (i*n+j)*sizeof(double))) = (double)i;
+
+    zeroctrs();
+
+    GPR[3].data() = Y;
+    GPR[4].data() = A;
+    GPR[5].data() = X;
+    GPR[6].data() = m;
+    GPR[7].data() = n;
+
+    mxv(0,0,0,0,0);
+
+    caches::L2.flush();
+    caches::L3.flush();
+
+    result_t R;
+    R.cycles = counters::cycles;
+    R.operations = counters::operations;
+    R.L1Dhits = caches::L1D.hits;
+    R.L2misses = caches::L2.misses;
+    R.L3misses = caches::L3.misses;
+    R.pass = true;
+    for (uint32_t i=0; i<m; i++)
+    {
+	double y = *((double*)(MEM.data() + Y + i*sizeof(double)));
+	if (y != ((n*(n-1))/2)*i) R.pass = false;
+    }
+    return R;
+}
+
+int main
+(
+    int		  argc,
+    char	**argv
+)
+{
+    pipelined::params::init(argc, argv);
+
+    const u32 nmachines = 4;
+    std::vector<std::pair<u32, u32> > points;
+    for (uint32_t m = 2; m <= 64; m *= 2) for (uint32_t n = m/2; n <= m; n *= 2) points.push_back(std::make_pair(m, n));
+    for (uint32_t n = 16; n <= 512; n *= 2) points.push_back(std::make_pair(4, n));
+
+    std::vector<result_t> expected;
+    for (u32 i=0; i<points.size(); i++) expected.push_back(run_mxv(points[i].first, points[i].second));
+
+    std::vector<std::future<result_t> > results;
+    {
+	std::vector<std::unique_ptr<machine> > machines;
+	for (u32 k=0; k<nmachines; k++) machines.push_back(std::unique_ptr<machine>(new machine()));
+	for (u32 i=0; i<points.size(); i++)
+	{
+	    u32 m = points[i].first; u32 n = points[i].second;
+	    results.push_back(machines[i % nmachines]->run([m, n]() { return run_mxv(m, n); }));
+	}
+    }
+
+    bool pass = true;
+    for (u32 i=0; i<points.size(); i++)
+    {
+	result_t R = results[i].get();
+	result_t E = expected[i];
+	bool same = R.pass && (R.cycles == E.cycles) && (R.operations == E.operations) && (R.L1Dhits == E.L1Dhits) && (R.L2misses == E.L2misses) && (R.L3misses == E.L3misses);
+	printf("M = %4d, N = %4d : instr = %6lu, cyc = %8lu (sequential %8lu) | %s\n", points[i].first, points[i].second, R.operations, R.cycles, E.cycles, same ? "PASS" : "FAIL");
+	if (!same) pass = false;
+    }
+    return pass ? 0 : 1;
+}
@@ -8,6 +8,8 @@ int main
     char	**argv
 )
 {
+    pipelined::params::init(argc, argv);
+
     printf("L1D: %u bytes of capacity, %u sets, %u-way set associative, %u-byte line size\n",
 	   pipelined::caches::L1D.capacity(), pipelined::caches::L1D.nsets(), pipelined::caches::L1D.nways(), pipelined::caches::L1D.linesize());
     printf("L1I: %u bytes of capacity, %u sets, %u-way set associative, %u-byte line size\n",
@@ -32,6 +34,8 @@ int main
 
 	pipelined::caches::L2.flush();
 	pipelined::caches::L3.flush();
+	pipelined::caches::L1D.flush();
+	pipelined::golden::record("memcpy", "n=" + std::to_string(n));
 
 	double rate = (double)pipelined::counters::cycles/(double)n;
 	
@@ -0,0 +1,88 @@
+#include<pipelined.hh>
+#include<mxv.hh>
+#include<stdio.h>
+#include<chrono>
+
+using namespace pipelined;
+
+// The simulated memory covers the whole 32-bit address space and is backed on first touch: checks that
+// far apart addresses work, that only the touched pages are backed and that clearing brings them all back
+// to 0. Then runs mxv near the bottom and near the top of memory: since both placements map to the same
+// cache sets, they must take exactly the same cycles.
+
+static double	seconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool	sparse()
+{
+    const u64 addr[] = { 0, 0x12345678, 0x80000000, memory::span - 16 };
+    zeromem();
+    bool pass = MEM.pages().empty();
+    for (u32 i=0; i<4; i++) MEM[addr[i]] = i + 1;
+    *(double*)&MEM[memory::span - 8] = 1.0;				// the last bytes of memory
+    std::vector<u32> pages = MEM.pages();
+    pass = (pages.size() == 4) && pass;
+    for (u32 i=0; i<4; i++) pass = (MEM[addr[i]] == i + 1) && pass;
+    for (u32 i=0; i<pages.size(); i++) pass = (pages[i] == addr[i]/memory::page) && pass;
+
+    const u64 big = 64 << 20;						// touch a 64 MiB working set
+    for (u64 a = 0; a < big; a += memory::page) MEM[memory::span/2 + a] = 1;
+    pass = (MEM.pages().size() == 4 + big/memory::page - 1) && pass;	// 0x80000000 was already touched
+    double t0 = seconds();
+    zeromem();
+    double t1 = seconds();
+    pass = MEM.pages().empty() && pass;
+    for (u32 i=0; i<4; i++) pass = (MEM[addr[i]] == 0) && pass;
+    printf("sparse : %lu MiB touched, cleared in %.4f s | %s\n", big >> 20, t1 - t0, pass ? "PASS" : "FAIL");
+    return pass;
+}
+
+static u64	run_mxv(u32 base, u32 m, u32 n, bool &pass)		// mxv with its data at base, returns the cycles
+{
+    const u32 Y = base;
+    const u32 X = Y + m*sizeof(double);
+    const u32 A = X + n*sizeof(double);
+
+    zeromem();
+    for (u32 i=0; i<m; i++) *((double*)(MEM.data() + Y + i*sizeof(double))) = 0.0;
+    for (u32 j=0; j<n; j++) *((double*)(MEM.data() + X + j*sizeof(double))) = (double)j;
+    for (u32 i=0; i<m; i++) for (u32 j=0; j<n; j++) *((double*)(MEM.data() + A + (i*n+j)*sizeof(double))) = (double)i;
+    zeroctrs();
+    GPR[3].data() = Y;
+    GPR[4].data() = A;
+    GPR[5].data() = X;
+    GPR[6].data() = m;
+    GPR[7].data() = n;
+
+    mxv(0,0,0,0,0);
+    caches::L2.flush();
+    caches::L3.flush();
+
+    for (u32 i=0; i<m; i++) if (*((double*)(MEM.data() + Y + i*sizeof(double))) != ((n*(n-1))/2)*i) pass = false;
+    return counters::cycles;
+}
+
+static bool	placement(u32 m, u32 n)
+{
+    const u32 high = 0xc0000000;					// maps to the same cache sets as address 0
+    bool pass = true;
+    u64 cycles[2] = { run_mxv(0, m, n, pass), run_mxv(high, m, n, pass) };
+    pass = (cycles[0] == cycles[1]) && pass;
+    printf("mxv M = %4d, N = %4d : cyc = %8lu (at 0) %8lu (at 0x%08x) | %s\n", m, n, cycles[0], cycles[1], high, pass ? "PASS" : "FAIL");
+    return pass;
+}
+
+int main
+(
+    int		  argc,
+    char	**argv
+)
+{
+    pipelined::params::init(argc, argv);
+
+    bool pass = sparse();
+    for (u32 m = 4; m <= 32; m *= 2) for (u32 n = m; n <= 256; n *= 4) pass = placement(m, n) && pass;
+    return pass ? 0 : 1;
+}
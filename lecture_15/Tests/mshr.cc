@@ -0,0 +1,75 @@
+#include<pipelined.hh>
+#include<memcpy.hh>
+#include<vmemcpy.hh>
+#include<stdio.h>
+#include"kernels.hh"
+
+using namespace pipelined;
+
+// Runs vmemcpy and memcpy with 1 to 64 MSHRs at every level, and checks that the results are still right, that
+// more registers never cost cycles, that one register serializes the misses to memory, and that the counters are
+// consistent: a primary miss takes a register (at most one per miss of the level), and the byte loads of memcpy
+// to a line in flight merge with its miss.
+
+typedef struct
+{
+    u64		cycles;
+    u64		allocated;			// L1D registers taken
+    u64		merged;				// L1D secondary misses
+    u64		stalls;				// L1D misses that waited for a register
+} result_t;
+
+static void	configure(u32 n)
+{
+    std::string N = std::to_string(n);
+    params::set("L1.mshrs", N);
+    params::set("L2.mshrs", N);
+    params::set("L3.mshrs", N);
+    params::configure();
+}
+
+static bool	consistent()
+{
+    const caches::cache *C[3] = { &caches::L1D, &caches::L2, &caches::L3 };
+    bool pass = true;
+    for (u32 l=0; l<3; l++) pass = (C[l]->mshr.allocated <= C[l]->misses) && (C[l]->mshr.stalls <= C[l]->mshr.allocated) && pass;
+    return pass;
+}
+
+static result_t	copy(bool vector, u32 n, bool &pass)
+{
+    kernels::copy(n);
+    if (vector) pipelined::vmemcpy(0,0,0);
+    else        pipelined::memcpy(0,0,0);
+    result_t R = { counters::cycles, caches::L1D.mshr.allocated, caches::L1D.mshr.merged, caches::L1D.mshr.stalls };
+    pass = consistent() && pass;
+    if (caches::L3.mshr.size() == 1) pass = (counters::cycles >= caches::L3.mshr.allocated * params::MEM::latency) && pass;	// one miss to memory at a time
+    pass = kernels::copied(n) && pass;
+    return R;
+}
+
+int main
+(
+    int		  argc,
+    char	**argv
+)
+{
+    pipelined::params::init(argc, argv);
+
+    bool pass = true;
+    result_t last[2];
+    for (u32 n = 1; n <= 64; n *= 2)
+    {
+	configure(n);
+	bool ok = true;
+	result_t R[2] = { copy(true, 4096, ok), copy(false, 1024, ok) };
+	ok = (R[1].merged > 0) && (R[0].allocated > 0) && ok;
+	if (n > 1) for (u32 k=0; k<2; k++) ok = (R[k].cycles <= last[k].cycles) && ok;
+	printf("MSHRs = %2u : vmemcpy cyc = %6lu, L1D allocated = %4lu, stalls = %4lu; memcpy cyc = %6lu, L1D allocated = %4lu, merged = %4lu | %s\n",
+	       n, R[0].cycles, R[0].allocated, R[0].stalls, R[1].cycles, R[1].allocated, R[1].merged, kernels::verdict(ok));
+	last[0] = R[0]; last[1] = R[1];
+	pass = ok && pass;
+    }
+    configure(0);
+    return pass ? 0 : 1;
+}
@@ -31,6 +31,8 @@ void test_mxv(u32 m, u32 n)
 
     pipelined::caches::L2.flush();
     pipelined::caches::L3.flush();
+    pipelined::caches::L1D.flush();
+    pipelined::golden::record("mxv", "M=" + std::to_string(M) + " N=" + std::to_string(N));
     
     if (pipelined::tracing) printf("\n");
     printf("M = %4d, N = %4d : instr = %6lu, cyc = %8lu, L1D(access= %6lu, hit = %6lu, miss = %6lu), L2(miss = %6lu), L3(miss = %6lu) | ",
@@ -54,6 +56,8 @@ int main
     char	**argv
 )
 {
+    pipelined::params::init(argc, argv);
+
     printf("L1D: %u bytes of capacity, %u sets, %u-way set associative, %u-byte line size\n",
 	   pipelined::caches::L1D.capacity(), pipelined::caches::L1D.nsets(), pipelined::caches::L1D.nways(), pipelined::caches::L1D.linesize());
     printf("L1I: %u bytes of capacity, %u sets, %u-way set associative, %u-byte line size\n",
@@ -0,0 +1,78 @@
+#include<pipelined.hh>
+#include<memcpy.hh>
+#include<mxv.hh>
+#include<stdio.h>
+#include"kernels.hh"
+
+using namespace pipelined;
+
+// Runs memcpy and mxv with each prefetcher on L1D and L2, and checks that the results are still right, that the
+// prefetch counters are consistent (a prefetch is useful or useless at most once, and only a useful one can be
+// late) and that on these streaming kernels every prefetcher saves L1D misses and cycles over none.
+
+typedef struct
+{
+    u64		cycles;
+    u64		misses;				// of L1D
+} result_t;
+
+static bool	configure(const char *kind, const char *degree, const char *distance)
+{
+    bool ok = params::set("L1.prefetcher", kind) && params::set("L2.prefetcher", kind);
+    ok = params::set("L1.prefetchdegree", degree) && params::set("L2.prefetchdegree", degree) && ok;
+    ok = params::set("L1.prefetchdistance", distance) && params::set("L2.prefetchdistance", distance) && ok;
+    params::configure();
+    return ok;
+}
+
+static bool	consistent(const caches::cache &C)
+{
+    const caches::prefetcher &P = C.prefetch;
+    return (P.useful + P.useless <= P.issued) && (P.late <= P.useful);
+}
+
+static result_t	copy(u32 n, bool &pass)
+{
+    kernels::copy(n);
+    pipelined::memcpy(0,0,0);
+    pass = kernels::copied(n) && consistent(caches::L1D) && consistent(caches::L2) && pass;
+    result_t R = { counters::cycles, caches::L1D.misses };
+    return R;
+}
+
+static result_t	product(u32 m, u32 n, bool &pass)
+{
+    kernels::rows(m, n);
+    mxv(0,0,0,0,0);
+    pass = kernels::rowsok(m, n) && consistent(caches::L1D) && consistent(caches::L2) && pass;
+    result_t R = { counters::cycles, caches::L1D.misses };
+    return R;
+}
+
+int main
+(
+    int		  argc,
+    char	**argv
+)
+{
+    pipelined::params::init(argc, argv);
+
+    typedef struct { const char *kind, *degree, *distance; } config_t;
+    const config_t configs[] = { { "none", "1", "1" }, { "nextline", "1", "1" }, { "stride", "1", "1" }, { "stream", "1", "1" }, { "nextline", "4", "2" }, { "stream", "4", "2" } };
+    bool pass = true;
+    result_t base[2];
+    for (u32 c=0; c<sizeof(configs)/sizeof(configs[0]); c++)
+    {
+	const config_t &C = configs[c];
+	bool ok = configure(C.kind, C.degree, C.distance);
+	result_t R[2] = { copy(4096, ok), product(16, 1024, ok) };
+	const caches::prefetcher &P = caches::L1D.prefetch;
+	if (!c) { base[0] = R[0]; base[1] = R[1]; ok = (P.issued == 0) && ok; }
+	else for (u32 k=0; k<2; k++) ok = (R[k].cycles < base[k].cycles) && (R[k].misses < base[k].misses) && (P.useful > 0) && ok;
+	printf("%-8s degree = %s, distance = %s : memcpy cyc = %6lu, L1D misses = %4lu; mxv cyc = %7lu, L1D misses = %4lu; L1D prefetches = %5lu (useful = %5lu, late = %5lu) | %s\n",
+	       C.kind, C.degree, C.distance, R[0].cycles, R[0].misses, R[1].cycles, R[1].misses, P.issued, P.useful, P.late, kernels::verdict(ok));
+	pass = ok && pass;
+    }
+    configure("none", "1", "1");
+    return pass ? 0 : 1;
+}
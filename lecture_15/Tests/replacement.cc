@@ -0,0 +1,74 @@
+#include<pipelined.hh>
+#include<vmemcpy.hh>
+#include<stdio.h>
+#include"kernels.hh"
+
+using namespace pipelined;
+
+// Runs vmemcpy over and over on the same buffers with each replacement policy in L1D and L2, and compares the hits
+// and misses of the runs after the first. When source and destination fit in L1D every policy hits on every
+// line. When they take twice L1D, or twice L2, LRU and its approximations (PLRU, and SRRIP, which inserts every
+// line at the same distance) evict (almost) each line just before it is used again, while BRRIP and random
+// replacement keep part of the buffers and miss at least 10% less.
+
+typedef struct
+{
+    u64		hits;				// L1D
+    u64		misses;				// L1D
+    u64		L2misses;
+} result_t;
+
+static result_t	copies(const char *policy, u32 n, bool &pass)	// the second and third of three copies of n bytes
+{
+    params::set("L1.replacement", policy);
+    params::set("L2.replacement", policy);
+    params::configure();
+    kernels::copy(n);
+    result_t R = { 0, 0, 0 };
+    for (u32 k=0; k<3; k++)
+    {
+	if (k == 1) R = { caches::L1D.hits, caches::L1D.misses, caches::L2.misses };
+	kernels::copyargs(n);
+	pipelined::vmemcpy(0,0,0);
+    }
+    R = { caches::L1D.hits - R.hits, caches::L1D.misses - R.misses, caches::L2.misses - R.L2misses };
+    pass = kernels::copied(n) && pass;
+    return R;
+}
+
+int main
+(
+    int		  argc,
+    char	**argv
+)
+{
+    pipelined::params::init(argc, argv);
+
+    const char *policies[] = { "lru", "plru", "srrip", "brrip", "random" };
+    const u32 L1 = caches::L1D.capacity(), L2 = caches::L2.capacity();
+    const u32 sizes[] = { L1/4, L1, L2 };				// both buffers fit in L1D; in L2 only; in neither
+    const u32 lines[] = { 2*sizes[0]/caches::L1D.linesize(), 2*sizes[1]/caches::L1D.linesize(), 2*sizes[2]/caches::L1D.linesize() };
+    bool pass = true;
+    result_t lru[3];
+    for (u32 p=0; p<sizeof(policies)/sizeof(policies[0]); p++)
+    {
+	bool ok = true;
+	std::string policy = policies[p];
+	result_t R[3];
+	for (u32 s=0; s<3; s++) R[s] = copies(policies[p], sizes[s], ok);
+	if (p == 0) for (u32 s=0; s<3; s++) lru[s] = R[s];
+	ok = (R[0].misses == 0) && (R[0].hits == 2*lines[0]) && ok;	// two runs, every line hit
+	ok = (R[1].L2misses == 0) && ok;
+	if ((policy == "lru") || (policy == "plru") || (policy == "srrip"))
+	    ok = (R[1].misses*10 >= 2*lines[1]*9) && (R[2].misses == 2*lines[2]) && (R[2].L2misses == 2*lines[2]) && ok;	// (almost) every line missed
+	else
+	    ok = (R[1].misses*10 < lru[1].misses*9) && (R[2].L2misses*10 < lru[2].L2misses*9) && ok;
+	printf("%-6s : n = %5u L1D hits = %4lu, misses = %4lu; n = %5u L1D hits = %4lu, misses = %4lu; n = %5u L1D misses = %4lu, L2 misses = %4lu | %s\n",
+	       policies[p], sizes[0], R[0].hits, R[0].misses, sizes[1], R[1].hits, R[1].misses, sizes[2], R[2].misses, R[2].L2misses, kernels::verdict(ok));
+	pass = ok && pass;
+    }
+    params::set("L1.replacement", "lru");
+    params::set("L2.replacement", "lru");
+    params::configure();
+    return pass ? 0 : 1;
+}
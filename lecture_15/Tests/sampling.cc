@@ -0,0 +1,156 @@
+#include<pipelined.hh>
+#include<mxv.hh>
+#include<sgemv.hh>
+#include<stdio.h>
+#include<math.h>
+#include<chrono>
+
+using namespace pipelined;
+
+// Runs mxv and sgemv in full detail and sampled (SMARTS: functional warming with a detailed window every
+// period instructions, or plain fast-forward with only a bounded stretch of warming before each window), and compares the extrapolated cycles with the real ones. The sampled result must be
+// correct, and its error must be within the confidence interval or below the tolerance. Sampling started after a
+// detailed run must take the same samples as from the start. Under full warming the caches must stay warm from
+// window to window: a working set that fits in L3, but takes longer than a period to go through, misses L3 only
+// the first time, as in a detailed run.
+
+static const double	tolerance = 0.05;		// largest acceptable relative error outside the confidence interval
+
+static double	seconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void	arguments(bool single, u32 m, u32 n)			// the kernels use up their argument registers
+{
+    const u32 size = single ? sizeof(float) : sizeof(double);
+    GPR[3].data() = 0;
+    GPR[4].data() = (m + n)*size;
+    GPR[5].data() = m*size;
+    GPR[6].data() = m;
+    GPR[7].data() = n;
+    GPR[8].data() = m;
+}
+
+static bool	setup(bool single, u32 m, u32 n, bool zero = true)	// mxv (double) or sgemv (single) inputs (false if they do not fit in MEM)
+{
+    const u32 size = single ? sizeof(float) : sizeof(double);
+    const u32 Y = 0;
+    const u32 X = Y + m*size;
+    const u32 A = X + n*size;
+    if (A + m*n*size > MEM.size()) return false;
+
+    zeromem();
+    for (u32 i=0; i<m; i++) if (single) ((float*)(MEM.data() + Y))[i] = 0; else ((double*)(MEM.data() + Y))[i] = 0;
+    for (u32 j=0; j<n; j++) if (single) ((float*)(MEM.data() + X))[j] = 1; else ((double*)(MEM.data() + X))[j] = j;	// sums stay exact in single precision
+    for (u32 i=0; i<m; i++) for (u32 j=0; j<n; j++)
+    {
+	if (single) ((float*)(MEM.data() + A))[i + m*j] = i;		// column major, as Tests/sgemv.cc
+	else        ((double*)(MEM.data() + A))[i*n + j] = i;		// row major, as Tests/mxv.cc
+    }
+
+    if (zero) zeroctrs();
+    arguments(single, m, n);
+    return true;
+}
+
+static void	run(bool single, u32 m, u32 n)
+{
+    if (single) sgemv((float*)(MEM.data()), 0, 0, m, n, m);
+    else        mxv(0, 0, 0, m, n);
+    caches::L2.flush();
+    caches::L3.flush();
+}
+
+static bool	check(bool single, u32 m, u32 n)
+{
+    for (u32 i=0; i<m; i++)
+    {
+	double y = single ? ((float*)(MEM.data()))[i] : ((double*)(MEM.data()))[i];
+	if (y != (single ? (double)n*i : (double)((n*(n-1))/2)*i)) return false;
+    }
+    return true;
+}
+
+static bool	compare(bool single, u32 m, u32 n, u64 period, u64 window, u64 warmup, u64 warming = ~(u64)0)
+{
+    if (!setup(single, m, n)) return true;
+    double t0 = seconds();
+    run(single, m, n);
+    double t1 = seconds();
+    u64 cycles = counters::cycles;
+    bool pass = check(single, m, n);
+
+    setup(single, m, n);
+    double t2 = seconds();
+    sampling::start(period, window, warmup, warming);
+    run(single, m, n);
+    sampling::stop();
+    double t3 = seconds();
+    sampling::estimate_t E = sampling::estimate();
+    pass = check(single, m, n) && pass;
+
+    double error = fabs(E.cycles - cycles) / cycles;
+    bool within = (fabs(E.cycles - cycles) <= E.error) || (error <= tolerance);
+    printf("%s M = %4d, N = %5d : cyc = %9lu, estimate = %11.1f +- %9.1f (%5.2f%%, %4lu samples), error = %5.2f%%, speedup = %5.1f | %s\n",
+	   single ? "sgemv" : "mxv  ", m, n, cycles, E.cycles, E.error, 100*E.error/E.cycles, E.samples, 100*error, (t1 - t0)/(t3 - t2),
+	   (pass && within) ? "PASS" : "FAIL");
+    return pass && within;
+}
+
+static bool	after(bool single, u32 m, u32 n, u64 period, u64 window, u64 warmup)	// sampling started after a detailed run
+{
+    setup(single, m, n);
+    sampling::start(period, window, warmup, ~(u64)0);
+    run(single, m, n);
+    sampling::stop();
+    u64 samples = sampling::estimate().samples;
+
+    setup(single, m, n);
+    run(single, m, n);							// in detail, and not a window
+    setup(single, m, n, false);
+    sampling::start(period, window, warmup, ~(u64)0);
+    run(single, m, n);
+    sampling::stop();
+    sampling::estimate_t E = sampling::estimate();
+    bool pass = check(single, m, n) && (E.samples == samples);
+    printf("%s M = %4d, N = %5d : %4lu samples after a detailed run, %4lu from the start | %s\n",
+	   single ? "sgemv" : "mxv  ", m, n, E.samples, samples, pass ? "PASS" : "FAIL");
+    return pass;
+}
+
+static bool	warm(u32 m, u32 n, u32 passes, u64 period, u64 window, u64 warmup)	// mxv over the same data, passes times
+{
+    setup(false, m, n);
+    for (u32 k=0; k<passes; k++) { arguments(false, m, n); run(false, m, n); }
+    u64 misses = caches::L3.misses;
+
+    setup(false, m, n);
+    sampling::start(period, window, warmup, ~(u64)0);
+    for (u32 k=0; k<passes; k++) { arguments(false, m, n); run(false, m, n); }
+    sampling::stop();
+    sampling::estimate_t E = sampling::estimate();
+    bool pass = check(false, m, n) && (E.samples > 0) && (caches::L3.misses == misses);
+    printf("mxv   M = %4d, N = %5d : %u passes, L3 misses = %5lu sampled (%4lu samples), %5lu in detail | %s\n",
+	   m, n, passes, caches::L3.misses, E.samples, misses, pass ? "PASS" : "FAIL");
+    return pass;
+}
+
+int main
+(
+    int		  argc,
+    char	**argv
+)
+{
+    pipelined::params::init(argc, argv);
+
+    bool pass = true;
+    for (u32 n = 1024; n <= 4096; n *= 2) pass = compare(false, 16, n, 10000, 1000, 1000) && pass;
+    for (u32 n = 1024; n <= 4096; n *= 2) pass = compare(false, 16, n, 50000, 1000, 1000) && pass;
+    for (u32 n = 1024; n <= 8192; n *= 2) pass = compare(true,  16, n, 10000, 1000, 1000) && pass;
+    for (u32 n = 1024; n <= 8192; n *= 2) pass = compare(true,  16, n, 50000, 1000, 1000) && pass;
+    for (u32 n = 1024; n <= 8192; n *= 2) pass = compare(true,  16, n, 50000, 1000, 1000, 8000) && pass;	// bounded warming
+    pass = after(false, 16, 1024, 10000, 1000, 1000) && pass;
+    pass = warm(16, 80, 8, 3000, 500, 500) && pass;				// 11 KiB: L2 is 4 KiB, L3 16 KiB
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,85 @@
+#include<pipelined.hh>
+#include<spmv.hh>
+#include<stdio.h>
+
+using namespace pipelined;
+
+void test_spmv(u32 m, u32 nnz)			// m x m matrix, nnz nonzeros per row
+{
+    pipelined::zeromem();
+
+    const uint32_t M = m;
+    const uint32_t K = nnz < m ? nnz : m;
+
+    const uint32_t Y = 0;
+    const uint32_t X = Y + M*sizeof(double);
+    const uint32_t R = X + M*sizeof(double);
+    const uint32_t C = R + (M+1)*sizeof(uint32_t);
+    const uint32_t V = (C + M*K*sizeof(uint32_t) + 7) & ~7;	// doubles are aligned
+
+    std::vector<double> y(M, 0.0);		// the reference result, in the same order of operations
+    for (uint32_t j=0; j<M; j++) *((double*)(pipelined::MEM.data() + X + j*sizeof(double))) = (double)j;
+    for (uint32_t i=0; i<M; i++)
+    {
+	*((uint32_t*)(pipelined::MEM.data() + R + i*sizeof(uint32_t))) = i*K;
+	for (uint32_t k=0; k<K; k++)
+	{
+	    uint32_t j = (i*7 + k*(M/K)) % M;	// K distinct columns, scattered
+	    double   a = (double)(i + k + 1);
+	    *((uint32_t*)(pipelined::MEM.data() + C + (i*K+k)*sizeof(uint32_t))) = j;
+	    *((double*)(pipelined::MEM.data() + V + (i*K+k)*sizeof(double))) = a;
+	    y[i] += a*(double)j;
+	}
+    }
+    *((uint32_t*)(pipelined::MEM.data() + R + M*sizeof(uint32_t))) = M*K;
+
+    pipelined::zeroctrs();
+
+    pipelined::GPR[3].data() = Y;
+    pipelined::GPR[4].data() = V;
+    pipelined::GPR[5].data() = C;
+    pipelined::GPR[6].data() = R;
+    pipelined::GPR[7].data() = X;
+    pipelined::GPR[8].data() = M;
+
+    pipelined::spmv(0,0,0,0,0,0);
+
+    pipelined::caches::L2.flush();
+    pipelined::caches::L3.flush();
+    pipelined::caches::L1D.flush();
+    pipelined::golden::record("spmv", "M=" + std::to_string(M) + " NNZ=" + std::to_string(M*K));
+
+    if (pipelined::tracing) printf("\n");
+    printf("M = %4d, NNZ = %5d : instr = %6lu, cyc = %8lu, L1D(access= %6lu, hit = %6lu, miss = %6lu), L2(miss = %6lu), L3(miss = %6lu) | ",
+	    M, M*K, pipelined::counters::operations, pipelined::counters::cycles, pipelined::caches::L1D.accesses, pipelined::caches::L1D.hits, pipelined::caches::L1D.misses,
+	    pipelined::caches::L2.misses, pipelined::caches::L3.misses);
+    bool pass = true;
+    for (uint32_t i=0; i<M; i++) if (*((double*)(pipelined::MEM.data() + Y + i*sizeof(double))) != y[i]) pass = false;
+    if (pass) printf("PASS\n");
+    else      printf("FAIL\n");
+}
+
+int main
+(
+    int		  argc,
+    char	**argv
+)
+{
+    pipelined::params::init(argc, argv);
+
+    printf("L1D: %u bytes of capacity, %u sets, %u-way set associative, %u-byte line size\n",
+	   pipelined::caches::L1D.capacity(), pipelined::caches::L1D.nsets(), pipelined::caches::L1D.nways(), pipelined::caches::L1D.linesize());
+    printf("L1I: %u bytes of capacity, %u sets, %u-way set associative, %u-byte line size\n",
+	   pipelined::caches::L1I.capacity(), pipelined::caches::L1I.nsets(), pipelined::caches::L1I.nways(), pipelined::caches::L1I.linesize());
+    printf("L2: %u bytes of capacity, %u sets, %u-way set associative, %u-byte line size\n",
+	   pipelined::caches::L2.capacity(), pipelined::caches::L2.nsets(), pipelined::caches::L2.nways(), pipelined::caches::L2.linesize());
+    printf("L3: %u bytes of capacity, %u sets, %u-way set associative, %u-byte line size\n",
+	   pipelined::caches::L3.capacity(), pipelined::caches::L3.nsets(), pipelined::caches::L3.nways(), pipelined::caches::L3.linesize());
+
+    for (uint32_t m = 4; m <= 1024; m *= 4) for (uint32_t nnz = 1; nnz <= 16; nnz *= 4)
+    {
+	test_spmv(m,nnz);
+    }
+
+    return 0;
+}
@@ -0,0 +1,112 @@
+#include<pipelined.hh>
+#include<mxv.hh>
+#include<stdio.h>
+#include<fstream>
+#include<sstream>
+
+using namespace pipelined;
+
+// Runs mxv and checks the statistics registry against the variables it reports: the counters, the operations
+// of each unit (which add up to all operations) and the dispatch-to-issue histogram (one sample per operation).
+// Then measures a region, a second run after a reset, which must count only that run, and exports the lot as
+// JSON and CSV. Last, checks that a smaller physical register file counts more rename stalls, and costs cycles.
+
+static void	setup(u32 m, u32 n)
+{
+    const u32 Y = 0;
+    const u32 X = Y + m*sizeof(double);
+    const u32 A = X + n*sizeof(double);
+
+    for (u32 i=0; i<m; i++) *((double*)(MEM.data() + Y + i*sizeof(double))) = 0.0;
+    for (u32 j=0; j<n; j++) *((double*)(MEM.data() + X + j*sizeof(double))) = (double)j;
+    for (u32 i=0; i<m; i++) for (u32 j=0; j<n; j++) *((double*)(MEM.data() + A + (i*n+j)*sizeof(double))) = (double)i;
+    GPR[3].data() = Y;
+    GPR[4].data() = A;
+    GPR[5].data() = X;
+    GPR[6].data() = m;
+    GPR[7].data() = n;
+}
+
+static std::string	slurp(const char *path)
+{
+    std::ifstream in(path);
+    std::stringstream S;
+    S << in.rdbuf();
+    return S.str();
+}
+
+static bool	run(u32 m, u32 n)
+{
+    zeromem();
+    zeroctrs();
+    setup(m, n);
+    mxv(0,0,0,0,0);
+
+    bool pass = (stats::value("core.cycles") == counters::cycles) && (stats::value("core.instructions") == counters::instructions);
+    pass = (stats::value("caches.L1D.misses") == caches::L1D.misses) && (stats::value("caches.L2.accesses") == caches::L2.accesses) && pass;
+    pass = (stats::value("prf.rename_stalls") == PRF::stalls) && (stats::value("units.FPU.busy_cycles") == units::FPU.claims) && pass;
+    const char *U[] = { "LDU", "STU", "FXU", "FPU", "BRU", "VU" };
+    double operations = 0;
+    for (u32 i=0; i<6; i++) operations += stats::value(std::string("units.") + U[i] + ".operations");
+    pass = (operations == counters::operations) && (stats::dispatch.samples() == counters::operations) && pass;
+    pass = (stats::value("branches.taken") > 0) && (stats::value("branches.taken") <= stats::value("branches.executed")) && pass;
+    pass = (stats::value("core.ipc") == (double)counters::instructions/counters::cycles) && pass;
+
+    u64 instructions = counters::instructions, cycles = counters::cycles, misses = caches::L1D.misses;
+    stats::reset();							// a region: the second run only
+    setup(m, n);
+    mxv(0,0,0,0,0);
+    pass = (stats::value("core.instructions") == counters::instructions - instructions) && (stats::value("core.cycles") == counters::cycles - cycles) && pass;
+    pass = (stats::value("caches.L1D.misses") == caches::L1D.misses - misses) && (stats::value("core.instructions") == instructions) && pass;
+    pass = (stats::dispatch.samples() == stats::value("core.operations")) && pass;
+
+    pass = stats::dump("stats.json") && stats::dump("stats.csv") && pass;
+    std::string json = slurp("stats.json"), csv = slurp("stats.csv");
+    char line[64];
+    snprintf(line, sizeof(line), "\ncaches.L1D.misses,%lu\n", caches::L1D.misses - misses);
+    pass = (csv.find(line) != std::string::npos) && (csv.find("\nbackend.dispatch_to_issue.samples,") != std::string::npos) && pass;
+    pass = (json.find("\"L1D\": {") != std::string::npos) && (json.find("\"dispatch_to_issue\": {") != std::string::npos) && pass;
+    pass = (std::count(json.begin(), json.end(), '{') == std::count(json.begin(), json.end(), '}')) && pass;
+
+    printf("M = %4d, N = %4d : instr = %6lu, cyc = %8lu, L1D misses = %6lu (region), ipc = %.3f, FPU utilization = %.3f, taken = %.3f | %s\n",
+	   m, n, (u64)stats::value("core.instructions"), (u64)stats::value("core.cycles"), (u64)stats::value("caches.L1D.misses"),
+	   stats::value("core.ipc"), stats::value("units.FPU.utilization"), stats::value("branches.taken_rate"), pass ? "PASS" : "FAIL");
+    return pass;
+}
+
+static bool	renames(u32 m, u32 n)					// a smaller register file waits for its registers more often
+{
+    u64 stalls[2], cycles[2];
+    const u32 N[2] = { 64, params::GPR::N + params::FPR::N + 1 };
+    for (u32 k=0; k<2; k++)
+    {
+	params::set("PRF.N", std::to_string(N[k]));
+	params::configure();
+	zeromem();
+	setup(m, n);
+	mxv(0,0,0,0,0);
+	stalls[k] = stats::value("prf.rename_stalls"); cycles[k] = counters::cycles;
+    }
+    params::set("PRF.N", "64");
+    params::configure();
+    bool pass = (stalls[1] > stalls[0]) && (cycles[1] > cycles[0]);
+    printf("M = %4d, N = %4d : PRF.N = %2u rename stalls = %6lu, cyc = %8lu; PRF.N = %2u rename stalls = %6lu, cyc = %8lu | %s\n",
+	   m, n, N[0], stalls[0], cycles[0], N[1], stalls[1], cycles[1], pass ? "PASS" : "FAIL");
+    return pass;
+}
+
+int main
+(
+    int		  argc,
+    char	**argv
+)
+{
+    pipelined::params::init(argc, argv);
+
+    bool pass = true;
+    for (u32 m = 4; m <= 32; m *= 2) for (u32 n = m; n <= 256; n *= 4) pass = run(m, n) && pass;
+    pass = renames(32, 128) && pass;
+    remove("stats.json");
+    remove("stats.csv");
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,89 @@
+#include<pipelined.hh>
+#include<memcpy.hh>
+#include<vmemcpy.hh>
+#include<stdio.h>
+#include"kernels.hh"
+
+using namespace pipelined;
+
+// Runs memcpy and vmemcpy with a write-through or write-back L1D, with and without a store buffer, and checks
+// that the results are still right (once L1D is flushed too), that each store goes into the buffer once (as a
+// new entry or coalesced), that the byte stores of memcpy coalesce into about one line write each, that a
+// write-back L1D writes L2 less than a write-through one, and that no store waits for an entry of a large buffer.
+// On a 4-wide machine such a buffer costs no cycles but the write of its last entry (to L2 if L1D writes through,
+// to L1D if it writes back), which the machine waits for. At single issue it can cost more: a store no longer
+// waits for its line, so it issues as soon as its data are there, and takes the issue slot that the address
+// updates of the next iterations would have had. Without the buffer those stores issue while the core waits.
+
+typedef struct
+{
+    u64		cycles;
+    u64		stores;				// that went into L1D
+    u64		writes;				// to L2
+    u64		drains;				// line writes of the store buffer
+    u64		stalls;				// stores that waited for an entry
+} result_t;
+
+static void	configure(u32 writeback, u32 entries)
+{
+    params::set("L1.writeback", std::to_string(writeback));
+    params::set("SB.N", std::to_string(entries));
+    params::configure();
+}
+
+static result_t	copy(bool vector, u32 n, bool &pass)
+{
+    kernels::copy(n);
+    if (vector) pipelined::vmemcpy(0,0,0);
+    else        pipelined::memcpy(0,0,0);
+    result_t R = { counters::cycles, caches::L1D.writes, caches::L2.writes, caches::SB.drains, caches::SB.stalls };
+    if (caches::SB.active()) pass = (caches::SB.stores == R.stores) && (caches::SB.coalesced + caches::SB.drains == caches::SB.stores) && pass;
+    if (!caches::L1D.writeback()) pass = (R.writes == (caches::SB.active() ? R.drains : R.stores)) && pass;	// written through
+    pass = kernels::copied(n) && pass;
+    return R;
+}
+
+static bool	wide(u32 writeback, u32 n)					// a 64-entry buffer on a 4-wide machine costs no cycles but its last write
+{
+    bool pass = true;
+    const u32 drain = writeback ? params::L1::latency : params::L2::latency;
+    params::set("Backend.maxissue", "4");
+    configure(writeback, 0);
+    result_t base[2] = { copy(false, n, pass), copy(true, n, pass) };
+    configure(writeback, 64);
+    result_t R[2] = { copy(false, n, pass), copy(true, n, pass) };
+    for (u32 k=0; k<2; k++) pass = (R[k].cycles <= base[k].cycles + drain) && pass;
+    printf("%-13s 4-wide      : memcpy cyc = %6lu (SB.N = 64) %6lu (none); vmemcpy cyc = %6lu (SB.N = 64) %6lu (none) | %s\n",
+	   writeback ? "write-back" : "write-through", R[0].cycles, base[0].cycles, R[1].cycles, base[1].cycles, kernels::verdict(pass));
+    params::set("Backend.maxissue", "1");
+    return pass;
+}
+
+int main
+(
+    int		  argc,
+    char	**argv
+)
+{
+    pipelined::params::init(argc, argv);
+
+    const u32 n = 2048, lines = n / caches::L1D.linesize();
+    bool pass = true;
+    result_t base[2];
+    for (u32 writeback = 0; writeback <= 1; writeback++) for (u32 entries = 0; entries <= 64; entries = entries ? 8*entries : 1)
+    {
+	configure(writeback, entries);
+	bool ok = true;
+	result_t R[2] = { copy(false, n, ok), copy(true, n, ok) };
+	if (!writeback && !entries) { base[0] = R[0]; base[1] = R[1]; }
+	if (entries) ok = (R[0].drains <= 2*lines) && ok;				// the 16 byte stores to a line mostly coalesce
+	if (writeback) ok = (R[0].writes < base[0].writes) && (R[1].writes <= base[1].writes) && ok;
+	if (entries == 64) ok = (R[0].stalls == 0) && (R[1].stalls == 0) && ok;
+	printf("%-13s SB.N = %2u : memcpy cyc = %6lu, stores = %4lu, L2 writes = %4lu; vmemcpy cyc = %6lu, stores = %4lu, L2 writes = %4lu | %s\n",
+	       writeback ? "write-back" : "write-through", entries, R[0].cycles, R[0].stores, R[0].writes, R[1].cycles, R[1].stores, R[1].writes, kernels::verdict(ok));
+	pass = ok && pass;
+    }
+    for (u32 writeback = 0; writeback <= 1; writeback++) pass = wide(writeback, n) && pass;
+    configure(0, 0);
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,111 @@
+#include<pipelined.hh>
+#include<sgemv.hh>
+#include<mxv.hh>
+#include<memcpy.hh>
+#include<stdio.h>
+#include"kernels.hh"
+
+using namespace pipelined;
+
+// Runs sgemv, whose loads of y[i] read what the previous column stored, and mxv, which never loads what it stores,
+// with no store queue, with one and no dependence predictor (loads always go ahead) and with one and store sets.
+// Checks that the results are still right, that the y[i] loads of sgemv get their data forwarded, that without a
+// predictor they are replayed over and over while store sets learn the dependence after a replay or two (and then
+// save cycles, when replays are costly), and that mxv runs just as without a store queue. Last, smears a byte with
+// memcpy behind a store buffer: the stores miss, and the loads that read them must get their data forwarded without
+// waiting for the lines.
+
+typedef struct
+{
+    u64		cycles;
+    u64		forwarded;
+    u64		violations;
+} result_t;
+
+static void	configure(u32 entries, u32 storesets, u32 penalty)
+{
+    params::set("SQ.N", std::to_string(entries));
+    params::set("SQ.storesets", std::to_string(storesets));
+    params::set("SQ.penalty", std::to_string(penalty));
+    params::configure();
+}
+
+static result_t	columns(u32 m, u32 n, bool &pass)			// sgemv: y += A*x, a column at a time
+{
+    kernels::columns(m, n);
+    sgemv(0,0,0,m,n,m);
+    result_t R = { counters::cycles, operations::SQ.forwarded, operations::SQ.violations };
+    pass = kernels::columnsok(m, n) && pass;
+    return R;
+}
+
+static result_t	rows(u32 m, u32 n, bool &pass)				// mxv: y = A*x, a row at a time
+{
+    kernels::rows(m, n);
+    mxv(0,0,0,0,0);
+    result_t R = { counters::cycles, operations::SQ.forwarded, operations::SQ.violations };
+    pass = kernels::rowsok(m, n) && pass;
+    return R;
+}
+
+static bool	smear(u32 n)							// memcpy one byte up: each load reads what the last store wrote
+{
+    params::set("SB.N", "8");
+    configure(64, 64, 10);
+    zeromem();
+    zeroctrs();
+    MEM[0] = 42;
+    u64 cycles[2];
+    for (u32 k=0; k<2; k++)						// into lines that miss, then again into the same lines
+    {
+	u64 start = counters::cycles;
+	GPR[3].data() = 1;
+	GPR[4].data() = 0;
+	GPR[5].data() = n;
+	pipelined::memcpy(0,0,0);
+	cycles[k] = counters::cycles - start;
+    }
+    bool pass = (operations::SQ.forwarded > n) && (cycles[0] <= cycles[1]);	// the forwarded loads did not wait for their lines
+    kernels::flush();
+    for (u32 i=0; i<=n; i++) if (MEM[i] != 42) pass = false;
+    params::set("SB.N", "0");
+    printf("SQ.N = 64, SB.N = 8 : smear %u bytes cyc = %6lu (lines missing) %6lu (lines there), forwarded = %4lu | %s\n",
+	   n, cycles[0], cycles[1], operations::SQ.forwarded, kernels::verdict(pass));
+    return pass;
+}
+
+int main
+(
+    int		  argc,
+    char	**argv
+)
+{
+    pipelined::params::init(argc, argv);
+
+    typedef struct { u32 entries, storesets, penalty; } config_t;
+    const config_t configs[] = { { 0, 0, 10 }, { 16, 0, 10 }, { 16, 64, 10 }, { 16, 0, 100 }, { 16, 64, 100 } };
+    bool pass = true;
+    result_t base[2], blind;
+    for (u32 c=0; c<sizeof(configs)/sizeof(configs[0]); c++)
+    {
+	const config_t &C = configs[c];
+	configure(C.entries, C.storesets, C.penalty);
+	bool ok = true;
+	result_t R[2] = { columns(8, 1024, ok), rows(64, 64, ok) };
+	if (!C.entries) { base[0] = R[0]; base[1] = R[1]; ok = (R[0].forwarded == 0) && (R[0].violations == 0) && ok; }
+	else
+	{
+	    ok = (R[0].forwarded > 0) && ok;
+	    if (!C.storesets) { ok = (R[0].violations == R[0].forwarded) && ok; blind = R[0]; }	// every y[i] load went ahead of its store
+	    else ok = (R[0].violations <= 2) && ok;
+	    if (C.storesets && (C.penalty == 100)) ok = (R[0].cycles < blind.cycles) && ok;
+	    ok = (R[1].cycles == base[1].cycles) && (R[1].forwarded == 0) && (R[1].violations == 0) && ok;
+	}
+	printf("SQ.N = %2u, storesets = %2u, penalty = %3u : sgemv cyc = %6lu, forwarded = %4lu, violations = %4lu; mxv cyc = %6lu | %s\n",
+	       C.entries, C.storesets, C.penalty, R[0].cycles, R[0].forwarded, R[0].violations, R[1].cycles, kernels::verdict(ok));
+	pass = ok && pass;
+    }
+    pass = smear(1024) && pass;
+    configure(0, 64, 10);
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,278 @@
+#include<pipelined.hh>
+#include<memcpy.hh>
+#include<vmemcpy.hh>
+#include<mxv.hh>
+#include<sgemv.hh>
+#include<spmv.hh>
+#include<stdio.h>
+#include<string.h>
+#include<chrono>
+#include<map>
+#include<sys/resource.h>
+
+// Host throughput of the simulator itself. Runs each kernel at a fixed size, in timing mode and in functional
+// mode, and reports simulated instructions per host second (MIPS), host ns per simulated operation, the peak
+// RSS and the split of the host time between the two modes. Each time is the best of a few repeats, and each
+// repeat runs the kernel over and over for at least 0.1 s (the functional runs take only milliseconds).
+//
+//   bench [-r repeats] [-o baseline] [-b baseline] [-t tolerance] [-c file] [key=value ...]
+//
+// -o writes the results as a baseline (CSV). -b compares with a baseline: a kernel fails if its results are
+// wrong or its simulated counts (instructions, operations, cycles) changed, which holds on any host with the
+// same machine parameters. The times are only reported against the baseline's, unless -t is given: then a kernel
+// also fails if either mode got slower by more than the tolerance (0.1 is 10%), which is only meaningful with a
+// baseline recorded on the same host, with the same build flags.
+
+using namespace pipelined;
+
+typedef struct
+{
+    std::string	kernel;
+    std::string	size;
+    u64		instructions;
+    u64		operations;
+    u64		cycles;
+    double	timing;					// best host seconds, timing mode
+    double	functional;				// best host seconds, functional mode
+    double	rss;					// peak resident set of the process so far, in MiB
+} result_t;
+
+typedef struct
+{
+    const char	*name;
+    const char	*size;
+    void	(*setup)();				// inputs in MEM and arguments in the GPRs
+    bool	(*check)();				// are the results right?
+    void	(*run)();
+} kernel_t;
+
+static const u32	N = 64*1024;			// memcpy, vmemcpy: bytes
+static const u32	M = 16, K = 4096;		// mxv, sgemv: m x n
+static const u32	S = 4096, Z = 16;		// spmv: m x m, nonzeros per row
+
+static void	setup_copy()
+{
+    for (u32 i=0; i<N; i++) MEM[i] = (i * 2654435761u) >> 24;
+    GPR[3].data() = N;
+    GPR[4].data() = 0;
+    GPR[5].data() = N;
+}
+
+static bool	check_copy()
+{
+    for (u32 i=0; i<N; i++) if (MEM[N + i] != MEM[i]) return false;
+    return true;
+}
+
+static void	setup_mxv()
+{
+    const u32 X = M*sizeof(double), A = X + K*sizeof(double);
+    for (u32 j=0; j<K; j++) *((double*)(MEM.data() + X + j*sizeof(double))) = (double)j;
+    for (u32 i=0; i<M; i++) for (u32 j=0; j<K; j++) *((double*)(MEM.data() + A + (i*K+j)*sizeof(double))) = (double)i;
+    GPR[3].data() = 0;
+    GPR[4].data() = A;
+    GPR[5].data() = X;
+    GPR[6].data() = M;
+    GPR[7].data() = K;
+}
+
+static bool	check_mxv()
+{
+    for (u32 i=0; i<M; i++) if (((double*)MEM.data())[i] != (double)((K*(K-1))/2)*i) return false;
+    return true;
+}
+
+static void	setup_sgemv()
+{
+    const u32 X = M*sizeof(float), A = X + K*sizeof(float);
+    for (u32 j=0; j<K; j++) *((float*)(MEM.data() + X + j*sizeof(float))) = 1.0;
+    for (u32 i=0; i<M; i++) for (u32 j=0; j<K; j++) *((float*)(MEM.data() + A + (i+M*j)*sizeof(float))) = (float)i;
+    GPR[3].data() = 0;
+    GPR[4].data() = A;
+    GPR[5].data() = X;
+    GPR[6].data() = M;
+    GPR[7].data() = K;
+    GPR[8].data() = M;
+}
+
+static bool	check_sgemv()
+{
+    for (u32 i=0; i<M; i++) if (((float*)MEM.data())[i] != (float)K*i) return false;
+    return true;
+}
+
+static std::vector<double>	reference;		// spmv: the expected y
+
+static void	setup_spmv()
+{
+    const u32 X = S*sizeof(double), R = X + S*sizeof(double), C = R + (S+1)*sizeof(u32), V = (C + S*Z*sizeof(u32) + 7) & ~7;
+    reference.assign(S, 0.0);
+    for (u32 j=0; j<S; j++) *((double*)(MEM.data() + X + j*sizeof(double))) = (double)j;
+    for (u32 i=0; i<=S; i++) *((u32*)(MEM.data() + R + i*sizeof(u32))) = i*Z;
+    for (u32 i=0; i<S; i++) for (u32 l=0; l<Z; l++)
+    {
+	u32 j = (i*7 + l*(S/Z)) % S;					// as in Tests/spmv.cc
+	*((u32*)(MEM.data() + C + (i*Z + l)*sizeof(u32))) = j;
+	*((double*)(MEM.data() + V + (i*Z + l)*sizeof(double))) = (double)(i + l + 1);
+	reference[i] += (double)(i + l + 1)*(double)j;
+    }
+    GPR[3].data() = 0;
+    GPR[4].data() = V;
+    GPR[5].data() = C;
+    GPR[6].data() = R;
+    GPR[7].data() = X;
+    GPR[8].data() = S;
+}
+
+static bool	check_spmv()
+{
+    for (u32 i=0; i<S; i++) if (((double*)MEM.data())[i] != reference[i]) return false;
+    return true;
+}
+
+static void	run_memcpy()	{ pipelined::memcpy(0,0,0); }
+static void	run_vmemcpy()	{ pipelined::vmemcpy(0,0,0); }
+static void	run_mxv()	{ mxv(0,0,0,0,0); }
+static void	run_sgemv()	{ sgemv(0,0,0,0,0,0); }
+static void	run_spmv()	{ spmv(0,0,0,0,0,0); }
+
+static const kernel_t	kernels[] =
+{
+    { "memcpy",  "64K",      setup_copy,  check_copy,  run_memcpy  },
+    { "vmemcpy", "64K",      setup_copy,  check_copy,  run_vmemcpy },
+    { "mxv",     "16x4096",  setup_mxv,   check_mxv,   run_mxv     },
+    { "sgemv",   "16x4096",  setup_sgemv, check_sgemv, run_sgemv   },
+    { "spmv",    "4096x16",  setup_spmv,  check_spmv,  run_spmv    }
+};
+
+static double	seconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static const double	minimum = 0.1;			// host seconds each repeat runs for, at least
+
+static double	once(const kernel_t &K, bool functional, bool &pass)	// host seconds of one run
+{
+    zeromem();
+    zeroctrs();						// before setup: it resets the register mapping
+    K.setup();
+    double t0 = seconds();
+    if (functional) { functional::region fast; K.run(); }
+    else            { K.run(); caches::L2.flush(); caches::L3.flush(); caches::L1D.flush(); }
+    double t1 = seconds();
+    pass = K.check() && pass;
+    return t1 - t0;
+}
+
+static double	repeat(const kernel_t &K, bool functional, bool &pass)	// host seconds per run, over at least minimum seconds of runs
+{
+    double total = 0;
+    u32 runs = 0;
+    do { total += once(K, functional, pass); runs++; } while (total < minimum);
+    return total / runs;
+}
+
+static result_t	measure(const kernel_t &K, u32 repeats, bool &pass)
+{
+    result_t R;
+    R.kernel = K.name;
+    R.size = K.size;
+    R.timing = R.functional = 1e30;
+    for (u32 r=0; r<repeats; r++) R.timing = std::min(R.timing, repeat(K, false, pass));
+    R.instructions = counters::instructions;
+    R.operations = counters::operations;
+    R.cycles = counters::cycles;
+    for (u32 r=0; r<repeats; r++) R.functional = std::min(R.functional, repeat(K, true, pass));
+    pass = (functional::instructions == R.instructions) && pass;
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    R.rss = usage.ru_maxrss / 1024.0;
+    return R;
+}
+
+static const char	header[] = "kernel,size,instructions,operations,cycles,timing.s,timing.MIPS,timing.ns/op,functional.s,functional.MIPS,timing.share,rss.MiB";
+
+static void	print(FILE *out, const result_t &R, const char *verdict = 0)
+{
+    fprintf(out, "%s,%s,%lu,%lu,%lu,%.6f,%.3f,%.1f,%.6f,%.3f,%.3f,%.1f", R.kernel.c_str(), R.size.c_str(), R.instructions, R.operations, R.cycles,
+	    R.timing, R.instructions / R.timing / 1e6, R.timing / R.operations * 1e9,
+	    R.functional, R.instructions / R.functional / 1e6, R.timing / (R.timing + R.functional), R.rss);
+    if (verdict) fprintf(out, ",%s", verdict);
+    fprintf(out, "\n");
+}
+
+static bool	load(const char *path, std::map<std::string, result_t> &B)	// read a baseline file
+{
+    FILE *F = fopen(path, "r");
+    if (!F) { perror(path); return false; }
+    char line[1024], kernel[64], size[64];
+    while (fgets(line, sizeof(line), F))
+    {
+	result_t R;
+	if (sscanf(line, "%63[^,],%63[^,],%lu,%lu,%lu,%lf,%*f,%*f,%lf", kernel, size, &R.instructions, &R.operations, &R.cycles, &R.timing, &R.functional) != 7) continue;	// the header
+	R.kernel = kernel; R.size = size;
+	B[R.kernel] = R;
+    }
+    fclose(F);
+    return true;
+}
+
+int main
+(
+    int		  argc,
+    char	**argv
+)
+{
+    pipelined::params::init(argc, argv);
+
+    u32		repeats = 3;
+    double	tolerance = 0;				// 0: the times are not gated
+    const char	*baseline = 0;
+    FILE	*out = 0;
+    for (int arg = 1; arg < argc; arg += 2)
+    {
+	if (arg + 1 >= argc) { fprintf(stderr, "usage: %s [-r repeats] [-o baseline] [-b baseline] [-t tolerance]\n", argv[0]); return 1; }
+	if      (!strcmp(argv[arg], "-r")) repeats = std::max(1, atoi(argv[arg+1]));
+	else if (!strcmp(argv[arg], "-t")) tolerance = atof(argv[arg+1]);
+	else if (!strcmp(argv[arg], "-b")) baseline = argv[arg+1];
+	else if (!strcmp(argv[arg], "-o")) { out = fopen(argv[arg+1], "w"); if (!out) { perror(argv[arg+1]); return 1; } }
+	else { fprintf(stderr, "usage: %s [-r repeats] [-o baseline] [-b baseline] [-t tolerance]\n", argv[0]); return 1; }
+    }
+    std::map<std::string, result_t> B;
+    if (baseline && !load(baseline, B)) return 1;
+
+    printf("%s%s\n", header, baseline ? ",verdict" : "");
+    if (out) fprintf(out, "%s\n", header);
+    bool pass = true;
+    double timing = 0, functional = 0;
+    for (u32 k=0; k<sizeof(kernels)/sizeof(kernels[0]); k++)
+    {
+	bool right = true;
+	result_t R = measure(kernels[k], repeats, right);
+	timing += R.timing; functional += R.functional;
+	std::string verdict = right ? "" : "WRONG ";			// the results of the kernel
+	bool worse = !right;
+	if (baseline)
+	{
+	    std::map<std::string, result_t>::const_iterator it = B.find(R.kernel);
+	    if (it == B.end()) verdict += "NEW";
+	    else
+	    {
+		const result_t &O = it->second;
+		char speedup[64];
+		if ((O.size != R.size) || (O.instructions != R.instructions) || (O.operations != R.operations) || (O.cycles != R.cycles)) { verdict += "CHANGED "; worse = true; }
+		if (tolerance && (R.timing > O.timing * (1 + tolerance)))		{ verdict += "SLOWER-TIMING "; worse = true; }
+		if (tolerance && (R.functional > O.functional * (1 + tolerance)))	{ verdict += "SLOWER-FUNCTIONAL "; worse = true; }
+		snprintf(speedup, sizeof(speedup), "%.2fx timing %.2fx functional", O.timing / R.timing, O.functional / R.functional);
+		verdict += speedup;
+	    }
+	}
+	print(stdout, R, baseline ? verdict.c_str() : 0);
+	if (out) print(out, R);
+	if (worse) pass = false;
+    }
+    printf("total: %.3f s timing, %.3f s functional (%.0f%% timing)\n", timing, functional, 100*timing/(timing + functional));
+    if (out) fclose(out);
+    return pass ? 0 : 1;
+}
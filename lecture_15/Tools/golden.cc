@@ -0,0 +1,106 @@
+#include<stdio.h>
+#include<stdint.h>
+#include<stdlib.h>
+#include<string>
+#include<vector>
+#include<map>
+#include<sstream>
+
+// Compares golden records (PIPELINED_GOLDEN=file, see pipelined::golden) with the expected ones, field by field:
+//
+//   golden <expected> <actual>
+//
+// Reports each field that differs, each test point that is missing from actual and each new one, and exits with 1
+// if there is any. Prints nothing when the two files match.
+
+typedef struct
+{
+    std::vector<std::string>			fields;		// names of the counts, from the header
+    std::vector<std::string>			order;		// test points, as found in the file
+    std::map<std::string, std::vector<uint64_t> >	counts;		// of each test point
+} records_t;
+
+static std::vector<std::string>	split(const std::string &line)
+{
+    std::vector<std::string> V;
+    std::stringstream S(line);
+    std::string item;
+    while (std::getline(S, item, ',')) V.push_back(item);
+    return V;
+}
+
+static bool	load(const char *path, records_t &R)
+{
+    FILE *F = fopen(path, "r");
+    if (!F) { perror(path); return false; }
+    char buf[4096];
+    bool ok = true;
+    for (uint32_t n = 1; fgets(buf, sizeof(buf), F); n++)
+    {
+	std::string line(buf);
+	while (!line.empty() && ((line.back() == '\n') || (line.back() == '\r'))) line.pop_back();
+	if (line.empty()) continue;
+	std::vector<std::string> V = split(line);
+	if (V.size() < 2) { fprintf(stderr, "%s:%u: not a golden record\n", path, n); ok = false; continue; }
+	if (V[0] == "test")							// the header (repeated if files were concatenated)
+	{
+	    std::vector<std::string> fields(V.begin() + 2, V.end());
+	    if (!R.fields.empty() && (fields != R.fields)) { fprintf(stderr, "%s:%u: another header\n", path, n); ok = false; }
+	    R.fields = fields;
+	    continue;
+	}
+	if (V.size() != R.fields.size() + 2) { fprintf(stderr, "%s:%u: %lu fields, the header has %lu\n", path, n, V.size(), R.fields.size() + 2); ok = false; continue; }
+	std::string key = V[0] + " " + V[1];
+	for (uint32_t k = 2; R.counts.count(key); k++) key = V[0] + " " + V[1] + " #" + std::to_string(k);	// a test point run again
+	std::vector<uint64_t> &C = R.counts[key];
+	for (uint32_t i=2; i<V.size(); i++) C.push_back(strtoull(V[i].c_str(), 0, 10));
+	R.order.push_back(key);
+    }
+    fclose(F);
+    return ok;
+}
+
+int main
+(
+    int		  argc,
+    char	**argv
+)
+{
+    if (argc != 3)
+    {
+	fprintf(stderr, "usage: %s <expected> <actual>\n", argv[0]);
+	return 1;
+    }
+    records_t E, A;
+    if (!load(argv[1], E) || !load(argv[2], A)) return 1;
+
+    std::map<std::string, uint32_t> column;				// of each field of E in A
+    for (uint32_t i=0; i<A.fields.size(); i++) column[A.fields[i]] = i;
+    for (uint32_t i=0; i<E.fields.size(); i++) if (!column.count(E.fields[i])) printf("%s: field %s is not recorded\n", argv[2], E.fields[i].c_str());
+
+    uint32_t differ = 0, missing = 0, added = 0;
+    for (uint32_t p=0; p<E.order.size(); p++)
+    {
+	const std::string &key = E.order[p];
+	if (!A.counts.count(key)) { printf("%s: missing\n", key.c_str()); missing++; continue; }
+	const std::vector<uint64_t> &e = E.counts[key], &a = A.counts[key];
+	bool same = true;
+	for (uint32_t i=0; i<E.fields.size(); i++)
+	{
+	    if (!column.count(E.fields[i])) continue;
+	    uint64_t x = e[i], y = a[column[E.fields[i]]];
+	    if (x == y) continue;
+	    printf("%s: %s %lu -> %lu (%+ld, %+.2f%%)\n", key.c_str(), E.fields[i].c_str(), x, y, (int64_t)(y - x), x ? 100.0*((double)y - (double)x)/(double)x : 100.0);
+	    same = false;
+	}
+	if (!same) differ++;
+    }
+    for (uint32_t p=0; p<A.order.size(); p++) if (!E.counts.count(A.order[p])) { printf("%s: new\n", A.order[p].c_str()); added++; }
+
+    if (differ || missing || added || (E.fields.size() != A.fields.size()))
+    {
+	printf("%lu test points: %u differ, %u missing, %u new\n", E.order.size(), differ, missing, added);
+	return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,354 @@
+#include<pipelined.hh>
+#include<memcpy.hh>
+#include<vmemcpy.hh>
+#include<mxv.hh>
+#include<sgemv.hh>
+#include<spmv.hh>
+#include<stdio.h>
+#include<string.h>
+#include<map>
+
+// Parameter sweep over the kernels: runs every point of a grid on a work-stealing pool of worker threads.
+// Each worker is an isolated simulated machine (PIPELINED_THREADS), and writes one CSV or JSON row per point.
+//
+//   sweep [-j workers] [-f csv|json] [-o file] [-c config] kernel key=values ...
+//
+// kernel is memcpy, vmemcpy (parameter n), mxv, sgemv (parameters m and n) or spmv (m rows, n nonzeros per row). The other keys are machine
+// parameters (see params::keys(), e.g. L2.nways or Backend.maxissue); L1 is both L1D and L1I. Parameters not
+// in the grid come from the config file (or PIPELINED_CONFIG), else the built-in defaults.
+// values is a comma-separated list; each element is a value, a range a:b (step 1), a:b:+k or a:b:*k,
+// or a word (replacement policies, prefetchers, branch predictors). The grid is the cartesian product of all the lists.
+
+using namespace pipelined;
+
+typedef std::map<std::string, std::string>	point_t;	// one value for each key of the grid
+
+typedef struct
+{
+    u64		instructions;
+    u64		operations;
+    u64		cycles;
+    u64		accesses[4];				// L1D, L1I, L2, L3
+    u64		hits[4];
+    u64		misses[4];
+    bool	pass;
+} result_t;
+
+static const char	*levels[] = { "L1D", "L1I", "L2", "L3" };
+
+static u32	pattern(u32 i)				// deterministic data for the copy kernels
+{
+    return (i * 2654435761u) >> 24;
+}
+
+static bool	run_memcpy(u32 n, bool vector)
+{
+    const u32 src = 0;
+    const u32 dst = ((n + 1023) / 1024) * 1024;	// 1024, as in Tests/memcpy.cc, unless n is larger
+    assert(dst + n <= MEM.size());
+    for (u32 i=0; i<n; i++) MEM[src + i] = pattern(i);
+
+    GPR[3].data() = dst;
+    GPR[4].data() = src;
+    GPR[5].data() = n;
+    if (vector) pipelined::vmemcpy(0,0,0);
+    else        pipelined::memcpy(0,0,0);
+    caches::L2.flush();
+    caches::L3.flush();
+    caches::L1D.flush();
+
+    for (u32 i=0; i<n; i++) if (MEM[dst + i] != MEM[src + i]) return false;
+    return true;
+}
+
+static bool	run_mxv(u32 m, u32 n)
+{
+    const u32 Y = 0;
+    const u32 X = Y + m*sizeof(double);
+    const u32 A = X + n*sizeof(double);
+    assert(A + m*n*sizeof(double) <= MEM.size());
+    for (u32 i=0; i<m; i++) *((double*)(MEM.data() + Y + i*sizeof(double))) = 0.0;
+    for (u32 j=0; j<n; j++) *((double*)(MEM.data() + X + j*sizeof(double))) = (double)j;
+    for (u32 i=0; i<m; i++) for (u32 j=0; j<n; j++) *((double*)(MEM.data() + A + (i*n+j)*sizeof(double))) = (double)i;
+
+    GPR[3].data() = Y;
+    GPR[4].data() = A;
+    GPR[5].data() = X;
+    GPR[6].data() = m;
+    GPR[7].data() = n;
+    mxv(0,0,0,0,0);
+    caches::L2.flush();
+    caches::L3.flush();
+    caches::L1D.flush();
+
+    for (u32 i=0; i<m; i++) if (*((double*)(MEM.data() + Y + i*sizeof(double))) != ((n*(n-1))/2)*i) return false;
+    return true;
+}
+
+static bool	run_sgemv(u32 m, u32 n)
+{
+    const u32 Y = 0;
+    const u32 X = Y + m*sizeof(float);
+    const u32 A = X + n*sizeof(float);
+    assert(A + m*n*sizeof(float) <= MEM.size());
+    for (u32 i=0; i<m; i++) *((float*)(MEM.data() + Y + i*sizeof(float))) = 0.0;
+    for (u32 j=0; j<n; j++) *((float*)(MEM.data() + X + j*sizeof(float))) = 1.0;	// sums stay exact in single precision for large n
+    for (u32 i=0; i<m; i++) for (u32 j=0; j<n; j++) *((float*)(MEM.data() + A + (i+m*j)*sizeof(float))) = (float)i;
+
+    GPR[3].data() = Y;
+    GPR[4].data() = A;
+    GPR[5].data() = X;
+    GPR[6].data() = m;
+    GPR[7].data() = n;
+    GPR[8].data() = m;
+    sgemv((float*)(MEM.data() + Y), (float*)(MEM.data() + A), (float*)(MEM.data() + X), m, n, m);
+    caches::L2.flush();
+    caches::L3.flush();
+    caches::L1D.flush();
+
+    for (u32 i=0; i<m; i++) if (*((float*)(MEM.data() + Y + i*sizeof(float))) != (float)n*i) return false;
+    return true;
+}
+
+static bool	run_spmv(u32 m, u32 n)				// m x m, n nonzeros per row
+{
+    const u32 k = std::min(n, m);
+    const u32 Y = 0;
+    const u32 X = Y + m*sizeof(double);
+    const u32 R = X + m*sizeof(double);
+    const u32 C = R + (m + 1)*sizeof(u32);
+    const u32 V = (C + m*k*sizeof(u32) + 7) & ~7;
+    std::vector<double> y(m, 0.0);
+    for (u32 j=0; j<m; j++) *((double*)(MEM.data() + X + j*sizeof(double))) = (double)j;
+    for (u32 i=0; i<=m; i++) *((u32*)(MEM.data() + R + i*sizeof(u32))) = i*k;
+    for (u32 i=0; i<m; i++) for (u32 l=0; l<k; l++)
+    {
+	u32 j = (i*7 + l*(m/k)) % m;					// as in Tests/spmv.cc
+	*((u32*)(MEM.data() + C + (i*k + l)*sizeof(u32))) = j;
+	*((double*)(MEM.data() + V + (i*k + l)*sizeof(double))) = (double)(i + l + 1);
+	y[i] += (double)(i + l + 1)*(double)j;
+    }
+
+    GPR[3].data() = Y;
+    GPR[4].data() = V;
+    GPR[5].data() = C;
+    GPR[6].data() = R;
+    GPR[7].data() = X;
+    GPR[8].data() = m;
+    spmv(0,0,0,0,0,0);
+    caches::L2.flush();
+    caches::L3.flush();
+    caches::L1D.flush();
+
+    for (u32 i=0; i<m; i++) if (*((double*)(MEM.data() + Y + i*sizeof(double))) != y[i]) return false;
+    return true;
+}
+
+static u32	argument(const point_t &P, const char *key, u32 value)	// kernel parameter key at point P (value if not in the grid)
+{
+    point_t::const_iterator it = P.find(key);
+    return it == P.end() ? value : strtoul(it->second.c_str(), 0, 0);
+}
+
+static bool	setup(const point_t &base, const point_t &P)	// set this worker's parameters to base, changed by the machine keys of P
+{
+    bool ok = true;
+    for (point_t::const_iterator it = base.begin(); it != base.end(); it++) ok = params::set(it->first, it->second) && ok;
+    for (point_t::const_iterator it = P.begin(); it != P.end(); it++) if ((it->first != "m") && (it->first != "n")) ok = params::set(it->first, it->second) && ok;
+    return ok;
+}
+
+static result_t	simulate(const std::string &kernel, const point_t &base, const point_t &P)
+{
+    bool ok = setup(base, P); assert(ok);
+    params::configure();
+
+    result_t R;
+    if      (kernel == "memcpy")  R.pass = run_memcpy(argument(P, "n", 1024), false);
+    else if (kernel == "vmemcpy") R.pass = run_memcpy(argument(P, "n", 1024), true);
+    else if (kernel == "mxv")     R.pass = run_mxv(argument(P, "m", 4), argument(P, "n", 4));
+    else if (kernel == "sgemv")   R.pass = run_sgemv(argument(P, "m", 4), argument(P, "n", 4));
+    else                          R.pass = run_spmv(argument(P, "m", 4), argument(P, "n", 4));
+
+    R.instructions = counters::instructions;
+    R.operations = counters::operations;
+    R.cycles = counters::cycles;
+    caches::cache *C[4] = { &caches::L1D, &caches::L1I, &caches::L2, &caches::L3 };
+    for (u32 l=0; l<4; l++) { R.accesses[l] = C[l]->accesses; R.hits[l] = C[l]->hits; R.misses[l] = C[l]->misses; }
+    return R;
+}
+
+class workers					// work-stealing pool: each worker takes from the back of its own queue, and steals from the front of the others
+{
+    private:
+	typedef struct
+	{
+	    std::mutex		lock;
+	    std::deque<u32>	items;
+	} queue_t;
+
+	std::vector<queue_t>	_queues;
+
+	bool	take(u32 w, u32 &item)
+	{
+	    for (u32 k=0; k<_queues.size(); k++)
+	    {
+		queue_t &Q = _queues[(w + k) % _queues.size()];
+		std::lock_guard<std::mutex> guard(Q.lock);
+		if (Q.items.empty()) continue;
+		if (k == 0) { item = Q.items.back();  Q.items.pop_back();  }	// own work, most recently queued
+		else        { item = Q.items.front(); Q.items.pop_front(); }	// stolen work, oldest first
+		return true;
+	    }
+	    return false;
+	}
+
+    public:
+	workers(u32 n) : _queues(n) { }
+
+	template<typename F> void run(u32 nitems, F work)		// call work(item) for items [0, nitems), on all workers
+	{
+	    for (u32 i=0; i<nitems; i++) _queues[i % _queues.size()].items.push_front(i);
+	    std::vector<std::thread> threads;
+	    for (u32 w=0; w<_queues.size(); w++) threads.push_back(std::thread([this, w, work]() { u32 item; while (take(w, item)) work(item); }));
+	    for (u32 w=0; w<threads.size(); w++) threads[w].join();
+	}
+};
+
+static bool	values(const std::string &list, std::vector<std::string> &V)	// expand a list of values
+{
+    size_t start = 0;
+    while (start <= list.size())
+    {
+	size_t end = list.find(',', start); if (end == std::string::npos) end = list.size();
+	std::string item = list.substr(start, end - start);
+	start = end + 1;
+	if (item.empty()) return false;
+	if (!isdigit(item[0])) { V.push_back(item); continue; }		// a word, checked by params::set
+	unsigned long a, b, step = 1; char op = '+';
+	if      (sscanf(item.c_str(), "%lu:%lu:%c%lu", &a, &b, &op, &step) == 4) { }
+	else if (sscanf(item.c_str(), "%lu:%lu", &a, &b) == 2 && item.find(':', item.find(':') + 1) == std::string::npos) { }
+	else if (item.find(':') == std::string::npos) { V.push_back(item); continue; }	// a value (sizes can have a K or M suffix)
+	else return false;
+	if (((op != '+') && (op != '*')) || ((op == '*') && (step < 2)) || ((op == '+') && (step < 1)) || (a > b) || ((op == '*') && (a == 0))) return false;
+	for (unsigned long v = a; v <= b; v = (op == '*') ? v*step : v+step) V.push_back(std::to_string(v));
+    }
+    return !V.empty();
+}
+
+int main
+(
+    int		  argc,
+    char	**argv
+)
+{
+    u32		nworkers = std::thread::hardware_concurrency();
+    bool	json = false;
+    FILE	*out = stdout;
+    const char	*config = getenv("PIPELINED_CONFIG");
+    int		arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; arg += 2)
+    {
+	if (arg + 1 >= argc) break;
+	if      (!strcmp(argv[arg], "-j")) nworkers = atoi(argv[arg+1]);
+	else if (!strcmp(argv[arg], "-f")) json = !strcmp(argv[arg+1], "json");
+	else if (!strcmp(argv[arg], "-o")) { out = fopen(argv[arg+1], "w"); if (!out) { perror(argv[arg+1]); return 1; } }
+	else if (!strcmp(argv[arg], "-c")) config = argv[arg+1];
+	else break;
+    }
+    if (arg >= argc)
+    {
+	fprintf(stderr, "usage: %s [-j workers] [-f csv|json] [-o file] [-c config] memcpy|vmemcpy|mxv|sgemv|spmv key=values ...\n", argv[0]);
+	return 1;
+    }
+    std::string kernel = argv[arg++];
+    if ((kernel != "memcpy") && (kernel != "vmemcpy") && (kernel != "mxv") && (kernel != "sgemv") && (kernel != "spmv"))
+    {
+	fprintf(stderr, "unknown kernel %s\n", kernel.c_str());
+	return 1;
+    }
+    if (nworkers == 0) nworkers = 1;
+    if (config && !params::load(config)) return 1;
+
+    point_t base;					// the parameters of every point, before the grid changes them
+    std::vector<std::string> keys = params::keys();
+    for (u32 k=0; k<keys.size(); k++) base[keys[k]] = params::get(keys[k]);
+    keys.push_back("m");
+    keys.push_back("n");
+
+    std::vector<std::string>			names;		// keys of the grid, in command line order
+    std::vector<std::vector<std::string> >	lists;		// values of each key
+    for (; arg < argc; arg++)
+    {
+	std::string a = argv[arg];
+	size_t eq = a.find('=');
+	std::string key = a.substr(0, eq);
+	std::vector<std::string> V;
+	if ((eq == std::string::npos) || (std::find(keys.begin(), keys.end(), key) == keys.end()) || !values(a.substr(eq + 1), V))
+	{
+	    fprintf(stderr, "bad grid argument %s\n", argv[arg]);
+	    return 1;
+	}
+	names.push_back(key);
+	lists.push_back(V);
+    }
+
+    std::vector<point_t> points;				// the cartesian product, last key varying fastest
+    std::vector<u32> ix(names.size(), 0);
+    while (true)
+    {
+	point_t P;
+	for (u32 k=0; k<names.size(); k++) P[names[k]] = lists[k][ix[k]];
+	if (!setup(base, P)) return 1;
+	std::string why = params::check();
+	if (!why.empty()) { fprintf(stderr, "bad configuration: %s\n", why.c_str()); return 1; }
+	points.push_back(P);
+	int k = names.size() - 1;
+	while ((k >= 0) && (++ix[k] == lists[k].size())) ix[k--] = 0;
+	if (k < 0) break;
+    }
+
+    std::vector<result_t> results(points.size());
+    workers pool(std::min<u32>(nworkers, points.size()));
+    pool.run(points.size(), [&](u32 i) { results[i] = simulate(kernel, base, points[i]); });
+
+    if (json) fprintf(out, "[\n");
+    else
+    {
+	fprintf(out, "kernel");
+	for (u32 k=0; k<names.size(); k++) fprintf(out, ",%s", names[k].c_str());
+	fprintf(out, ",instructions,operations,cycles");
+	for (u32 l=0; l<4; l++) fprintf(out, ",%s.accesses,%s.hits,%s.misses", levels[l], levels[l], levels[l]);
+	fprintf(out, ",pass\n");
+    }
+    bool pass = true;
+    for (u32 i=0; i<points.size(); i++)
+    {
+	const result_t &R = results[i];
+	if (json)
+	{
+	    fprintf(out, "  { \"kernel\": \"%s\"", kernel.c_str());
+	    for (u32 k=0; k<names.size(); k++)
+	    {
+		const std::string &v = points[i].at(names[k]);
+		if (v.find_first_not_of("0123456789") == std::string::npos) fprintf(out, ", \"%s\": %s", names[k].c_str(), v.c_str());
+		else							    fprintf(out, ", \"%s\": \"%s\"", names[k].c_str(), v.c_str());
+	    }
+	    fprintf(out, ", \"instructions\": %lu, \"operations\": %lu, \"cycles\": %lu", R.instructions, R.operations, R.cycles);
+	    for (u32 l=0; l<4; l++) fprintf(out, ", \"%s\": { \"accesses\": %lu, \"hits\": %lu, \"misses\": %lu }", levels[l], R.accesses[l], R.hits[l], R.misses[l]);
+	    fprintf(out, ", \"pass\": %s }%s\n", R.pass ? "true" : "false", (i + 1 < points.size()) ? "," : "");
+	}
+	else
+	{
+	    fprintf(out, "%s", kernel.c_str());
+	    for (u32 k=0; k<names.size(); k++) fprintf(out, ",%s", points[i].at(names[k]).c_str());
+	    fprintf(out, ",%lu,%lu,%lu", R.instructions, R.operations, R.cycles);
+	    for (u32 l=0; l<4; l++) fprintf(out, ",%lu,%lu,%lu", R.accesses[l], R.hits[l], R.misses[l]);
+	    fprintf(out, ",%s\n", R.pass ? "PASS" : "FAIL");
+	}
+	if (!R.pass) pass = false;
+    }
+    if (json) fprintf(out, "]\n");
+    if (out != stdout) fclose(out);
+    return pass ? 0 : 1;
+}
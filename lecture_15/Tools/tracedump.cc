@@ -0,0 +1,128 @@
+#include<trace.hh>
+#include<stdio.h>
+#include<string.h>
+
+// Turns a binary trace (PIPELINED_TRACE=file) back into the CSV produced by text tracing (PIPELINED_TRACE=-)
+
+using namespace pipelined;
+
+static FILE	*in;
+
+static bool	get(uint64_t &v)			// read one varint, false at end of file
+{
+    v = 0;
+    for (uint32_t shift = 0; ; shift += 7)
+    {
+	int c = getc(in);
+	if (c == EOF) return false;
+	v |= (uint64_t)(c & 0x7f) << shift;
+	if (!(c & 0x80)) return true;
+    }
+}
+
+static uint64_t	u()					// read an unsigned value
+{
+    uint64_t v; bool ok = get(v); assert(ok);
+    return v;
+}
+
+static int64_t	i()					// read a signed value
+{
+    return trace::unzigzag(u());
+}
+
+static std::string	bytes()				// read a string
+{
+    uint64_t n = u();
+    std::string s(n, ' ');
+    size_t r = fread(&s[0], 1, n, in); assert(r == n);
+    return s;
+}
+
+static void	define(std::vector<std::string> &table)	// read an entry of the format or string table
+{
+    uint64_t id = u();
+    if (id >= table.size()) table.resize(id + 1);
+    table[id] = bytes();
+}
+
+static void	operands(trace::operands_t &O)
+{
+    O.format = u();
+    O.nargs = u(); assert(O.nargs <= 4);
+    for (uint32_t k=0; k<O.nargs; k++) O.args[k] = i();
+}
+
+int main
+(
+    int		  argc,
+    char	**argv
+)
+{
+    if (argc != 2)
+    {
+	fprintf(stderr, "usage: %s <trace file>\n", argv[0]);
+	return 1;
+    }
+    in = fopen(argv[1], "rb");
+    if (!in)
+    {
+	perror(argv[1]);
+	return 1;
+    }
+    char magic[sizeof(trace::magic)];
+    if ((fread(magic, 1, sizeof(magic), in) != sizeof(magic)) || memcmp(magic, trace::magic, sizeof(magic)))
+    {
+	fprintf(stderr, "%s: not a trace file\n", argv[1]);
+	return 1;
+    }
+
+    std::vector<std::string>	formats;
+    std::vector<std::string>	strings;
+    uint64_t			icount = 0, ocount = 0, fetched = 0, dispatched = 0;
+    trace::operands_t		O;
+    uint64_t			kind;
+    while (get(kind))
+    {
+	switch (kind)
+	{
+	    case trace::FORMAT:
+		define(formats);
+		break;
+	    case trace::STRING:
+		define(strings);
+		break;
+	    case trace::HEADER:
+		printf("%s\n", trace::header);
+		break;
+	    case trace::INSTRUCTION:
+		{
+		    icount += i();
+		    uint32_t addr = u();
+		    bool hit = u();
+		    operands(O);
+		    fetched += i();
+		    uint64_t decoded = fetched + i();
+		    dispatched = decoded + i();
+		    printf("%07lu , 0x%04x%c, %30s , %07lu , %07lu , %07lu , ", icount, addr, hit ? '*' : ' ',
+			   trace::text(O, formats, strings).c_str(), fetched, decoded, dispatched);
+		}
+		break;
+	    case trace::OPERATION:
+		{
+		    ocount += i();
+		    operands(O);
+		    uint64_t ready = dispatched + i();
+		    uint64_t issue = ready + i();
+		    uint64_t complete = issue + i();
+		    printf("%08lu , %32s , %08lu , %08lu , %08lu\n", ocount, trace::text(O, formats, strings).c_str(), ready, issue, complete);
+		}
+		break;
+	    default:
+		fprintf(stderr, "%s: bad record kind %lu\n", argv[1], kind);
+		return 1;
+	}
+    }
+    fclose(in);
+    return 0;
+}